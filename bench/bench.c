@@ -0,0 +1,193 @@
+/**
+ * Microbenchmarks, run in the s51 simulator of SDCC (ucsim), see bench/run-bench.py
+ *
+ * Each benchmark is enclosed in BENCH_BEGIN / BENCH_END, the script sets a breakpoint
+ * on benchBegin() / benchEnd() and reads the clock counter of the simulator at each stop.
+ * The benchmark names are parsed from this file, in the order of BENCH_BEGIN.
+ *
+ * s51 simulates a standard 8051 with 12 clocks per machine cycle, the CH554 needs
+ * less clocks per instruction, so the numbers are only comparable to each other.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "../lib/inc.h"
+#include "../lib/hardware.h"
+#include "../lib/usb-cdc.h"
+#include "../lib/dataflash.h"
+#include "../lib/crc.h"
+
+/**
+ * Start of a benchmark, the name is only used by the script
+ */
+#define BENCH_BEGIN(name) benchBegin()
+
+/**
+ * End of a benchmark
+ */
+#define BENCH_END() benchEnd()
+
+/**
+ * Call the USB interrupt handler, it returns with RETI,
+ * which is the same as RET, if no interrupt is active
+ */
+#ifdef IDE_ENVIRONMENT
+#define CALL_USB_INTERRUPT() usbInterrupt()
+#else
+#define CALL_USB_INTERRUPT() \
+	__asm \
+		lcall _usbInterrupt \
+	__endasm
+#endif
+
+// Internal state of lib/usb-cdc.c
+extern volatile __data uint8_t g_UpPoint2_Busy;
+
+/**
+ * Test data, a descriptor sized block in code memory
+ */
+__code uint8_t g_BenchCode[64] = {
+	0x09, 0x02, 0x43, 0x00, 0x02, 0x01, 0x00, 0x80, 0x32
+};
+
+/**
+ * Buffer in XRAM
+ */
+__xdata uint8_t g_BenchXdata[64];
+
+/**
+ * SETUP packet: GET_DESCRIPTOR configuration, 255 bytes, the descriptor
+ * is longer than one packet, so the EP0 IN interrupt sends the next block
+ */
+__code uint8_t g_BenchSetup[8] = {
+	0x80, USB_GET_DESCRIPTOR, 0x00, 0x02, 0x00, 0x00, 0xff, 0x00
+};
+
+/**
+ * Breakpoint: benchmark starts
+ */
+void benchBegin() {
+}
+
+/**
+ * Breakpoint: benchmark ends
+ */
+void benchEnd() {
+}
+
+/**
+ * Before each UsbCdc_puts(): configured, endpoint not busy
+ */
+void benchPutsReady() {
+	g_UsbConfig = 1;
+	g_UpPoint2_Busy = 0;
+}
+
+/**
+ * Run all benchmarks
+ */
+void main() {
+	uint8_t i;
+	__xdata uint8_t* dst;
+	__code uint8_t* src;
+
+	// Calibration: overhead of the breakpoint functions, subtracted from all results
+	BENCH_BEGIN("empty");
+	BENCH_END();
+
+	benchPutsReady();
+	BENCH_BEGIN("UsbCdc_puts 25 bytes");
+	UsbCdc_puts("ABCDEFGHIJKLMNOPQRSTUVWXY");
+	BENCH_END();
+
+	benchPutsReady();
+	BENCH_BEGIN("UsbCdc_puts 1 byte");
+	UsbCdc_puts("A");
+	BENCH_END();
+
+	benchPutsReady();
+	BENCH_BEGIN("UsbCdc_puti 255");
+	UsbCdc_puti(255);
+	BENCH_END();
+
+	BENCH_BEGIN("ReadDataFlash 15 bytes");
+	ReadDataFlash(0, 15, g_BenchXdata);
+	BENCH_END();
+
+	// ROM_STATUS is the same register as ROM_CTRL, s51 does not simulate the flash,
+	// after the first byte the status would be wrong, so only one byte is written
+	ROM_CTRL = bROM_ADDR_OK;
+	BENCH_BEGIN("WriteDataFlash 1 byte");
+	WriteDataFlash(0, g_BenchXdata, 1);
+	BENCH_END();
+
+	BENCH_BEGIN("memcpy xdata 64 bytes");
+	memcpy(g_BenchXdata, Ep2Buffer, 64);
+	BENCH_END();
+
+	BENCH_BEGIN("memcpy code to xdata 64 bytes");
+	memcpy(g_BenchXdata, g_BenchCode, 64);
+	BENCH_END();
+
+	BENCH_BEGIN("loop copy code to xdata 64 bytes");
+	dst = g_BenchXdata;
+	src = g_BenchCode;
+	for (i = 0; i < 64; i++) {
+		*dst++ = *src++;
+	}
+	BENCH_END();
+
+	// CRC, for the strategy selected with CRC_STRATEGY, see make bench-crc
+	BENCH_BEGIN("crc8 64 bytes");
+	crc8(CRC8_INIT, g_BenchXdata, 64);
+	BENCH_END();
+
+	BENCH_BEGIN("crc16 64 bytes");
+	crc16(CRC16_INIT, g_BenchXdata, 64);
+	BENCH_END();
+
+	BENCH_BEGIN("crc32 64 bytes");
+	crc32(CRC32_INIT, g_BenchXdata, 64);
+	BENCH_END();
+
+	// USB interrupt paths
+
+	UEP2_T_LEN = 25;
+	USB_INT_ST = UIS_TOKEN_IN | 2;
+	UIF_TRANSFER = 1;
+	BENCH_BEGIN("ISR EP2 IN");
+	CALL_USB_INTERRUPT();
+	BENCH_END();
+
+	USB_RX_LEN = 1;
+	USB_INT_ST = UIS_TOKEN_OUT | 2;
+	U_TOG_OK = 1;
+	UIF_TRANSFER = 1;
+	BENCH_BEGIN("ISR EP2 OUT");
+	CALL_USB_INTERRUPT();
+	BENCH_END();
+
+	memcpy(Ep0Buffer, g_BenchSetup, sizeof(g_BenchSetup));
+	USB_RX_LEN = sizeof(g_BenchSetup);
+	USB_INT_ST = UIS_TOKEN_SETUP | 0;
+	UIF_TRANSFER = 1;
+	BENCH_BEGIN("ISR SETUP GET_DESCRIPTOR");
+	CALL_USB_INTERRUPT();
+	BENCH_END();
+
+	// transmitSetupBlock() uses the register bank of the interrupt, and is
+	// therefore measured in the interrupt: the second block of the descriptor
+	USB_INT_ST = UIS_TOKEN_IN | 0;
+	UIF_TRANSFER = 1;
+	BENCH_BEGIN("ISR EP0 IN transmitSetupBlock");
+	CALL_USB_INTERRUPT();
+	BENCH_END();
+
+	UIF_BUS_RST = 1;
+	BENCH_BEGIN("ISR bus reset");
+	CALL_USB_INTERRUPT();
+	BENCH_END();
+
+	while (1);
+}
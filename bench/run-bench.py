@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+# Run the microbenchmarks of bench/bench.c in the s51 simulator (ucsim, part of SDCC)
+# and compare the clock counts to the stored baseline
+#
+# run-bench.py bench.ihx baseline.txt            Run, print the difference to the baseline
+# run-bench.py bench.ihx baseline.txt --update   Run, and store the result as new baseline
+#
+# Benchmarks named "... <n> bytes" additionally show the throughput at --clock,
+# with the s51 clock count, the CH554 needs less clocks, so it's a lower bound
+#
+# Exit code 1 if a benchmark got slower than the tolerance, 2 if s51 failed. A missing baseline,
+# or a benchmark without entry, is only a warning (only --update creates it)
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+path = os.path.dirname(os.path.realpath(__file__))
+
+parser = argparse.ArgumentParser(description='Cycle counts of the microbenchmarks')
+parser.add_argument('image', help='bench.ihx, the .map file is expected next to it')
+parser.add_argument('baseline', help='Baseline file')
+parser.add_argument('--update', action='store_true', help='Store the result as new baseline')
+parser.add_argument('--tolerance', type=float, default=0, help='Allowed regression in percent, default 0')
+parser.add_argument('--s51', default='s51', help='s51 executable')
+parser.add_argument('--clock', type=float, default=24e6, help='Clock for the bytes per second, default 24 MHz')
+args = parser.parse_args()
+
+# Benchmark names, in the order of execution
+with open(path + '/bench.c', 'r') as f:
+	names = re.findall(r'BENCH_BEGIN\("([^"]+)"\)', f.read())
+
+
+def symbolAddress(mapFile, symbol):
+	"""
+	Code address of a symbol from the SDCC linker map
+	"""
+	with open(mapFile, 'r') as f:
+		for line in f:
+			m = re.match(r'\s*C:\s+([0-9A-Fa-f]+)\s+' + symbol + r'\s', line)
+			if m:
+				return int(m.group(1), 16)
+
+	print('Symbol ' + symbol + ' not found in ' + mapFile)
+	sys.exit(2)
+
+
+mapFile = os.path.splitext(args.image)[0] + '.map'
+begin = symbolAddress(mapFile, '_benchBegin')
+end = symbolAddress(mapFile, '_benchEnd')
+
+# Each run stops at the next breakpoint, state prints the clock counter
+commands = 'break 0x%x\nbreak 0x%x\n' % (begin, end)
+commands += 'run\nstate\n' * (len(names) * 2)
+commands += 'quit\n'
+
+output = subprocess.run([args.s51, '-t', '8052', args.image], input=commands,
+		stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True).stdout
+
+clocks = [int(c) for c in re.findall(r'\((\d+) clks\)', output)]
+if len(clocks) < len(names) * 2:
+	print(output)
+	print('Expected ' + str(len(names) * 2) + ' breakpoint stops, got ' + str(len(clocks)))
+	sys.exit(2)
+
+results = {}
+for i, name in enumerate(names):
+	results[name] = clocks[i * 2 + 1] - clocks[i * 2]
+
+# The first benchmark is empty, the call overhead of the breakpoint functions
+overhead = results[names[0]]
+for name in names:
+	results[name] -= overhead
+
+baseline = {}
+if os.path.exists(args.baseline):
+	with open(args.baseline, 'r') as f:
+		for line in f:
+			if line.startswith('#') or not line.strip():
+				continue
+			value, name = line.rstrip('\n').split(' ', 1)
+			baseline[name] = int(value)
+
+
+def throughput(name, value):
+	"""
+	Bytes per second, for benchmarks named "... <n> bytes"
+	"""
+	m = re.search(r'(\d+) bytes?$', name)
+	if not m or value <= 0:
+		return ''
+	return '  %8.0f B/s' % (int(m.group(1)) * args.clock / value)
+
+
+regression = False
+missing = False
+print('%-36s %10s %10s %8s' % ('Benchmark', 'Clocks', 'Baseline', 'Diff'))
+for name in names:
+	value = results[name]
+	if name in baseline:
+		diff = value - baseline[name]
+		percent = diff * 100.0 / baseline[name] if baseline[name] else 0
+		marker = ''
+		if percent > args.tolerance and diff > 0:
+			marker = ' SLOWER'
+			regression = True
+		print('%-36s %10d %10d %+7.1f%%%s%s' % (name, value, baseline[name], percent, throughput(name, value), marker))
+	else:
+		print('%-36s %10d %10s %8s%s MISSING' % (name, value, '-', '', throughput(name, value)))
+		missing = True
+
+if args.update:
+	with open(args.baseline, 'w') as f:
+		f.write('# s51 clocks per benchmark, generated by bench/run-bench.py --update\n')
+		for name in names:
+			f.write('%d %s\n' % (results[name], name))
+	print('Baseline written to ' + args.baseline)
+	sys.exit(0)
+
+if missing:
+	print('Warning: benchmarks without baseline, store them with --update and commit ' + args.baseline)
+
+sys.exit(1 if regression else 0)
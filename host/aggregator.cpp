@@ -0,0 +1,526 @@
+/**
+ * Read the sample frames (command F of logic.c) of many devices at once, and merge
+ * them into one output ordered by timestamp. One thread, all CDC ports are read
+ * non blocking from one epoll loop, so dozens of devices need no thread per device.
+ *
+ * aggregator                        All devices with VID / PID / serial of usb-descriptor.json
+ * aggregator -n 10000               10000 frames per device, then exit
+ * aggregator -t 60 -o capture.txt   Endless, stop after 60 seconds
+ * aggregator /tmp/ttyCH55X-0 /tmp/ttyCH55X-1   Given ports, e.g. the simulation (sim/pty.c)
+ *
+ * Output, one line per frame: <time s> <device index> <sequence> <samples...>
+ * The time is the host time the frame was read (CLOCK_MONOTONIC, since start).
+ * Frames are held back for the merge window (-w), so a device read a bit later
+ * in the same loop iteration is still sorted in.
+ * Statistics per device are written to stderr every -i seconds.
+ *
+ * Exit code 1 if a device failed, lost frames or sent invalid frames
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "frame-decoder.h"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <libgen.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+/**
+ * Samples per sample frame, see logic.c
+ */
+#define FRAME_SAMPLES 8
+
+/**
+ * Frames requested with -n 0 (endless), the max of the F command
+ */
+#define FRAMES_ENDLESS 4294967295UL
+
+/**
+ * Max epoll events per loop iteration
+ */
+#define EVENTS_MAX 64
+
+/**
+ * Exit with -n if no device sent anything for this time
+ */
+#define IDLE_TIMEOUT_NS 5000000000LL
+
+struct Device {
+	std::string path;
+	int fd = -1;
+	FrameDecoder decoder;
+
+	/**
+	 * Next expected sequence number, unwrapped, -1 before the first frame
+	 */
+	int64_t expected = -1;
+
+	uint64_t bytes = 0;
+	uint64_t records = 0;
+	uint64_t lost = 0;
+	uint64_t reordered = 0;
+
+	/**
+	 * Counters at the last statistics output
+	 */
+	uint64_t lastBytes = 0;
+	uint64_t lastRecords = 0;
+
+	bool failed = false;
+};
+
+struct Record {
+	int64_t timeNs;
+	uint32_t device;
+	uint64_t sequence;
+	uint16_t samples[FRAME_SAMPLES];
+};
+
+/**
+ * Min heap order: time, then device, then sequence
+ */
+struct RecordLater {
+	bool operator()(const Record& a, const Record& b) const {
+		if (a.timeNs != b.timeNs) {
+			return a.timeNs > b.timeNs;
+		}
+		if (a.device != b.device) {
+			return a.device > b.device;
+		}
+		return a.sequence > b.sequence;
+	}
+};
+
+static std::vector<Device> g_devices;
+static std::priority_queue<Record, std::vector<Record>, RecordLater> g_merge;
+static FILE* g_output = stdout;
+static int64_t g_startNs = 0;
+static uint8_t g_readBuffer[65536];
+
+/**
+ * CLOCK_MONOTONIC in ns
+ */
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Content of a small file, without trailing whitespace, empty on error
+ */
+static std::string readFile(const std::string& path) {
+	std::string content;
+	char buffer[4096];
+
+	FILE* f = fopen(path.c_str(), "r");
+	if (f == nullptr) {
+		return content;
+	}
+
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		content.append(buffer, length);
+	}
+	fclose(f);
+
+	while (!content.empty() && (content.back() == '\n' || content.back() == ' ' || content.back() == '\r')) {
+		content.pop_back();
+	}
+
+	return content;
+}
+
+/**
+ * String value of a top level key of usb-descriptor.json, no JSON parser needed for this
+ */
+static std::string jsonString(const std::string& json, const std::string& key) {
+	size_t pos = json.find("\"" + key + "\"");
+	if (pos == std::string::npos) {
+		return "";
+	}
+
+	pos = json.find(':', pos);
+	size_t start = json.find('"', pos);
+	size_t end = json.find('"', start + 1);
+	if (pos == std::string::npos || start == std::string::npos || end == std::string::npos) {
+		return "";
+	}
+
+	return json.substr(start + 1, end - start - 1);
+}
+
+/**
+ * CDC ports of the devices with this VID / PID / serial, from sysfs
+ */
+static std::vector<std::string> discover(const std::string& vendor, const std::string& product, const std::string& serial) {
+	std::vector<std::string> ports;
+	char real[PATH_MAX];
+
+	DIR* dir = opendir("/sys/class/tty");
+	if (dir == nullptr) {
+		return ports;
+	}
+
+	while (struct dirent* entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "ttyACM", 6) != 0) {
+			continue;
+		}
+
+		// The device link points to the USB interface, the parent is the USB device
+		std::string link = std::string("/sys/class/tty/") + entry->d_name + "/device";
+		if (realpath(link.c_str(), real) == nullptr) {
+			continue;
+		}
+		std::string usb = dirname(real);
+
+		if (readFile(usb + "/idVendor") != vendor || readFile(usb + "/idProduct") != product) {
+			continue;
+		}
+		if (!serial.empty() && readFile(usb + "/serial") != serial) {
+			continue;
+		}
+
+		ports.push_back(std::string("/dev/") + entry->d_name);
+	}
+	closedir(dir);
+
+	std::sort(ports.begin(), ports.end());
+	return ports;
+}
+
+/**
+ * Open the port raw and non blocking, and start the frames
+ */
+static bool deviceOpen(Device& device, unsigned long frames) {
+	struct termios tio;
+	char command[32];
+
+	device.fd = open(device.path.c_str(), O_RDWR | O_NONBLOCK | O_NOCTTY);
+	if (device.fd < 0) {
+		fprintf(stderr, "%s: %s\n", device.path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if (tcgetattr(device.fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(device.fd, TCSANOW, &tio);
+	}
+	tcflush(device.fd, TCIOFLUSH);
+
+	int length = snprintf(command, sizeof(command), "F %lu\n", frames);
+	if (write(device.fd, command, length) != length) {
+		fprintf(stderr, "%s: start command: %s\n", device.path.c_str(), strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void deviceClose(Device& device, bool stopFrames) {
+	if (device.fd < 0) {
+		return;
+	}
+
+	if (stopFrames) {
+		if (write(device.fd, "F 0\n", 4) != 4) {
+			// Device already gone
+		}
+	}
+
+	close(device.fd);
+	device.fd = -1;
+}
+
+/**
+ * Decode the received data, and add the sample frames to the merge
+ */
+static void deviceRead(Device& device, uint32_t index) {
+	ssize_t length = read(device.fd, g_readBuffer, sizeof(g_readBuffer));
+	int64_t timeNs = nowNs();
+
+	if (length < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return;
+	}
+
+	if (length <= 0) {
+		fprintf(stderr, "%s: disconnected\n", device.path.c_str());
+		device.failed = true;
+		deviceClose(device, false);
+		return;
+	}
+
+	device.bytes += length;
+
+	device.decoder.feed(g_readBuffer, length, [&](uint8_t type, const uint8_t* payload, uint8_t payloadLength) {
+		if (type != FRAME_TYPE_SAMPLES || payloadLength != 2 + FRAME_SAMPLES * 2) {
+			return;
+		}
+
+		// 16 bit sequence on the device, unwrapped
+		uint16_t sequence16 = payload[0] | (payload[1] << 8);
+		uint64_t sequence = sequence16;
+		if (device.expected >= 0) {
+			uint16_t diff = sequence16 - (uint16_t) device.expected;
+			if (diff >= 0x8000) {
+				device.reordered++;
+				return;
+			}
+			device.lost += diff;
+			sequence = device.expected + diff;
+		}
+		device.expected = sequence + 1;
+		device.records++;
+
+		Record record;
+		record.timeNs = timeNs;
+		record.device = index;
+		record.sequence = sequence;
+		for (int i = 0; i < FRAME_SAMPLES; i++) {
+			record.samples[i] = payload[2 + i * 2] | (payload[3 + i * 2] << 8);
+		}
+		g_merge.push(record);
+	});
+}
+
+/**
+ * Write the merged records up to this time
+ */
+static void mergeFlush(int64_t untilNs) {
+	while (!g_merge.empty() && g_merge.top().timeNs <= untilNs) {
+		const Record& record = g_merge.top();
+
+		fprintf(g_output, "%.6f %u %llu", (record.timeNs - g_startNs) / 1e9, record.device,
+				(unsigned long long) record.sequence);
+		for (int i = 0; i < FRAME_SAMPLES; i++) {
+			fprintf(g_output, " %u", record.samples[i]);
+		}
+		fputc('\n', g_output);
+
+		g_merge.pop();
+	}
+}
+
+/**
+ * Statistics per device, and the total
+ */
+static void printStats(double seconds, bool total) {
+	uint64_t bytes = 0;
+	uint64_t records = 0;
+
+	for (size_t i = 0; i < g_devices.size(); i++) {
+		Device& device = g_devices[i];
+		uint64_t b = total ? device.bytes : device.bytes - device.lastBytes;
+		uint64_t r = total ? device.records : device.records - device.lastRecords;
+
+		fprintf(stderr, "%2zu %-24s %8.1f kB/s %8.0f frames/s  lost %llu  reordered %llu  invalid %llu%s\n",
+				i, device.path.c_str(), b / seconds / 1e3, r / seconds, (unsigned long long) device.lost,
+				(unsigned long long) device.reordered, (unsigned long long) device.decoder.errors,
+				device.failed ? "  FAILED" : "");
+
+		device.lastBytes = device.bytes;
+		device.lastRecords = device.records;
+		bytes += b;
+		records += r;
+	}
+
+	fprintf(stderr, "   %-24s %8.1f kB/s %8.0f frames/s\n", "total", bytes / seconds / 1e3, records / seconds);
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-n frames] [-t seconds] [-w window ms] [-i interval s] [-o file] [-d descriptor.json] [ports...]\n", name);
+	fprintf(stderr, "  -n  Frames per device, default 0: endless\n");
+	fprintf(stderr, "  -t  Stop after n seconds\n");
+	fprintf(stderr, "  -w  Merge window, default 20 ms\n");
+	fprintf(stderr, "  -i  Statistics interval, default 1 s, 0: only at the end\n");
+	fprintf(stderr, "  -o  Output file, default stdout\n");
+	fprintf(stderr, "  -d  usb-descriptor.json for VID / PID / serial, default ../usb-descriptor of the binary\n");
+}
+
+int main(int argc, char** argv) {
+	unsigned long frames = 0;
+	double seconds = 0;
+	double windowMs = 20;
+	double interval = 1;
+	const char* outputPath = nullptr;
+	std::string descriptorPath;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:w:i:o:d:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = strtoul(optarg, nullptr, 10);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'w':
+			windowMs = atof(optarg);
+			break;
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'o':
+			outputPath = optarg;
+			break;
+		case 'd':
+			descriptorPath = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<std::string> ports(argv + optind, argv + argc);
+	if (ports.empty()) {
+		if (descriptorPath.empty()) {
+			char exe[PATH_MAX];
+			ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+			exe[length > 0 ? length : 0] = 0;
+			descriptorPath = std::string(dirname(exe)) + "/../usb-descriptor/usb-descriptor.json";
+		}
+
+		std::string json = readFile(descriptorPath);
+		if (json.empty()) {
+			fprintf(stderr, "Can't read %s\n", descriptorPath.c_str());
+			return 1;
+		}
+
+		ports = discover(jsonString(json, "vendor"), jsonString(json, "product"), jsonString(json, "serial-text"));
+		if (ports.empty()) {
+			fprintf(stderr, "No device found\n");
+			return 1;
+		}
+	}
+
+	if (outputPath) {
+		g_output = fopen(outputPath, "w");
+		if (g_output == nullptr) {
+			fprintf(stderr, "%s: %s\n", outputPath, strerror(errno));
+			return 1;
+		}
+	}
+	static char outputBuffer[1 << 20];
+	setvbuf(g_output, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+	// SIGINT / SIGTERM are read in the event loop
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+	int signalFd = signalfd(-1, &signals, SFD_NONBLOCK);
+
+	int epollFd = epoll_create1(0);
+	struct epoll_event event;
+
+	event.events = EPOLLIN;
+	event.data.u32 = UINT32_MAX;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+
+	g_devices.resize(ports.size());
+	for (size_t i = 0; i < ports.size(); i++) {
+		Device& device = g_devices[i];
+		device.path = ports[i];
+
+		if (!deviceOpen(device, frames ? frames : FRAMES_ENDLESS)) {
+			device.failed = true;
+			deviceClose(device, false);
+			continue;
+		}
+
+		event.events = EPOLLIN;
+		event.data.u32 = i;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, device.fd, &event);
+	}
+	fprintf(stderr, "Reading %zu device(s)\n", ports.size());
+
+	int64_t windowNs = (int64_t) (windowMs * 1e6);
+	g_startNs = nowNs();
+	int64_t lastStats = g_startNs;
+	int64_t lastData = g_startNs;
+	bool running = true;
+
+	while (running) {
+		struct epoll_event events[EVENTS_MAX];
+		int count = epoll_wait(epollFd, events, EVENTS_MAX, windowNs / 2000000 + 1);
+
+		for (int e = 0; e < count; e++) {
+			uint32_t index = events[e].data.u32;
+			if (index == UINT32_MAX) {
+				running = false;
+				continue;
+			}
+
+			Device& device = g_devices[index];
+			if (device.fd >= 0) {
+				deviceRead(device, index);
+				lastData = nowNs();
+			}
+		}
+
+		int64_t now = nowNs();
+		mergeFlush(now - windowNs);
+
+		if (interval > 0 && now - lastStats >= interval * 1e9) {
+			printStats((now - lastStats) / 1e9, false);
+			lastStats = now;
+		}
+
+		if (seconds > 0 && now - g_startNs >= seconds * 1e9) {
+			running = false;
+		}
+
+		bool open = false;
+		bool complete = frames > 0;
+		for (Device& device : g_devices) {
+			open = open || device.fd >= 0;
+			complete = complete && (device.fd < 0 || device.records + device.lost >= frames);
+		}
+
+		if (!open || complete) {
+			running = false;
+		} else if (frames > 0 && now - lastData > IDLE_TIMEOUT_NS) {
+			fprintf(stderr, "No data for %lld s\n", IDLE_TIMEOUT_NS / 1000000000LL);
+			running = false;
+		}
+	}
+
+	mergeFlush(INT64_MAX);
+	fflush(g_output);
+
+	double duration = (nowNs() - g_startNs) / 1e9;
+	bool failed = false;
+	for (Device& device : g_devices) {
+		failed = failed || device.failed || device.lost || device.reordered || device.decoder.errors
+				|| (frames > 0 && device.records < frames);
+		deviceClose(device, true);
+	}
+
+	fprintf(stderr, "Total %.3f s\n", duration);
+	printStats(duration, true);
+
+	if (g_output != stdout) {
+		fclose(g_output);
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * Ping the device clock (firmware built with CLOCK_SYNC=1), and print the
+ * estimated offset and drift to the host clock, see clock-sync.h
+ *
+ * clock-check                         30 s, a ping every 100 ms
+ * clock-check -t 600 -i 50 -S 0001
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "clock-sync.h"
+#include "usb-device.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-t seconds] [-i ms] [-S serial]\n", name);
+	fprintf(stderr, "  -t  Duration, default 30 s\n");
+	fprintf(stderr, "  -i  Ping interval, default 100 ms\n");
+	fprintf(stderr, "  -S  Serial number, default the first device\n");
+}
+
+int main(int argc, char** argv) {
+	double seconds = 30;
+	int intervalMs = 100;
+	const char* serial = "";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:i:S:h")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'i':
+			intervalMs = atoi(optarg);
+			break;
+		case 'S':
+			serial = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (seconds <= 0 || intervalMs <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Control requests only, no interface is claimed, the serial port stays usable
+	UsbDevice device;
+	if (!device.open(USB_DEVICE_VENDOR, USB_DEVICE_PRODUCT, serial)) {
+		fprintf(stderr, "%s\n", device.lastError().c_str());
+		return 1;
+	}
+
+	ClockSync sync;
+	long pings = (long) (seconds * 1000 / intervalMs);
+	long pingsPerLine = 1000 / intervalMs > 0 ? 1000 / intervalMs : 1;
+	auto next = std::chrono::steady_clock::now();
+
+	for (long i = 1; i <= pings; i++) {
+		if (!clockSyncPing(device, sync)) {
+			fprintf(stderr, "Clock request: %s, firmware built with CLOCK_SYNC=0?\n", device.lastError().c_str());
+			return 1;
+		}
+
+		if (i % pingsPerLine == 0 || i == pings) {
+			printf("%6.1f s  offset %+.3f ms  drift %+8.1f ppm  residual %6.1f us  min RTT %6.1f us  %zu / %zu pings\n",
+					i * intervalMs / 1e3, sync.offsetNs() / 1e6, sync.driftPpm(), sync.residualNs() / 1e3,
+					sync.minRttNs() / 1e3, sync.usedCount(), sync.sampleCount());
+			fflush(stdout);
+		}
+
+		next += std::chrono::milliseconds(intervalMs);
+		std::this_thread::sleep_until(next);
+	}
+
+	printf("Device clock %.0f Hz nominal, %.1f Hz measured\n",
+			sync.ticksPerSecond(), sync.ticksPerSecond() * (1 + sync.driftPpm() * 1e-6));
+	return 0;
+}
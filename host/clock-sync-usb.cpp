@@ -0,0 +1,44 @@
+/**
+ * Clock sync ping over libusb, separate from clock-sync.cpp so the estimator
+ * can be tested without libusb
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "clock-sync.h"
+#include "usb-device.h"
+
+#include <chrono>
+
+/**
+ * Vendor request, see lib/usb-cdc.c
+ */
+#define GET_CLOCK 0x6D
+
+static int64_t monotonicNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool clockSyncPing(UsbDevice& device, ClockSync& sync) {
+	// struct ClockSync of lib/timer.h, little endian
+	uint8_t data[8];
+
+	int64_t send = monotonicNs();
+	int length = device.controlRead(GET_CLOCK, 0, 0, data, sizeof(data));
+	int64_t receive = monotonicNs();
+
+	if (length != (int) sizeof(data)) {
+		return false;
+	}
+
+	uint32_t ticks = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+	uint32_t ticksPerSecond = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t) data[7] << 24);
+
+	if (!sync.valid() && ticksPerSecond != 0) {
+		sync.setTicksPerSecond(ticksPerSecond);
+	}
+
+	sync.add(send, receive, ticks);
+	return true;
+}
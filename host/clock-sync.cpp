@@ -0,0 +1,114 @@
+/**
+ * Device to host time mapping, see clock-sync.h
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "clock-sync.h"
+
+#include <cmath>
+
+/**
+ * The slope is only fitted if the pings span at least this many seconds,
+ * before the nominal rate is used, jitter would dominate the drift
+ */
+#define CLOCK_SYNC_MIN_SPAN_S 1.0
+
+ClockSync::ClockSync(double ticksPerSecond)
+	: nominalTicksPerSecond(ticksPerSecond) {
+	nsPerTick = 1e9 / ticksPerSecond;
+}
+
+int64_t ClockSync::unwrap(uint32_t ticks) const {
+	return lastTicks + (int32_t) (ticks - (uint32_t) lastTicks);
+}
+
+void ClockSync::add(int64_t hostSendNs, int64_t hostReceiveNs, uint32_t ticks) {
+	Sample sample;
+	sample.hostNs = hostSendNs + (hostReceiveNs - hostSendNs) / 2;
+	sample.rttNs = hostReceiveNs - hostSendNs;
+	sample.ticks = samples.empty() ? ticks : unwrap(ticks);
+
+	lastTicks = sample.ticks;
+	samples.push_back(sample);
+	if (samples.size() > CLOCK_SYNC_SAMPLES) {
+		samples.pop_front();
+	}
+
+	fit();
+}
+
+void ClockSync::fit() {
+	minRtt = samples.front().rttNs;
+	for (const Sample& s : samples) {
+		if (s.rttNs < minRtt) {
+			minRtt = s.rttNs;
+		}
+	}
+
+	// Relative to the last ping, so the doubles keep ns resolution
+	baseHostNs = samples.back().hostNs;
+	baseTicks = samples.back().ticks;
+
+	double sumX = 0;
+	double sumY = 0;
+	double sumXX = 0;
+	double sumXY = 0;
+	double minX = 0;
+	used = 0;
+
+	for (const Sample& s : samples) {
+		if (s.rttNs > minRtt + CLOCK_SYNC_RTT_MARGIN_NS) {
+			continue;
+		}
+
+		double x = (double) (s.ticks - baseTicks);
+		double y = (double) (s.hostNs - baseHostNs);
+		sumX += x;
+		sumY += y;
+		sumXX += x * x;
+		sumXY += x * y;
+		if (x < minX) {
+			minX = x;
+		}
+		used++;
+	}
+
+	double n = (double) used;
+	double denominator = n * sumXX - sumX * sumX;
+
+	if (used >= 2 && -minX >= CLOCK_SYNC_MIN_SPAN_S * nominalTicksPerSecond && denominator > 0) {
+		nsPerTick = (n * sumXY - sumX * sumY) / denominator;
+	} else {
+		nsPerTick = 1e9 / nominalTicksPerSecond;
+	}
+	fitOffsetNs = (sumY - nsPerTick * sumX) / n;
+
+	double sumSquares = 0;
+	for (const Sample& s : samples) {
+		if (s.rttNs > minRtt + CLOCK_SYNC_RTT_MARGIN_NS) {
+			continue;
+		}
+
+		double error = (double) (s.hostNs - baseHostNs) - fitOffsetNs - nsPerTick * (double) (s.ticks - baseTicks);
+		sumSquares += error * error;
+	}
+	residual = std::sqrt(sumSquares / n);
+}
+
+int64_t ClockSync::toHostNs(int64_t ticks) const {
+	return baseHostNs + (int64_t) std::llround(fitOffsetNs + nsPerTick * (double) (ticks - baseTicks));
+}
+
+int64_t ClockSync::toDeviceTicks(int64_t hostNs) const {
+	return baseTicks + (int64_t) std::llround(((double) (hostNs - baseHostNs) - fitOffsetNs) / nsPerTick);
+}
+
+double ClockSync::driftPpm() const {
+	return (1e9 / nominalTicksPerSecond / nsPerTick - 1) * 1e6;
+}
+
+double ClockSync::offsetNs() const {
+	return (double) baseHostNs + fitOffsetNs - (double) baseTicks * 1e9 / nominalTicksPerSecond;
+}
@@ -0,0 +1,158 @@
+/**
+ * Device to host time mapping: the host pings the device with a vendor request,
+ * the device answers with its tick counter (lib/timer.h), latched when the SETUP
+ * packet is processed. Offset and drift of the RC oscillator are estimated with a
+ * least squares fit over the pings with the shortest round trip, their midpoint
+ * is closest to the moment the device latched the counter.
+ *
+ *   ClockSync sync;
+ *   // Every 100 ms, the estimate gets better with the time span of the pings
+ *   clockSyncPing(device, sync);
+ *   int64_t hostNs = sync.toHostNs(deviceTicks);
+ *
+ * The constant part of the USB latency (the SETUP is sent in the next frame) is
+ * the same for all devices on the host, so captures of several boards mapped
+ * with their own ClockSync are aligned to each other better than to host time.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+/**
+ * Max pings used for the fit, the oldest are dropped
+ */
+#define CLOCK_SYNC_SAMPLES 512
+
+/**
+ * Pings with a round trip up to this much longer than the shortest one are used for the fit
+ */
+#define CLOCK_SYNC_RTT_MARGIN_NS 250000
+
+class UsbDevice;
+
+class ClockSync {
+public:
+	/**
+	 * @param ticksPerSecond Nominal tick rate, replaced by the value of the device on the first ping
+	 */
+	ClockSync(double ticksPerSecond = 2000000);
+
+	/**
+	 * Add a ping
+	 *
+	 * @param hostSendNs Host time before the request, CLOCK_MONOTONIC
+	 * @param hostReceiveNs Host time after the answer
+	 * @param ticks Tick counter of the device
+	 */
+	void add(int64_t hostSendNs, int64_t hostReceiveNs, uint32_t ticks);
+
+	/**
+	 * At least one ping was added
+	 */
+	bool valid() const {
+		return !samples.empty();
+	}
+
+	/**
+	 * Extend a 32 bit tick value of the device to 64 bit, it needs to be within
+	 * half the wrap time (18 minutes at 2 MHz) of the last ping
+	 */
+	int64_t unwrap(uint32_t ticks) const;
+
+	/**
+	 * Host time of a device tick value
+	 */
+	int64_t toHostNs(int64_t ticks) const;
+
+	int64_t toHostNs(uint32_t ticks) const {
+		return toHostNs(unwrap(ticks));
+	}
+
+	/**
+	 * Device tick value at a host time
+	 */
+	int64_t toDeviceTicks(int64_t hostNs) const;
+
+	/**
+	 * Rate of the device clock compared to the host, in ppm, positive if the device is fast
+	 */
+	double driftPpm() const;
+
+	/**
+	 * Host time - nominal device time at the last ping, in ns
+	 */
+	double offsetNs() const;
+
+	/**
+	 * RMS deviation of the used pings from the fit, in ns
+	 */
+	double residualNs() const {
+		return residual;
+	}
+
+	/**
+	 * Shortest round trip in the window, in ns
+	 */
+	int64_t minRttNs() const {
+		return minRtt;
+	}
+
+	/**
+	 * Pings in the window, and used for the fit
+	 */
+	size_t sampleCount() const {
+		return samples.size();
+	}
+
+	size_t usedCount() const {
+		return used;
+	}
+
+	double ticksPerSecond() const {
+		return nominalTicksPerSecond;
+	}
+
+	void setTicksPerSecond(double ticksPerSecond) {
+		nominalTicksPerSecond = ticksPerSecond;
+		nsPerTick = 1e9 / ticksPerSecond;
+	}
+
+private:
+	void fit();
+
+private:
+	struct Sample {
+		int64_t hostNs;
+		int64_t rttNs;
+		int64_t ticks;
+	};
+
+	std::deque<Sample> samples;
+	double nominalTicksPerSecond;
+
+	/**
+	 * hostNs = baseHostNs + fitOffsetNs + nsPerTick * (ticks - baseTicks)
+	 */
+	int64_t baseHostNs = 0;
+	int64_t baseTicks = 0;
+	double fitOffsetNs = 0;
+	double nsPerTick;
+
+	int64_t lastTicks = 0;
+	int64_t minRtt = 0;
+	double residual = 0;
+	size_t used = 0;
+};
+
+/**
+ * Ping the device with the clock sync vendor request, and add the result
+ *
+ * @return false if the request failed, firmware built with CLOCK_SYNC=0?
+ */
+bool clockSyncPing(UsbDevice& device, ClockSync& sync);
@@ -0,0 +1,57 @@
+/**
+ * Decoder for the binary frames of lib/frame.h
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "frame-decoder.h"
+
+uint16_t crc16(const uint8_t* data, size_t length) {
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < length; i++) {
+		crc ^= (uint16_t) data[i] << 8;
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+
+	return crc;
+}
+
+size_t FrameDecoder::decode(uint8_t* frame) {
+	size_t length = 0;
+	size_t pos = 0;
+
+	if (encodedLength > sizeof(encoded)) {
+		return 0;
+	}
+
+	// COBS
+	while (pos < encodedLength) {
+		uint8_t code = encoded[pos];
+		if (code == 0 || pos + code > encodedLength) {
+			return 0;
+		}
+
+		for (size_t i = pos + 1; i < pos + code; i++) {
+			frame[length++] = encoded[i];
+		}
+		pos += code;
+
+		if (code != 255 && pos < encodedLength) {
+			frame[length++] = 0;
+		}
+	}
+
+	if (length < 4 || frame[1] != length - 4) {
+		return 0;
+	}
+
+	if (crc16(frame, length - 2) != (frame[length - 2] | (frame[length - 1] << 8))) {
+		return 0;
+	}
+
+	return length;
+}
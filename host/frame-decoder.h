@@ -0,0 +1,82 @@
+/**
+ * Decoder for the binary frames of lib/frame.h, same as test-tools/frame.py
+ *
+ * Frame: uint8_t type, uint8_t length, payload, uint16_t CRC-16/CCITT-FALSE (little endian),
+ * COBS encoded and terminated with a 0 byte
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Frame types, see lib/frame.h
+#define FRAME_TYPE_SAMPLES 0x01
+#define FRAME_TYPE_LOG 0x02
+
+/**
+ * Max encoded frame, a frame fits into one USB packet
+ */
+#define FRAME_ENCODED_MAX 64
+
+/**
+ * CRC-16/CCITT-FALSE, same as lib/crc.c
+ */
+uint16_t crc16(const uint8_t* data, size_t length);
+
+class FrameDecoder {
+public:
+	/**
+	 * Feed any chunk of received data
+	 *
+	 * @param onFrame Called for each valid frame: onFrame(type, payload, length)
+	 */
+	template <typename F>
+	void feed(const uint8_t* data, size_t length, F onFrame) {
+		uint8_t frame[FRAME_ENCODED_MAX];
+
+		for (size_t i = 0; i < length; i++) {
+			if (data[i] != 0) {
+				if (encodedLength < sizeof(encoded)) {
+					encoded[encodedLength] = data[i];
+				}
+				// Too long frames are counted as error at the delimiter
+				encodedLength++;
+				continue;
+			}
+
+			size_t frameLength = decode(frame);
+			encodedLength = 0;
+
+			if (frameLength == 0) {
+				errors++;
+				continue;
+			}
+
+			frames++;
+			onFrame(frame[0], frame + 2, frame[1]);
+		}
+	}
+
+	/**
+	 * Valid frames, and invalid frames (COBS, length, CRC)
+	 */
+	uint64_t frames = 0;
+	uint64_t errors = 0;
+
+private:
+	/**
+	 * Decode the buffered frame
+	 *
+	 * @param frame Decoded type, length, payload and CRC
+	 * @return Decoded length, 0 if invalid
+	 */
+	size_t decode(uint8_t* frame);
+
+private:
+	uint8_t encoded[FRAME_ENCODED_MAX];
+	size_t encodedLength = 0;
+};
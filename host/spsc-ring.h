@@ -0,0 +1,84 @@
+/**
+ * Lock free single producer / single consumer ring. Only pointers are stored,
+ * the data itself is not copied. The producer is the libusb event thread,
+ * the consumer the application thread.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @param T Element type, should be small (a pointer)
+ * @param Capacity Max elements, power of two
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity needs to be a power of two");
+
+public:
+	/**
+	 * Add an element, producer only
+	 *
+	 * @return false if the ring is full
+	 */
+	bool push(T value) {
+		size_t write = writePos.load(std::memory_order_relaxed);
+
+		if (write - readPos.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+
+		items[write & (Capacity - 1)] = value;
+		writePos.store(write + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Take the oldest element, consumer only
+	 *
+	 * @return false if the ring is empty
+	 */
+	bool pop(T& value) {
+		size_t read = readPos.load(std::memory_order_relaxed);
+
+		if (read == writePos.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		value = items[read & (Capacity - 1)];
+		readPos.store(read + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Elements in the ring, only a snapshot if called by another thread
+	 */
+	size_t size() const {
+		return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	static constexpr size_t capacity() {
+		return Capacity;
+	}
+
+private:
+	/**
+	 * Positions count up, the index is masked. Own cache lines, so producer
+	 * and consumer don't invalidate each others cache line.
+	 */
+	alignas(64) std::atomic<size_t> writePos{0};
+	alignas(64) std::atomic<size_t> readPos{0};
+
+	alignas(64) T items[Capacity];
+};
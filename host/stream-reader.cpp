@@ -0,0 +1,176 @@
+/**
+ * Read the test stream of the device with the host library, and check it like
+ * test-tools/stream-check.py: sequence numbers and CRC of the stream packets of logic.c
+ *
+ * stream-reader                       CDC data interface, stream command P, 100000 packets
+ * stream-reader -v                    Vendor bulk interface, stream command V
+ * stream-reader -v -t 60 -q 32 -s 16384
+ *
+ * Exit code 1 if any packet was lost, reordered, duplicated or corrupted
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "transfer-queue.h"
+#include "frame-decoder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+/**
+ * Layout of the stream packet, see logic.c
+ */
+#define PACKET_LEN 64
+#define CRC_OFFSET (PACKET_LEN - 2)
+
+/**
+ * Sequence and CRC check of the received packets
+ */
+struct StreamCheck {
+	uint64_t packets = 0;
+	uint64_t lost = 0;
+	uint64_t reordered = 0;
+	uint64_t corrupted = 0;
+	uint32_t expected = 0;
+
+	void add(const uint8_t* data, size_t length) {
+		for (size_t pos = 0; pos + PACKET_LEN <= length; pos += PACKET_LEN) {
+			const uint8_t* packet = data + pos;
+
+			if (crc16(packet, CRC_OFFSET) != (packet[CRC_OFFSET] | (packet[CRC_OFFSET + 1] << 8))) {
+				corrupted++;
+				continue;
+			}
+
+			// Little endian
+			uint32_t sequence = packet[0] | (packet[1] << 8) | (packet[2] << 16) | ((uint32_t) packet[3] << 24);
+			if (sequence > expected) {
+				lost += sequence - expected;
+			} else if (sequence < expected) {
+				reordered++;
+			}
+			expected = sequence + 1;
+			packets++;
+		}
+	}
+};
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-v] [-n packets] [-t seconds] [-q transfers] [-s bytes] [-S serial]\n", name);
+	fprintf(stderr, "  -v  Vendor bulk interface (VENDOR_BULK=1), default CDC data interface\n");
+	fprintf(stderr, "  -n  Packet count, default 100000\n");
+	fprintf(stderr, "  -t  Stream endless, and stop after n seconds\n");
+	fprintf(stderr, "  -q  Transfers queued, default 8\n");
+	fprintf(stderr, "  -s  Bytes per transfer, multiple of 64, default 4096\n");
+	fprintf(stderr, "  -S  Serial number, default the first device\n");
+}
+
+int main(int argc, char** argv) {
+	bool vendor = false;
+	long packets = 100000;
+	double seconds = 0;
+	int queued = 8;
+	int size = 4096;
+	const char* serial = "";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vn:t:q:s:S:h")) != -1) {
+		switch (opt) {
+		case 'v':
+			vendor = true;
+			break;
+		case 'n':
+			packets = atol(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'q':
+			queued = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'S':
+			serial = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (size <= 0 || size % PACKET_LEN || queued <= 0 || queued > TRANSFER_QUEUE_MAX) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	UsbDevice device;
+	UsbInterface cdc;
+	UsbInterface stream;
+
+	// The stream is started with a command on the CDC data interface in both cases
+	if (!device.open(USB_DEVICE_VENDOR, USB_DEVICE_PRODUCT, serial)
+			|| !device.claimInterface(UsbInterfaceType::Cdc, cdc)
+			|| !device.claimInterface(vendor ? UsbInterfaceType::Vendor : UsbInterfaceType::Cdc, stream)) {
+		fprintf(stderr, "%s\n", device.lastError().c_str());
+		return 1;
+	}
+
+	TransferQueue queue(device, stream.endpointIn, queued, size);
+	if (!queue.start()) {
+		fprintf(stderr, "%s\n", queue.lastError().c_str());
+		return 1;
+	}
+
+	char command[32];
+	snprintf(command, sizeof(command), "%c %ld\n", vendor ? 'V' : 'P', seconds > 0 ? 0 : packets);
+	if (device.bulkWrite(cdc.endpointOut, command, strlen(command)) != (int) strlen(command)) {
+		fprintf(stderr, "Start command: %s\n", device.lastError().c_str());
+		return 1;
+	}
+
+	StreamCheck check;
+	UsbTime start = std::chrono::steady_clock::now();
+
+	while (true) {
+		if (seconds > 0 && std::chrono::steady_clock::now() - start >= std::chrono::duration<double>(seconds)) {
+			break;
+		}
+		if (seconds <= 0 && check.packets + check.lost >= (uint64_t) packets) {
+			break;
+		}
+
+		UsbBlock* block = queue.next(3000);
+		if (block == nullptr) {
+			// Stream ended early, or device gone
+			break;
+		}
+
+		check.add(block->data, block->length);
+		queue.release(block);
+	}
+
+	TransferStats stats = queue.stats();
+
+	if (seconds > 0) {
+		// Any packet stops the endless stream
+		device.bulkWrite(stream.endpointOut, "x", 1);
+	}
+	queue.stop();
+
+	printf("%llu packets, %.3f s, %.1f kB/s, %d transfers of %d bytes queued\n",
+			(unsigned long long) check.packets, stats.seconds, stats.bytesPerSecond / 1e3, queued, size);
+	printf("Ring latency avg %.1f us, max %.1f us, processing avg %.1f us, max %.1f us\n",
+			stats.queueLatencyAvgUs, stats.queueLatencyMaxUs, stats.processAvgUs, stats.processMaxUs);
+	printf("Min transfers queued %zu, ring high water %zu, transfer errors %llu\n",
+			stats.minInFlight, stats.ringHighWater, (unsigned long long) stats.errors);
+	printf("Lost %llu, reordered / duplicated %llu, corrupted %llu\n",
+			(unsigned long long) check.lost, (unsigned long long) check.reordered, (unsigned long long) check.corrupted);
+
+	bool failed = check.lost || check.reordered || check.corrupted || (seconds <= 0 && check.packets < (uint64_t) packets);
+	return failed ? 1 : 0;
+}
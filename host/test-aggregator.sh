@@ -0,0 +1,63 @@
+#!/bin/sh
+# Aggregator test with simulated devices: starts several sim-pty (sim/pty.c),
+# reads a fixed number of frames from all of them, and checks the merged output:
+# complete, ordered by time, and the sequence of each device without gap
+#
+# test-aggregator.sh [devices] [frames]
+
+DEVICES=${1:-4}
+FRAMES=${2:-2000}
+DIR=$(mktemp -d /tmp/ch55x-aggregator.XXXXXX)
+HOST=$(cd "$(dirname "$0")" && pwd)
+
+make -s -C "$HOST/../sim" sim-pty || exit 1
+
+PIDS=""
+PORTS=""
+i=0
+while [ $i -lt "$DEVICES" ]; do
+	"$HOST/../sim/sim-pty" -l "$DIR/tty$i" -s "$DIR/sock$i" > "$DIR/sim$i.log" 2>&1 &
+	PIDS="$PIDS $!"
+	PORTS="$PORTS $DIR/tty$i"
+	i=$((i + 1))
+done
+
+# Wait until all pseudo terminals exist
+for port in $PORTS; do
+	n=0
+	while [ ! -e "$port" ] && [ $n -lt 50 ]; do
+		sleep 0.1
+		n=$((n + 1))
+	done
+done
+
+"$HOST/aggregator" -n "$FRAMES" -i 0 -o "$DIR/out.txt" $PORTS
+RESULT=$?
+
+kill $PIDS 2>/dev/null
+wait 2>/dev/null
+
+if [ $RESULT -ne 0 ]; then
+	echo "FAILED: aggregator exit code $RESULT"
+	rm -rf "$DIR"
+	exit 1
+fi
+
+awk -v devices="$DEVICES" -v frames="$FRAMES" '
+{
+	if ($1 < last) { print "FAILED: not ordered by time, line " NR; failed = 1; exit }
+	last = $1
+	if ($3 != next_seq[$2] + 0) { print "FAILED: device " $2 " sequence " $3 ", expected " next_seq[$2] + 0; failed = 1; exit }
+	next_seq[$2] = $3 + 1
+	# Sample n = sequence * 8 + n, modulo 16 bit
+	if ($4 != ($3 * 8) % 65536) { print "FAILED: device " $2 " sample " $4 " in sequence " $3; failed = 1; exit }
+}
+END {
+	if (failed) exit 1
+	if (NR != devices * frames) { print "FAILED: " NR " lines, expected " devices * frames; exit 1 }
+	print "OK " NR " frames of " devices " devices"
+}' "$DIR/out.txt"
+RESULT=$?
+
+rm -rf "$DIR"
+exit $RESULT
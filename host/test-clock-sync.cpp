@@ -0,0 +1,126 @@
+/**
+ * Test of the clock sync estimator with a simulated device: drifting clock,
+ * jittered round trips, and a 32 bit tick counter that wraps.
+ * Does not need libusb or a device, make test
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "clock-sync.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+/**
+ * Check a condition, exit the test on failure
+ */
+#define TEST_CHECK(condition) if (!(condition)) { \
+	printf("    FAILED: %s, line %i\n", #condition, __LINE__); \
+	return false; \
+}
+
+#define TICKS_PER_SECOND 2000000.0
+
+/**
+ * Simulated device, the counter is latched at a random time within the round trip
+ */
+struct SimDevice {
+	double driftPpm;
+	double startTicks;
+	std::mt19937 random{42};
+
+	double ticksAt(int64_t hostNs) const {
+		return startTicks + hostNs * 1e-9 * TICKS_PER_SECOND * (1 + driftPpm * 1e-6);
+	}
+
+	/**
+	 * @param slow Every n-th ping is delayed, like a busy host, 0 for none
+	 */
+	void ping(ClockSync& sync, int64_t hostNs, int slow, int i) {
+		std::uniform_int_distribution<int64_t> rtt(800000, 1200000);
+		int64_t receive = hostNs + rtt(random);
+		if (slow && i % slow == 0) {
+			receive += 5000000;
+		}
+
+		std::uniform_int_distribution<int64_t> latch(hostNs, receive);
+		sync.add(hostNs, receive, (uint32_t) (int64_t) ticksAt(latch(random)));
+	}
+};
+
+/**
+ * A single ping, nominal rate
+ */
+static bool testSinglePing() {
+	ClockSync sync;
+	TEST_CHECK(!sync.valid());
+
+	sync.add(1000000, 2000000, 2000);
+	TEST_CHECK(sync.valid());
+	TEST_CHECK(sync.driftPpm() == 0);
+	TEST_CHECK(sync.toHostNs((uint32_t) 2000) == 1500000);
+	TEST_CHECK(sync.toHostNs((uint32_t) 4000) == 2500000);
+	TEST_CHECK(sync.toDeviceTicks(2500000) == 4000);
+
+	return true;
+}
+
+/**
+ * Drift and offset over 60 s of pings every 100 ms, with delayed pings,
+ * and the counter wrapping after 10 s
+ */
+static bool testDrift(double driftPpm) {
+	SimDevice device;
+	device.driftPpm = driftPpm;
+	device.startTicks = 4294967296.0 - 10 * TICKS_PER_SECOND;
+
+	ClockSync sync;
+	int64_t hostNs = 0;
+	for (int i = 0; i < 600; i++) {
+		device.ping(sync, hostNs, 7, i);
+		hostNs += 100000000;
+	}
+
+	printf("    drift %.1f ppm, estimated %.1f ppm, residual %.1f us, %zu of %zu pings used\n",
+			driftPpm, sync.driftPpm(), sync.residualNs() / 1e3, sync.usedCount(), sync.sampleCount());
+
+	TEST_CHECK(std::fabs(sync.driftPpm() - driftPpm) < 5);
+	TEST_CHECK(sync.usedCount() < sync.sampleCount());
+
+	// Mapping of the last ping, and of a sample 1 s later, the counter has wrapped
+	for (int64_t t : {hostNs - 100000000, hostNs + 1000000000}) {
+		uint32_t ticks = (uint32_t) (int64_t) device.ticksAt(t);
+		int64_t mapped = sync.toHostNs(ticks);
+		TEST_CHECK(std::llabs(mapped - t) < 200000);
+		TEST_CHECK(std::llabs(sync.toDeviceTicks(mapped) - sync.unwrap(ticks)) <= 1);
+	}
+
+	return true;
+}
+
+int main() {
+	int failed = 0;
+
+	printf("single-ping\n");
+	if (!testSinglePing()) {
+		failed++;
+	}
+
+	for (double drift : {0.0, 150.0, -2000.0}) {
+		printf("drift %.0f ppm\n", drift);
+		if (!testDrift(drift)) {
+			failed++;
+		}
+	}
+
+	if (failed) {
+		printf("%i test(s) failed\n", failed);
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Test of the SPSC ring: a producer and a consumer thread pass pointers,
+ * the order is checked, and the ring never loses or duplicates an element.
+ * Does not need libusb or a device, make test
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "spsc-ring.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+/**
+ * Check a condition, exit the test on failure
+ */
+#define TEST_CHECK(condition) if (!(condition)) { \
+	printf("    FAILED: %s, line %i\n", #condition, __LINE__); \
+	return false; \
+}
+
+#define ITEMS 2000000
+
+/**
+ * Single thread: full / empty
+ */
+static bool testFullEmpty() {
+	SpscRing<int, 4> ring;
+	int value;
+
+	TEST_CHECK(ring.empty());
+	TEST_CHECK(!ring.pop(value));
+
+	for (int i = 0; i < 4; i++) {
+		TEST_CHECK(ring.push(i));
+	}
+	TEST_CHECK(!ring.push(4));
+	TEST_CHECK(ring.size() == 4);
+
+	for (int i = 0; i < 4; i++) {
+		TEST_CHECK(ring.pop(value) && value == i);
+	}
+	TEST_CHECK(!ring.pop(value));
+
+	// Wrap around
+	for (int i = 0; i < 10; i++) {
+		TEST_CHECK(ring.push(i));
+		TEST_CHECK(ring.pop(value) && value == i);
+	}
+
+	return true;
+}
+
+/**
+ * Producer and consumer thread, like the libusb event thread and the application,
+ * the pointers point into a fixed pool, like the transfer buffers
+ */
+static bool testThreads() {
+	static uint32_t pool[128];
+	SpscRing<uint32_t*, 64> ring;
+	uint32_t* item;
+	uint32_t expected = 0;
+	uint32_t errors = 0;
+
+	std::thread producer([&ring]() {
+		for (uint32_t i = 0; i < ITEMS; i++) {
+			uint32_t* slot = &pool[i % 128];
+
+			// Max 64 items ahead of the consumer, so the slot was read by the consumer
+			while (ring.size() == 64) {
+				std::this_thread::yield();
+			}
+			*slot = i;
+			while (!ring.push(slot)) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	while (expected < ITEMS) {
+		if (!ring.pop(item)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (item != &pool[expected % 128] || *item != expected) {
+			errors++;
+		}
+		expected++;
+	}
+
+	producer.join();
+	TEST_CHECK(errors == 0);
+	TEST_CHECK(ring.empty());
+
+	return true;
+}
+
+int main() {
+	int failed = 0;
+
+	printf("full-empty\n");
+	if (!testFullEmpty()) {
+		failed++;
+	}
+
+	printf("threads\n");
+	if (!testThreads()) {
+		failed++;
+	}
+
+	if (failed) {
+		printf("%i test(s) failed\n", failed);
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
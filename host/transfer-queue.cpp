@@ -0,0 +1,270 @@
+/**
+ * Asynchronous bulk IN transfers with a lock free ring to the consumer
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "transfer-queue.h"
+
+/**
+ * Timeout of a single transfer, the transfer is submitted again, this only
+ * returns partially filled transfers if the stream pauses
+ */
+#define TRANSFER_TIMEOUT_MS 100
+
+/**
+ * Max sleep of next(), while waiting for a transfer
+ */
+#define TRANSFER_WAIT_MAX_US 200
+
+/**
+ * Nanoseconds of a steady clock time
+ */
+static int64_t toNs(UsbTime time) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * Store value if it is larger, single writer
+ */
+template <typename T>
+static void storeMax(std::atomic<T>& max, T value) {
+	if (value > max.load(std::memory_order_relaxed)) {
+		max.store(value, std::memory_order_relaxed);
+	}
+}
+
+TransferQueue::TransferQueue(UsbDevice& device, uint8_t endpoint, size_t transfers, size_t transferSize)
+		: device(device), endpoint(endpoint), transferCount(transfers), transferSize(transferSize) {
+	if (transferCount > TRANSFER_QUEUE_MAX) {
+		transferCount = TRANSFER_QUEUE_MAX;
+	}
+
+	for (size_t i = 0; i < transferCount; i++) {
+		UsbBlock* block = &blocks[i];
+		block->queue = this;
+		block->transfer = libusb_alloc_transfer(0);
+
+		// The transfer buffer is handed to the consumer, not copied
+		unsigned char* buffer = new unsigned char[transferSize];
+		libusb_fill_bulk_transfer(block->transfer, device.handle(), endpoint, buffer, (int) transferSize,
+				transferCallback, block, TRANSFER_TIMEOUT_MS);
+		block->data = buffer;
+	}
+}
+
+TransferQueue::~TransferQueue() {
+	stop();
+
+	for (size_t i = 0; i < transferCount; i++) {
+		delete[] blocks[i].transfer->buffer;
+		libusb_free_transfer(blocks[i].transfer);
+	}
+}
+
+bool TransferQueue::start(bool eventThread) {
+	if (running) {
+		return true;
+	}
+
+	deviceGone = false;
+	running = true;
+	resetStats();
+
+	UsbBlock* block;
+	while (ring.pop(block)) {
+	}
+
+	for (size_t i = 0; i < transferCount; i++) {
+		if (!submit(&blocks[i])) {
+			stop();
+			return false;
+		}
+	}
+
+	if (eventThread) {
+		thread = std::thread(&TransferQueue::eventLoop, this);
+	}
+
+	return true;
+}
+
+void TransferQueue::stop() {
+	if (!running && !thread.joinable()) {
+		return;
+	}
+
+	running = false;
+
+	for (size_t i = 0; i < transferCount; i++) {
+		// Fails for transfers not in flight, ignored
+		libusb_cancel_transfer(blocks[i].transfer);
+	}
+
+	if (thread.joinable()) {
+		// The event thread runs until all transfers are returned
+		thread.join();
+	} else {
+		while (inFlight > 0) {
+			struct timeval tv = { 0, 100000 };
+			libusb_handle_events_timeout(device.context(), &tv);
+		}
+	}
+}
+
+void TransferQueue::eventLoop() {
+	while (running || inFlight > 0) {
+		struct timeval tv = { 0, 100000 };
+		libusb_handle_events_timeout(device.context(), &tv);
+	}
+}
+
+bool TransferQueue::submit(UsbBlock* block) {
+	inFlight++;
+
+	int result = libusb_submit_transfer(block->transfer);
+	if (result < 0) {
+		inFlight--;
+		errors++;
+		deviceGone = true;
+		error = std::string("libusb_submit_transfer: ") + libusb_error_name(result);
+		return false;
+	}
+
+	return true;
+}
+
+void LIBUSB_CALL TransferQueue::transferCallback(libusb_transfer* transfer) {
+	UsbBlock* block = (UsbBlock*) transfer->user_data;
+	block->queue->completed(block);
+}
+
+void TransferQueue::completed(UsbBlock* block) {
+	libusb_transfer* transfer = block->transfer;
+	size_t flight = --inFlight;
+
+	if (running && flight < minInFlight.load(std::memory_order_relaxed)) {
+		minInFlight.store(flight, std::memory_order_relaxed);
+	}
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		// A timed out transfer can contain data, too
+		break;
+
+	case LIBUSB_TRANSFER_CANCELLED:
+		return;
+
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		errors++;
+		deviceGone = true;
+		return;
+
+	default:
+		// STALL, overflow, error
+		errors++;
+		break;
+	}
+
+	if (transfer->actual_length == 0) {
+		if (running) {
+			submit(block);
+		}
+		return;
+	}
+
+	block->length = transfer->actual_length;
+	block->completed = std::chrono::steady_clock::now();
+
+	transfers++;
+	bytes += block->length;
+
+	// There are never more blocks than ring entries
+	ring.push(block);
+	storeMax(ringHighWater, ring.size());
+}
+
+UsbBlock* TransferQueue::next(unsigned int timeoutMs) {
+	UsbBlock* block;
+	UsbTime start = std::chrono::steady_clock::now();
+	unsigned int sleepUs = 1;
+
+	while (!ring.pop(block)) {
+		if (!running || deviceGone) {
+			return nullptr;
+		}
+
+		if (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeoutMs)) {
+			return nullptr;
+		}
+
+		// No lock between the threads, poll with increasing sleep
+		std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+		if (sleepUs < TRANSFER_WAIT_MAX_US) {
+			sleepUs *= 2;
+		}
+	}
+
+	block->taken = std::chrono::steady_clock::now();
+
+	uint64_t latency = toNs(block->taken) - toNs(block->completed);
+	consumed++;
+	queueLatencySum += latency;
+	storeMax(queueLatencyMax, latency);
+
+	return block;
+}
+
+void TransferQueue::release(UsbBlock* block) {
+	uint64_t duration = toNs(std::chrono::steady_clock::now()) - toNs(block->taken);
+	released++;
+	processSum += duration;
+	storeMax(processMax, duration);
+
+	block->length = 0;
+	if (running && !deviceGone) {
+		submit(block);
+	}
+}
+
+TransferStats TransferQueue::stats() const {
+	TransferStats stats;
+
+	stats.transfers = transfers;
+	stats.bytes = bytes;
+	stats.errors = errors;
+	stats.seconds = (toNs(std::chrono::steady_clock::now()) - startTime) / 1e9;
+	stats.bytesPerSecond = stats.seconds > 0 ? stats.bytes / stats.seconds : 0;
+
+	if (consumed) {
+		stats.queueLatencyAvgUs = queueLatencySum / 1e3 / consumed;
+	}
+	stats.queueLatencyMaxUs = queueLatencyMax / 1e3;
+
+	if (released) {
+		stats.processAvgUs = processSum / 1e3 / released;
+	}
+	stats.processMaxUs = processMax / 1e3;
+
+	stats.minInFlight = minInFlight;
+	stats.ringHighWater = ringHighWater;
+
+	return stats;
+}
+
+void TransferQueue::resetStats() {
+	transfers = 0;
+	bytes = 0;
+	errors = 0;
+	consumed = 0;
+	queueLatencySum = 0;
+	queueLatencyMax = 0;
+	released = 0;
+	processSum = 0;
+	processMax = 0;
+	ringHighWater = 0;
+	minInFlight = transferCount;
+	startTime = toNs(std::chrono::steady_clock::now());
+}
@@ -0,0 +1,220 @@
+/**
+ * Asynchronous bulk IN transfers, N transfers are always queued in libusb, so the
+ * host controller has a buffer for the next packet while the application processes
+ * the last one. Completed transfers are handed to the consumer through a lock free
+ * ring, the consumer reads the transfer buffer directly, and releases it, which
+ * submits the transfer again.
+ *
+ *   UsbDevice device;
+ *   UsbInterface interface;
+ *   device.open();
+ *   device.claimInterface(UsbInterfaceType::Vendor, interface);
+ *
+ *   TransferQueue queue(device, interface.endpointIn, 8, 4096);
+ *   queue.start();
+ *   while (UsbBlock* block = queue.next(1000)) {
+ *       process(block->data, block->length);
+ *       queue.release(block);
+ *   }
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "usb-device.h"
+#include "spsc-ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/**
+ * Max transfers in flight
+ */
+#define TRANSFER_QUEUE_MAX 64
+
+typedef std::chrono::steady_clock::time_point UsbTime;
+
+/**
+ * Completed transfer, owned by the consumer until TransferQueue::release()
+ */
+struct UsbBlock {
+	/**
+	 * Received data, the transfer buffer
+	 */
+	const uint8_t* data = nullptr;
+	size_t length = 0;
+
+	/**
+	 * Host time of the completion callback
+	 */
+	UsbTime completed;
+
+private:
+	friend class TransferQueue;
+
+	libusb_transfer* transfer = nullptr;
+	class TransferQueue* queue = nullptr;
+	UsbTime taken;
+};
+
+/**
+ * Counters, read with TransferQueue::stats()
+ */
+struct TransferStats {
+	/**
+	 * Completed transfers with data, and their bytes
+	 */
+	uint64_t transfers = 0;
+	uint64_t bytes = 0;
+
+	/**
+	 * Transfers failed (STALL, overflow, device gone)
+	 */
+	uint64_t errors = 0;
+
+	/**
+	 * Seconds since start(), and the throughput in this time
+	 */
+	double seconds = 0;
+	double bytesPerSecond = 0;
+
+	/**
+	 * Time a completed transfer waited in the ring for the consumer, in µs
+	 */
+	double queueLatencyAvgUs = 0;
+	double queueLatencyMaxUs = 0;
+
+	/**
+	 * Time the consumer kept a block until release(), in µs
+	 */
+	double processAvgUs = 0;
+	double processMaxUs = 0;
+
+	/**
+	 * Min transfers still queued when a transfer completed, 0 means the host controller
+	 * had no buffer for some time, and the device was NAKed: the consumer is too slow,
+	 * or more / larger transfers are needed
+	 */
+	size_t minInFlight = 0;
+
+	/**
+	 * Max completed transfers waiting for the consumer
+	 */
+	size_t ringHighWater = 0;
+};
+
+class TransferQueue {
+public:
+	/**
+	 * @param device Opened device, the interface needs to be claimed
+	 * @param endpoint Bulk IN endpoint
+	 * @param transfers Transfers in flight, max TRANSFER_QUEUE_MAX
+	 * @param transferSize Bytes per transfer, multiple of the packet size
+	 */
+	TransferQueue(UsbDevice& device, uint8_t endpoint, size_t transfers = 8, size_t transferSize = 4096);
+	~TransferQueue();
+
+	TransferQueue(const TransferQueue&) = delete;
+	TransferQueue& operator=(const TransferQueue&) = delete;
+
+	/**
+	 * Submit all transfers
+	 *
+	 * @param eventThread Handle the libusb events in an own thread, else the
+	 *                    application calls libusb_handle_events*() itself
+	 * @return false on error, see lastError()
+	 */
+	bool start(bool eventThread = true);
+
+	/**
+	 * Cancel all transfers, and wait until libusb returned them. Blocks still
+	 * held by the consumer stay valid until released.
+	 */
+	void stop();
+
+	/**
+	 * Next completed transfer, consumer thread only
+	 *
+	 * @param timeoutMs 0: don't wait
+	 * @return Block, nullptr on timeout or if stopped / the device is gone
+	 */
+	UsbBlock* next(unsigned int timeoutMs = 0);
+
+	/**
+	 * The consumer is done with the block, the transfer is submitted again
+	 */
+	void release(UsbBlock* block);
+
+	/**
+	 * Completed transfers waiting in the ring
+	 */
+	size_t pending() const {
+		return ring.size();
+	}
+
+	/**
+	 * The device is gone, or a transfer could not be submitted
+	 */
+	bool failed() const {
+		return deviceGone.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Counters, can be called from any thread
+	 */
+	TransferStats stats() const;
+
+	/**
+	 * Reset the counters, and the time base of the throughput
+	 */
+	void resetStats();
+
+	const std::string& lastError() const {
+		return error;
+	}
+
+private:
+	static void LIBUSB_CALL transferCallback(libusb_transfer* transfer);
+	void completed(UsbBlock* block);
+	bool submit(UsbBlock* block);
+	void eventLoop();
+
+private:
+	UsbDevice& device;
+	uint8_t endpoint;
+	size_t transferCount;
+	size_t transferSize;
+
+	UsbBlock blocks[TRANSFER_QUEUE_MAX];
+
+	/**
+	 * Completed transfers, libusb event thread -> consumer
+	 */
+	SpscRing<UsbBlock*, TRANSFER_QUEUE_MAX> ring;
+
+	std::thread thread;
+	std::atomic<bool> running{false};
+	std::atomic<bool> deviceGone{false};
+	std::atomic<size_t> inFlight{0};
+	std::string error;
+
+	// Counters of the event thread
+	std::atomic<uint64_t> transfers{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> errors{0};
+	std::atomic<size_t> minInFlight{0};
+	std::atomic<size_t> ringHighWater{0};
+
+	// Counters of the consumer, in ns
+	std::atomic<uint64_t> consumed{0};
+	std::atomic<uint64_t> queueLatencySum{0};
+	std::atomic<uint64_t> queueLatencyMax{0};
+	std::atomic<uint64_t> released{0};
+	std::atomic<uint64_t> processSum{0};
+	std::atomic<uint64_t> processMax{0};
+
+	std::atomic<int64_t> startTime{0};
+};
@@ -0,0 +1,207 @@
+/**
+ * Open the device with libusb, and claim the CDC data or the vendor bulk interface
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "usb-device.h"
+
+/**
+ * Interface classes
+ */
+#define USB_CLASS_CDC_CONTROL 0x02
+#define USB_CLASS_CDC_DATA 0x0A
+#define USB_CLASS_VENDOR 0xFF
+
+UsbDevice::UsbDevice() {
+	int result = libusb_init(&ctx);
+	if (result < 0) {
+		ctx = nullptr;
+		setError("libusb_init", result);
+	}
+}
+
+UsbDevice::~UsbDevice() {
+	if (dev) {
+		for (int i = 0; i < 32; i++) {
+			if (claimed & (1u << i)) {
+				libusb_release_interface(dev, i);
+			}
+		}
+		libusb_close(dev);
+	}
+
+	if (ctx) {
+		libusb_exit(ctx);
+	}
+}
+
+bool UsbDevice::setError(const std::string& message, int result) {
+	error = message + ": " + libusb_error_name(result);
+	return false;
+}
+
+bool UsbDevice::readSerial(libusb_device_handle* handle, const libusb_device_descriptor& descriptor, std::string& serial) {
+	unsigned char buffer[128];
+
+	serial.clear();
+	if (descriptor.iSerialNumber == 0) {
+		return true;
+	}
+
+	int length = libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber, buffer, sizeof(buffer));
+	if (length < 0) {
+		return false;
+	}
+
+	serial.assign((const char*) buffer, length);
+	return true;
+}
+
+bool UsbDevice::open(uint16_t vendor, uint16_t product, const std::string& serial) {
+	libusb_device** list;
+	libusb_device_descriptor descriptor;
+	std::string deviceSerial;
+
+	if (!ctx) {
+		return false;
+	}
+
+	ssize_t count = libusb_get_device_list(ctx, &list);
+	if (count < 0) {
+		return setError("libusb_get_device_list", (int) count);
+	}
+
+	error = "Device not found";
+	for (ssize_t i = 0; i < count && !dev; i++) {
+		if (libusb_get_device_descriptor(list[i], &descriptor) < 0
+				|| descriptor.idVendor != vendor || descriptor.idProduct != product) {
+			continue;
+		}
+
+		libusb_device_handle* handle;
+		int result = libusb_open(list[i], &handle);
+		if (result < 0) {
+			setError("libusb_open", result);
+			continue;
+		}
+
+		if (!readSerial(handle, descriptor, deviceSerial) || (!serial.empty() && serial != deviceSerial)) {
+			libusb_close(handle);
+			continue;
+		}
+
+		dev = handle;
+		serialNumber = deviceSerial;
+	}
+
+	libusb_free_device_list(list, 1);
+
+	if (!dev) {
+		return false;
+	}
+
+	// Detached on claim, attached again on release
+	libusb_set_auto_detach_kernel_driver(dev, 1);
+	error.clear();
+
+	return true;
+}
+
+bool UsbDevice::claimInterface(UsbInterfaceType type, UsbInterface& interface) {
+	libusb_config_descriptor* config;
+	uint8_t interfaceClass = type == UsbInterfaceType::Cdc ? USB_CLASS_CDC_DATA : USB_CLASS_VENDOR;
+	int control = -1;
+
+	if (!dev) {
+		error = "Not open";
+		return false;
+	}
+
+	int result = libusb_get_active_config_descriptor(libusb_get_device(dev), &config);
+	if (result < 0) {
+		return setError("libusb_get_active_config_descriptor", result);
+	}
+
+	interface = UsbInterface();
+	for (int i = 0; i < config->bNumInterfaces && interface.number < 0; i++) {
+		const libusb_interface_descriptor* descriptor = &config->interface[i].altsetting[0];
+
+		if (descriptor->bInterfaceClass == USB_CLASS_CDC_CONTROL) {
+			control = descriptor->bInterfaceNumber;
+		}
+
+		if (descriptor->bInterfaceClass != interfaceClass) {
+			continue;
+		}
+
+		for (int e = 0; e < descriptor->bNumEndpoints; e++) {
+			const libusb_endpoint_descriptor* endpoint = &descriptor->endpoint[e];
+
+			if ((endpoint->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK) {
+				continue;
+			}
+
+			if (endpoint->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+				interface.endpointIn = endpoint->bEndpointAddress;
+				interface.packetSize = endpoint->wMaxPacketSize;
+			} else {
+				interface.endpointOut = endpoint->bEndpointAddress;
+			}
+		}
+
+		if (interface.endpointIn) {
+			interface.number = descriptor->bInterfaceNumber;
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+
+	if (interface.number < 0) {
+		error = type == UsbInterfaceType::Cdc ? "No CDC data interface" : "No vendor interface, firmware built with VENDOR_BULK=0?";
+		return false;
+	}
+
+	// cdc_acm is bound to both CDC interfaces, claiming the control interface detaches it completely
+	if (type == UsbInterfaceType::Cdc && control >= 0 && !(claimed & (1u << control))) {
+		result = libusb_claim_interface(dev, control);
+		if (result < 0) {
+			return setError("libusb_claim_interface", result);
+		}
+		claimed |= 1u << control;
+	}
+
+	if (!(claimed & (1u << interface.number))) {
+		result = libusb_claim_interface(dev, interface.number);
+		if (result < 0) {
+			return setError("libusb_claim_interface", result);
+		}
+		claimed |= 1u << interface.number;
+	}
+
+	return true;
+}
+
+int UsbDevice::bulkWrite(uint8_t endpoint, const void* data, int length, unsigned int timeoutMs) {
+	int transferred = 0;
+
+	int result = libusb_bulk_transfer(dev, endpoint, (unsigned char*) data, length, &transferred, timeoutMs);
+	if (result < 0 && result != LIBUSB_ERROR_TIMEOUT) {
+		setError("libusb_bulk_transfer", result);
+		return -1;
+	}
+
+	return transferred;
+}
+
+int UsbDevice::controlRead(uint8_t request, uint16_t value, uint16_t index, void* data, uint16_t length, unsigned int timeoutMs) {
+	int result = libusb_control_transfer(dev, LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+			request, value, index, (unsigned char*) data, length, timeoutMs);
+	if (result < 0) {
+		setError("libusb_control_transfer", result);
+		return -1;
+	}
+
+	return result;
+}
@@ -0,0 +1,121 @@
+/**
+ * Open the device with libusb, and claim the CDC data or the vendor bulk interface
+ * for raw access, see transfer-queue.h
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include <libusb.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * VID / PID of usb-descriptor.json
+ */
+#define USB_DEVICE_VENDOR 0x16c0
+#define USB_DEVICE_PRODUCT 0x05e1
+
+/**
+ * Interface types, found by the interface class, so the interface numbers
+ * of usb-descriptor.json are not needed
+ */
+enum class UsbInterfaceType {
+	/**
+	 * CDC data interface (class 0x0A), EP2, the kernel driver (cdc_acm) is detached
+	 */
+	Cdc,
+
+	/**
+	 * Vendor specific interface (class 0xFF), EP3, firmware built with VENDOR_BULK=1
+	 */
+	Vendor
+};
+
+/**
+ * Claimed interface and its bulk endpoints
+ */
+struct UsbInterface {
+	int number = -1;
+	uint8_t endpointIn = 0;
+	uint8_t endpointOut = 0;
+	uint16_t packetSize = 0;
+};
+
+class UsbDevice {
+public:
+	UsbDevice();
+	~UsbDevice();
+
+	UsbDevice(const UsbDevice&) = delete;
+	UsbDevice& operator=(const UsbDevice&) = delete;
+
+	/**
+	 * Open the first device with this VID / PID, and serial number if not empty
+	 *
+	 * @return false on error, see lastError()
+	 */
+	bool open(uint16_t vendor = USB_DEVICE_VENDOR, uint16_t product = USB_DEVICE_PRODUCT, const std::string& serial = "");
+
+	/**
+	 * Claim an interface, the kernel driver is detached while claimed
+	 *
+	 * @param type Interface type
+	 * @param interface Interface and endpoints, filled
+	 * @return false if the interface does not exist or is busy, see lastError()
+	 */
+	bool claimInterface(UsbInterfaceType type, UsbInterface& interface);
+
+	/**
+	 * Synchronous bulk OUT, for commands, e.g. starting the stream
+	 *
+	 * @return Bytes written, -1 on error
+	 */
+	int bulkWrite(uint8_t endpoint, const void* data, int length, unsigned int timeoutMs = 1000);
+
+	/**
+	 * Vendor request to the device with a data stage IN, see processNonStandardSetupRequest() of lib/usb-cdc.c
+	 *
+	 * @return Bytes read, -1 on error
+	 */
+	int controlRead(uint8_t request, uint16_t value, uint16_t index, void* data, uint16_t length, unsigned int timeoutMs = 1000);
+
+	/**
+	 * Serial number string, empty if none
+	 */
+	const std::string& serial() const {
+		return serialNumber;
+	}
+
+	/**
+	 * Last error, for messages
+	 */
+	const std::string& lastError() const {
+		return error;
+	}
+
+	libusb_context* context() const {
+		return ctx;
+	}
+
+	libusb_device_handle* handle() const {
+		return dev;
+	}
+
+private:
+	bool setError(const std::string& message, int result);
+	bool readSerial(libusb_device_handle* handle, const libusb_device_descriptor& descriptor, std::string& serial);
+
+private:
+	libusb_context* ctx = nullptr;
+	libusb_device_handle* dev = nullptr;
+	std::string serialNumber;
+	std::string error;
+
+	/**
+	 * Claimed interface numbers, bit n = interface n, released on close
+	 */
+	uint32_t claimed = 0;
+};
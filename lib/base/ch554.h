@@ -25,7 +25,9 @@ Header file for CH554 microcontrollers.
 #define __at(x)
 #define __code
 #define __idata
+#define __data
 #define __interrupt(x)
+#define __using(x)
 #define SBIT(var, b, c) uint8_t var = 0
 
 uint8_t P1_0 = 0;
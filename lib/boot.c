@@ -0,0 +1,30 @@
+/**
+ * Boot phase timestamps
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "boot.h"
+
+#if BOOT_TIMES_ENABLE
+
+/**
+ * Boot phase timestamps
+ */
+__xdata BootTimes g_BootTimes;
+
+/**
+ * Store the timestamp of a phase, outside of the interrupt, use BOOT_PHASE()
+ *
+ * @param phase BOOT_PHASE_*
+ */
+void bootPhase(uint8_t phase) {
+	bool interrupts = EA;
+
+	EA = 0;
+	BOOT_PHASE_ISR(phase);
+	EA = interrupts;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * Boot phase timestamps: ticks of timer.h (0 = timer started, just after the
+ * clock switch) when each boot phase was reached for the first time.
+ * Read by the host with a vendor request, see test-tools/boot-time.py
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+#include "timer.h"
+
+// Enabled in the Makefile
+#ifndef BOOT_TIMES_ENABLE
+#define BOOT_TIMES_ENABLE 1
+#endif
+
+// Boot phases, in the expected order, see test-tools/boot-time.py
+#define BOOT_PHASE_INIT 0          // Watchdog set up, init without data flash access
+#define BOOT_PHASE_CLOCK 1         // Clock stable
+#define BOOT_PHASE_PULLUP 2        // Recorder and configuration loaded, USB pull-up enabled, the host sees the device
+#define BOOT_PHASE_USB_READY 3     // Endpoints configured, interrupts enabled
+#define BOOT_PHASE_DEFERRED 4      // Deferred init done, main loop starts
+#define BOOT_PHASE_BUS_RESET 5     // First bus reset
+#define BOOT_PHASE_CONFIGURED 6    // SET_CONFIGURATION
+#define BOOT_PHASE_FIRST_TX 7      // First CDC data packet
+
+#define BOOT_PHASES 8
+
+/**
+ * Boot phase timestamps, the layout is read by test-tools/boot-time.py
+ */
+typedef struct {
+	/**
+	 * Bit n set: phase n reached
+	 */
+	uint8_t phases;
+
+	/**
+	 * Ticks of timer.h
+	 */
+	uint32_t ticks[BOOT_PHASES];
+} BootTimes;
+
+#if BOOT_TIMES_ENABLE
+
+extern __xdata BootTimes g_BootTimes;
+
+/**
+ * Store the timestamp of a phase, in the USB interrupt, without function call
+ */
+#define BOOT_PHASE_ISR(phase) { \
+	if (!(g_BootTimes.phases & (1 << (phase)))) { \
+		g_BootTimes.phases |= 1 << (phase); \
+		TIMER_GET_TICKS(g_BootTimes.ticks[phase]); \
+	} \
+}
+
+/**
+ * Store the timestamp of a phase, outside of the interrupt
+ */
+#define BOOT_PHASE(phase) bootPhase(phase)
+
+/**
+ * Store the timestamp of a phase, outside of the interrupt, use BOOT_PHASE()
+ *
+ * @param phase BOOT_PHASE_*
+ */
+void bootPhase(uint8_t phase);
+
+#else
+
+#define BOOT_PHASE_ISR(phase)
+#define BOOT_PHASE(phase)
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * Persisted device configuration, stored in the data flash
+ * and loaded on boot, so the device is configured before
+ * the host enumerates it.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "config.h"
+#include "dataflash.h"
+
+#define LOG_MODULE 2
+#include "log.h"
+
+/**
+ * Default configuration, used if the data flash contains no valid block.
+ * The initial baud rate is 57600, 1 stop bit, no parity, 8 data bits,
+ * autostart sends the speedtest text, sample frames have all channels at 1000 samples / s.
+ */
+__code DeviceConfig g_ConfigDefault = {
+	CONFIG_MAGIC,
+	CONFIG_VERSION,
+	{ 0x00, 0xe1, 0x00, 0x00, 0x00, 0x00, 0x08 },
+	1000,
+	0xff,
+	CONFIG_OUTPUT_TEXT,
+	0,
+	0
+};
+
+/**
+ * Current configuration
+ */
+__xdata DeviceConfig g_Config;
+
+/**
+ * Configuration changed, needs to be written to the data flash
+ */
+volatile bool g_ConfigDirty = false;
+
+/**
+ * Copy written to the data flash, the USB interrupt may change g_Config meanwhile
+ */
+__xdata DeviceConfig g_ConfigSnapshot;
+
+/**
+ * Calculate the checksum of a configuration block
+ *
+ * @param config Configuration block
+ * @return XOR of all bytes except the checksum itself
+ */
+uint8_t configChecksum(__xdata DeviceConfig* config) {
+	uint8_t i;
+	uint8_t sum = 0;
+	__xdata uint8_t* data = (__xdata uint8_t*) config;
+
+	for (i = 0; i < sizeof(DeviceConfig) - 1; i++) {
+		sum ^= data[i];
+	}
+
+	return sum;
+}
+
+/**
+ * Load the configuration from the data flash,
+ * use the defaults if the block is missing or invalid
+ */
+void configLoad() {
+	ReadDataFlash(CONFIG_FLASH_ADDR, sizeof(DeviceConfig), (uint8_t*) &g_Config);
+
+	if (g_Config.magic != CONFIG_MAGIC || g_Config.version != CONFIG_VERSION
+			|| g_Config.checksum != configChecksum(&g_Config)) {
+		memcpy(&g_Config, &g_ConfigDefault, sizeof(DeviceConfig));
+	}
+}
+
+/**
+ * Write the configuration to the data flash
+ */
+void configSave() {
+	bool interrupts = EA;
+
+	// SET_LINE_CODING / SET_DEVICE_CONFIG change g_Config in the USB interrupt,
+	// a change after the copy sets the dirty flag again
+	EA = 0;
+	memcpy(&g_ConfigSnapshot, &g_Config, sizeof(DeviceConfig));
+	g_ConfigDirty = false;
+	EA = interrupts;
+
+	g_ConfigSnapshot.magic = CONFIG_MAGIC;
+	g_ConfigSnapshot.version = CONFIG_VERSION;
+	g_ConfigSnapshot.checksum = configChecksum(&g_ConfigSnapshot);
+
+	WriteDataFlash(CONFIG_FLASH_ADDR, (uint8_t*) &g_ConfigSnapshot, sizeof(DeviceConfig));
+	LOG_INFO("Config saved, version %u", CONFIG_VERSION);
+}
+
+/**
+ * Write the configuration, if it was changed. Called from the main loop,
+ * because the data flash should not be written from the USB interrupt
+ */
+void configProcess() {
+	if (g_ConfigDirty) {
+		configSave();
+	}
+}
@@ -0,0 +1,116 @@
+/**
+ * Persisted device configuration, stored in the data flash
+ * and loaded on boot, so the device is configured before
+ * the host enumerates it.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+/**
+ * Magic byte, to detect an empty / foreign data flash
+ */
+#define CONFIG_MAGIC 0xC5
+
+/**
+ * Layout version, increment if DeviceConfig changes,
+ * so an old block is replaced by the defaults
+ */
+#define CONFIG_VERSION 3
+
+/**
+ * Data flash address of the configuration block
+ */
+#define CONFIG_FLASH_ADDR 0
+
+/**
+ * Start streaming as soon as the host configured the device
+ */
+#define CONFIG_FLAG_AUTOSTART 0x01
+
+/**
+ * Output format: what is sent on autostart, see logic.c
+ */
+// Speedtest text, the same as the 's' command
+#define CONFIG_OUTPUT_TEXT 0
+// Stream packets until any byte is received, the same as "P 0"
+#define CONFIG_OUTPUT_STREAM 1
+// Sample frames at sampleRate and with channelMask, until "F 0" is received
+#define CONFIG_OUTPUT_FRAMES 2
+
+/**
+ * Persisted configuration block
+ */
+typedef struct {
+	/**
+	 * CONFIG_MAGIC
+	 */
+	uint8_t magic;
+
+	/**
+	 * CONFIG_VERSION
+	 */
+	uint8_t version;
+
+	/**
+	 * CDC line coding: baud rate (LE), stop bits, parity, data bits
+	 */
+	uint8_t lineCoding[7];
+
+	/**
+	 * Application: Sample rate of the sample frames on autostart in samples / s,
+	 * 0 = as fast as possible
+	 */
+	uint16_t sampleRate;
+
+	/**
+	 * Application: Channels in a sample frame, bit n = channel n, 0 = all
+	 */
+	uint8_t channelMask;
+
+	/**
+	 * Application: CONFIG_OUTPUT_*
+	 */
+	uint8_t outputFormat;
+
+	/**
+	 * CONFIG_FLAG_*
+	 */
+	uint8_t flags;
+
+	/**
+	 * XOR of all bytes before
+	 */
+	uint8_t checksum;
+} DeviceConfig;
+
+/**
+ * Current configuration
+ */
+extern __xdata DeviceConfig g_Config;
+
+/**
+ * Configuration changed, needs to be written to the data flash
+ */
+extern volatile bool g_ConfigDirty;
+
+/**
+ * Load the configuration from the data flash,
+ * use the defaults if the block is missing or invalid
+ */
+void configLoad();
+
+/**
+ * Write the configuration to the data flash
+ */
+void configSave();
+
+/**
+ * Write the configuration, if it was changed. Called from the main loop,
+ * because the data flash should not be written from the USB interrupt
+ */
+void configProcess();
@@ -0,0 +1,93 @@
+/**
+ * CRC-8, CRC-16 and CRC-32, used for the test stream packets, the frames of frame.h
+ * and everything else which needs an integrity check
+ *
+ * CRC-8/SMBUS:        polynomial 0x07, initial value 0x00
+ * CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF (Python binascii.crc_hqx)
+ * CRC-32/ISO-HDLC:    polynomial 0x04C11DB7 reflected, initial value and final XOR 0xFFFFFFFF
+ *                     (Python zlib.crc32, Ethernet, ZIP)
+ *
+ * The calculation is selected at compile time with CRC_STRATEGY, see build/Makefile.
+ * Bytes per second of each strategy: make bench-crc
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+// 256 entry table in code flash per CRC: 256 + 512 + 1024 bytes, fastest
+#define CRC_STRATEGY_TABLE 0
+
+// 16 entry table in code flash per CRC: 16 + 32 + 64 bytes
+#define CRC_STRATEGY_NIBBLE 1
+
+// Bit by bit, no table, slowest
+#define CRC_STRATEGY_BITWISE 2
+
+// Selected in the Makefile
+#ifndef CRC_STRATEGY
+#define CRC_STRATEGY CRC_STRATEGY_NIBBLE
+#endif
+
+/**
+ * Initial values
+ */
+#define CRC8_INIT 0x00
+#define CRC16_INIT 0xFFFF
+#define CRC32_INIT 0xFFFFFFFF
+
+/**
+ * Final value of the CRC-32, after the last block
+ */
+#define CRC32_FINAL(crc) ((crc) ^ 0xFFFFFFFF)
+
+/**
+ * Update the CRC-8 with a block of data
+ *
+ * @param crc CRC8_INIT, or the result of the previous block
+ * @param data Data
+ * @param len Length in bytes
+ * @return CRC
+ */
+uint8_t crc8(uint8_t crc, __xdata uint8_t* data, uint8_t len);
+
+/**
+ * Update the CRC-16 with a block of data
+ *
+ * @param crc CRC16_INIT, or the result of the previous block
+ * @param data Data
+ * @param len Length in bytes
+ * @return CRC
+ */
+uint16_t crc16(uint16_t crc, __xdata uint8_t* data, uint8_t len);
+
+/**
+ * Update the CRC-16 with a single byte, for data which is not in a buffer
+ *
+ * @param crc CRC16_INIT, or the result of the previous byte
+ * @param data Byte
+ * @return CRC
+ */
+uint16_t crc16Byte(uint16_t crc, uint8_t data);
+
+/**
+ * Update the CRC-32 with a block of data
+ *
+ * @param crc CRC32_INIT, or the result of the previous block
+ * @param data Data
+ * @param len Length in bytes
+ * @return CRC, CRC32_FINAL() is applied after the last block
+ */
+uint32_t crc32(uint32_t crc, __xdata uint8_t* data, uint8_t len);
+
+/**
+ * Update the CRC-32 with a single byte, for data which is not in a buffer
+ *
+ * @param crc CRC32_INIT, or the result of the previous byte
+ * @param data Byte
+ * @return CRC, CRC32_FINAL() is applied after the last byte
+ */
+uint32_t crc32Byte(uint32_t crc, uint8_t data);
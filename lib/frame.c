@@ -0,0 +1,145 @@
+/**
+ * Binary frames over USB CDC, for telemetry with less overhead than text
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "frame.h"
+#include "crc.h"
+#include "usb-cdc.h"
+
+/**
+ * Transmit buffer the frames are encoded into, NULL if none is started
+ */
+__xdata uint8_t* g_FrameBuffer = NULL;
+
+/**
+ * Write position in the transmit buffer
+ */
+uint8_t g_FramePos = 0;
+
+/**
+ * Position of the COBS code byte of the current block
+ */
+uint8_t g_FrameCodePos = 0;
+
+/**
+ * COBS code of the current block: count of the bytes written + 1
+ */
+uint8_t g_FrameCode = 0;
+
+/**
+ * CRC of the current frame
+ */
+uint16_t g_FrameCrc = 0;
+
+/**
+ * COBS encode one byte. A block never reaches 254 bytes,
+ * because a frame is never longer than a USB packet.
+ *
+ * @param data Byte
+ */
+inline void frameEncode(uint8_t data) {
+	if (data == 0) {
+		// The 0 is replaced by the code of the finished block
+		g_FrameBuffer[g_FrameCodePos] = g_FrameCode;
+		g_FrameCodePos = g_FramePos++;
+		g_FrameCode = 1;
+	} else {
+		g_FrameBuffer[g_FramePos++] = data;
+		g_FrameCode++;
+	}
+}
+
+/**
+ * Start a frame, exactly length payload bytes need to be added,
+ * then the frame is completed with Frame_end()
+ *
+ * @param type Frame type FRAME_TYPE_*
+ * @param length Payload length, max FRAME_MAX_PAYLOAD
+ * @return false if not connected or the frame is too long, nothing may be added then
+ */
+bool Frame_begin(uint8_t type, uint8_t length) {
+	if (length > FRAME_MAX_PAYLOAD) {
+		return false;
+	}
+
+	// Worst case: COBS adds no byte, because the frame is shorter than a COBS block
+	if (g_FrameBuffer != NULL && g_FramePos + length + FRAME_OVERHEAD > USBCDC_TRANSMIT_BUFFER_LEN) {
+		Frame_flush();
+	}
+
+	if (g_FrameBuffer == NULL) {
+		g_FrameBuffer = UsbCdc_beginTransmit();
+		if (g_FrameBuffer == NULL) {
+			return false;
+		}
+		g_FramePos = 0;
+	}
+
+	g_FrameCodePos = g_FramePos++;
+	g_FrameCode = 1;
+	g_FrameCrc = CRC16_INIT;
+
+	Frame_put(type);
+	Frame_put(length);
+
+	return true;
+}
+
+/**
+ * Add a payload byte
+ *
+ * @param data Byte
+ */
+void Frame_put(uint8_t data) {
+	g_FrameCrc = crc16Byte(g_FrameCrc, data);
+	frameEncode(data);
+}
+
+/**
+ * Add a 16 bit payload value, little endian
+ *
+ * @param data Value
+ */
+void Frame_putU16(uint16_t data) {
+	Frame_put(data);
+	Frame_put(data >> 8);
+}
+
+/**
+ * Add a 32 bit payload value, little endian
+ *
+ * @param data Value
+ */
+void Frame_putU32(uint32_t data) {
+	Frame_putU16(data);
+	Frame_putU16(data >> 16);
+}
+
+/**
+ * Complete the frame, the frame is sent with the next Frame_flush()
+ */
+void Frame_end() {
+	uint16_t crc = g_FrameCrc;
+
+	frameEncode(crc);
+	frameEncode(crc >> 8);
+
+	// Last block, followed by the delimiter
+	g_FrameBuffer[g_FrameCodePos] = g_FrameCode;
+	g_FrameBuffer[g_FramePos++] = 0;
+}
+
+/**
+ * Send the completed frames, needs to be called before other data is sent with usb-cdc.h
+ */
+void Frame_flush() {
+	if (g_FrameBuffer == NULL) {
+		return;
+	}
+
+	UsbCdc_transmit(g_FramePos);
+	g_FrameBuffer = NULL;
+}
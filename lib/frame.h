@@ -0,0 +1,74 @@
+/**
+ * Binary frames over USB CDC, for telemetry with less overhead than text
+ *
+ * Frame: uint8_t type, uint8_t length, payload, uint16_t CRC-16/CCITT-FALSE
+ * (little endian, over type, length and payload). The frame is COBS encoded,
+ * so it contains no 0 byte, and terminated with a 0 byte.
+ *
+ * The frames are encoded directly into the USB transmit buffer, without copy.
+ * A frame does not span USB packets, multiple frames are packed into one packet,
+ * which is sent by Frame_flush() or if the next frame does not fit anymore.
+ * Decoder for the host: test-tools/frame.py
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+/**
+ * Encoded bytes in addition to the payload: COBS code, type, length, CRC, delimiter
+ */
+#define FRAME_OVERHEAD 6
+
+/**
+ * Max payload length, the encoded frame fits into one USB packet
+ */
+#define FRAME_MAX_PAYLOAD (64 - FRAME_OVERHEAD)
+
+// Frame types, see test-tools/frame.py
+#define FRAME_TYPE_SAMPLES 0x01
+#define FRAME_TYPE_LOG 0x02
+
+/**
+ * Start a frame, exactly length payload bytes need to be added,
+ * then the frame is completed with Frame_end()
+ *
+ * @param type Frame type FRAME_TYPE_*
+ * @param length Payload length, max FRAME_MAX_PAYLOAD
+ * @return false if not connected or the frame is too long, nothing may be added then
+ */
+bool Frame_begin(uint8_t type, uint8_t length);
+
+/**
+ * Add a payload byte
+ *
+ * @param data Byte
+ */
+void Frame_put(uint8_t data);
+
+/**
+ * Add a 16 bit payload value, little endian
+ *
+ * @param data Value
+ */
+void Frame_putU16(uint16_t data);
+
+/**
+ * Add a 32 bit payload value, little endian
+ *
+ * @param data Value
+ */
+void Frame_putU32(uint32_t data);
+
+/**
+ * Complete the frame, the frame is sent with the next Frame_flush()
+ */
+void Frame_end();
+
+/**
+ * Send the completed frames, needs to be called before other data is sent with usb-cdc.h
+ */
+void Frame_flush();
@@ -5,18 +5,25 @@
  * License: MIT
  */
 
-#include "inc.h"
+#include "hardware.h"
+#include "profile.h"
+#include "timer.h"
 
 // USB BUFFER -----------------------------------------------------------------
 
 // Endpoint 0 OUT & IN buffer, must be an even address
-__xdata __at (0x0000) uint8_t  Ep0Buffer[DEFAULT_ENDP0_SIZE];
+__xdata __at (USB_EP0_BUFFER) uint8_t  Ep0Buffer[DEFAULT_ENDP0_SIZE];
 
 // Endpoint 1 upload buffer
-__xdata __at (0x0040) uint8_t  Ep1Buffer[DEFAULT_ENDP1_SIZE];
+__xdata __at (USB_EP1_BUFFER) uint8_t  Ep1Buffer[DEFAULT_ENDP1_SIZE];
 
 // Endpoint 2 IN & OUT buffer, must be an even address
-__xdata __at (0x0080) uint8_t  Ep2Buffer[2 * MAX_PACKET_SIZE];
+__xdata __at (USB_EP2_BUFFER) uint8_t  Ep2Buffer[2 * MAX_PACKET_SIZE];
+
+#if VENDOR_BULK_ENABLE
+// Endpoint 3 (vendor bulk) OUT & IN buffer, must be an even address
+__xdata __at (USB_EP3_BUFFER) uint8_t  Ep3Buffer[2 * MAX_PACKET_SIZE];
+#endif
 
 // ----------------------------------------------------------------------------
 
@@ -51,6 +58,15 @@ void ConfigureSystemClock() {
 	SAFE_MOD = 0x00;
 }
 
+/**
+ * Wait until CLOCK_SETTLE_MS passed since the clock switch,
+ * timerSetup() needs to be called directly after ConfigureSystemClock()
+ */
+void clockWaitStable() {
+	// The timer started with 0, and does not overflow within this time
+	while (timerGetTicks() < CLOCK_SETTLE_MS * (TIMER_TICKS_PER_SECOND / 1000));
+}
+
 /**
  * Delay Microseconds
  *
@@ -151,25 +167,31 @@ void USBDeviceCfg() {
  */
 void USBDeviceEndPointCfg() {
 	// Endpoint 1 sends the data transfer address
-	UEP1_DMA = (uint16_t) Ep1Buffer;
+	UEP1_DMA = (uint16_t) (uintptr_t) Ep1Buffer;
 
 	// Endpoint 2 IN data transfer address
-	UEP2_DMA = (uint16_t) Ep2Buffer;
+	UEP2_DMA = (uint16_t) (uintptr_t) Ep2Buffer;
 
-	// Endpoint 2/3 Single Buffer Transceiver Enable
-	UEP2_3_MOD = 0xCC;
+	// Endpoint 2/3 single buffer, directions of usb-descriptor.json
+	UEP2_3_MOD = USB_UEP2_3_MOD;
 
 	// Endpoint 2 automatically flips the sync flag, IN transaction returns NAK, OUT returns ACK
 	UEP2_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
 
+#if VENDOR_BULK_ENABLE
+	// Endpoint 3 (vendor bulk) data transfer address, same mode as endpoint 2
+	UEP3_DMA = (uint16_t) (uintptr_t) Ep3Buffer;
+	UEP3_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
+#endif
+
 	// Endpoint 1 automatically flips the sync flag, and IN transaction returns NAK
 	UEP1_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK;
 
 	// Endpoint 0 data transfer address
-	UEP0_DMA = (uint16_t) Ep0Buffer;
+	UEP0_DMA = (uint16_t) (uintptr_t) Ep0Buffer;
 
 	// Endpoint 1 upload buffer; endpoint 0 single 64 byte send and receive buffer
-	UEP4_1_MOD = 0X40;
+	UEP4_1_MOD = USB_UEP4_1_MOD;
 
 	// Manual flip, OUT transaction returns ACK, IN transaction returns NAK
 	UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
@@ -191,6 +213,11 @@ void USBDeviceIntCfg() {
 	// Do it all together, to save a few bytes
 	USB_INT_EN |= bUIE_SUSPEND | bUIE_TRANSFER | bUIE_BUS_RST;
 
+#if PROFILE_NAK
+	// Interrupt on each NAK, to count NAKed OUT packets
+	USB_INT_EN |= bUIE_DEV_NAK;
+#endif
+
 	// Clear interrupt flag
 	USB_INT_FG |= 0x1F;
 
@@ -201,6 +228,25 @@ void USBDeviceIntCfg() {
 	EA = 1;
 }
 
+/**
+ * Configure the interrupt priorities, profile selected by INT_PRIORITY.
+ * Interrupts which can preempt each other must not use the same register bank!
+ */
+void interruptPrioritySetup() {
+#if INT_PRIORITY == INT_PRIORITY_USB_FIRST
+	PT0 = 0;
+	IP_EX = bIP_USB;
+#elif INT_PRIORITY == INT_PRIORITY_TIMER_FIRST
+	PT0 = 1;
+	IP_EX = 0;
+#elif INT_PRIORITY == INT_PRIORITY_DEFAULT
+	PT0 = 0;
+	IP_EX = 0;
+#else
+#error INT_PRIORITY invalid
+#endif
+}
+
 #define BOOT_ADDR  0x3800
 
 /**
@@ -215,6 +261,12 @@ void jumpToBootloader() {
 	// Disable all interrupts
 	EA = 0;
 
+	// The bootloader does not kick the watchdog, it would reset the device during the update
+	SAFE_MOD = 0x55;
+	SAFE_MOD = 0xAA;
+	GLOBAL_CFG &= ~bWDOG_EN;
+	SAFE_MOD = 0x00;
+
 	// Ignore in IDE, non standard C Syntax
 #ifndef IDE_ENVIRONMENT
 
@@ -8,8 +8,10 @@
 #pragma once
 
 #include "inc.h"
+#include "../usb-descriptor/usb-layout.h"
 
 // USB BUFFER -----------------------------------------------------------------
+// Addresses generated from usb-descriptor.json, see usb-descriptor/usb-layout.h
 
 #undef DEFAULT_ENDP0_SIZE
 #define DEFAULT_ENDP0_SIZE	64
@@ -17,23 +19,40 @@
 #define DEFAULT_ENDP1_SIZE	64
 
 // Endpoint 0 OUT & IN buffer, must be an even address
-extern __xdata __at (0x0000) uint8_t  Ep0Buffer[DEFAULT_ENDP0_SIZE];
+extern __xdata __at (USB_EP0_BUFFER) uint8_t  Ep0Buffer[DEFAULT_ENDP0_SIZE];
 
 // Endpoint 1 upload buffer
-extern __xdata __at (0x0040) uint8_t  Ep1Buffer[DEFAULT_ENDP1_SIZE];
+extern __xdata __at (USB_EP1_BUFFER) uint8_t  Ep1Buffer[DEFAULT_ENDP1_SIZE];
 
 // Endpoint 2 IN & OUT buffer, must be an even address
-extern __xdata __at (0x0080) uint8_t  Ep2Buffer[2 * MAX_PACKET_SIZE];
+extern __xdata __at (USB_EP2_BUFFER) uint8_t  Ep2Buffer[2 * MAX_PACKET_SIZE];
+
+#if VENDOR_BULK_ENABLE
+// Endpoint 3 (vendor bulk) OUT & IN buffer, must be an even address
+extern __xdata __at (USB_EP3_BUFFER) uint8_t  Ep3Buffer[2 * MAX_PACKET_SIZE];
+#endif
 
 // ----------------------------------------------------------------------------
 
 
 
+/**
+ * Time the internal oscillator needs after the clock switch. There is no ready flag,
+ * the time is measured with the timer, so the init done in between is not waited again.
+ */
+#define CLOCK_SETTLE_MS 5
+
 /**
  * Configure System Clock, system clock is set in the Makefile
  */
 void ConfigureSystemClock();
 
+/**
+ * Wait until CLOCK_SETTLE_MS passed since the clock switch,
+ * timerSetup() needs to be called directly after ConfigureSystemClock()
+ */
+void clockWaitStable();
+
 /**
  * Delay Microseconds
  *
@@ -63,6 +82,39 @@ void USBDeviceEndPointCfg();
  */
 void USBDeviceIntCfg();
 
+// INTERRUPT PRIORITY ---------------------------------------------------------
+
+/**
+ * Default 8051 priorities, no interrupt preempts another one,
+ * pending interrupts are served in vector order (Timer 0 before USB)
+ */
+#define INT_PRIORITY_DEFAULT		0
+
+/**
+ * USB interrupt has high priority, and preempts the timer.
+ * For streaming, the timer interrupt waits until a running USB interrupt is done
+ */
+#define INT_PRIORITY_USB_FIRST		1
+
+/**
+ * Timer 0 interrupt has high priority, and preempts the USB interrupt.
+ * For sampling, the timer interrupt is not delayed by a running USB interrupt
+ */
+#define INT_PRIORITY_TIMER_FIRST	2
+
+// Profile is selected in the Makefile
+#ifndef INT_PRIORITY
+#define INT_PRIORITY INT_PRIORITY_USB_FIRST
+#endif
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Configure the interrupt priorities, profile selected by INT_PRIORITY.
+ * Interrupts which can preempt each other must not use the same register bank!
+ */
+void interruptPrioritySetup();
+
 /**
  * This function provided a way to access the internal bootloader
  */
@@ -0,0 +1,300 @@
+/**
+ * In-application firmware update, compiled into the segment IAP at IAP_ADDR
+ * with --stack-auto, see build/Makefile. iapRun() needs to be the first function.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "iap.h"
+#include "hardware.h"
+#include "watchdog.h"
+
+#if IAP_ENABLE
+
+static void iapWriteWord(uint16_t addr, uint16_t value);
+static uint8_t iapReadByte(uint16_t addr);
+static uint16_t iapCrc(uint16_t crc, uint8_t value);
+static void iapBootloaderVector();
+static void iapSendResult(bool ok, uint16_t crc);
+static void iapReset();
+
+/**
+ * Receive and program the image, never returns. Interrupts are disabled,
+ * the USB is polled, the device stays configured.
+ */
+void iapRun() {
+	uint8_t header[IAP_HEADER_LEN];
+	uint8_t resetVector[IAP_RESET_VECTOR_LEN];
+	uint8_t headerPos = 0;
+	uint16_t addr = 0;
+	uint16_t length = 0;
+	uint16_t crc = 0;
+	uint8_t low = 0xff;
+	uint8_t len;
+	uint8_t i;
+	uint8_t b;
+	bool done = false;
+
+	// The interrupt vectors are overwritten
+	EA = 0;
+
+	UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_R_RES) | UEP_R_RES_ACK;
+
+	SAFE_MOD = 0x55;
+	SAFE_MOD = 0xAA;
+	GLOBAL_CFG |= bCODE_WE;
+	SAFE_MOD = 0x00;
+
+	while (1) {
+		WATCHDOG_KICK();
+
+		if (UIF_BUS_RST) {
+			// The host enumerates again, the loader can't answer
+			iapReset();
+		}
+
+		if (UIF_SUSPEND) {
+			UIF_SUSPEND = 0;
+		}
+
+		if (!UIF_TRANSFER) {
+			continue;
+		}
+
+		switch (USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP)) {
+		case UIS_TOKEN_OUT | 2:
+			len = 0;
+
+			// Copy into the unused EP1 buffer, the next packet is received while this one is programmed
+			if (U_TOG_OK) {
+				len = USB_RX_LEN;
+				for (i = 0; i < len; i++) {
+					Ep1Buffer[i] = Ep2Buffer[i];
+				}
+			}
+			UIF_TRANSFER = 0;
+
+			for (i = 0; i < len; i++) {
+				b = Ep1Buffer[i];
+
+				if (headerPos < IAP_HEADER_LEN) {
+					header[headerPos++] = b;
+					if (headerPos < IAP_HEADER_LEN) {
+						continue;
+					}
+
+					length = header[4] | ((uint16_t) header[5] << 8);
+					if (header[0] != 'I' || header[1] != 'A' || header[2] != 'P' || header[3] != 'U'
+							|| length == 0 || length > IAP_ADDR) {
+						iapSendResult(false, 0);
+						headerPos = 0;
+						continue;
+					}
+
+					iapBootloaderVector();
+					addr = 0;
+					crc = 0xffff;
+					continue;
+				}
+
+				if (addr >= length) {
+					// More data than announced
+					continue;
+				}
+
+				crc = iapCrc(crc, b);
+
+				if (addr < IAP_RESET_VECTOR_LEN) {
+					// Written last
+					resetVector[addr] = b;
+				} else if (addr & 1) {
+					iapWriteWord(addr - 1, low | ((uint16_t) b << 8));
+				} else {
+					low = b;
+				}
+
+				addr++;
+				if (addr == length) {
+					done = true;
+				}
+			}
+
+			if (!done) {
+				break;
+			}
+			done = false;
+
+			// Odd length
+			if ((length & 1) && length > IAP_RESET_VECTOR_LEN) {
+				iapWriteWord(length - 1, low | 0xff00);
+			}
+			for (i = length < IAP_RESET_VECTOR_LEN ? length : IAP_RESET_VECTOR_LEN; i < IAP_RESET_VECTOR_LEN; i++) {
+				resetVector[i] = 0xff;
+			}
+			iapWriteWord(2, resetVector[2] | ((uint16_t) resetVector[3] << 8));
+			iapWriteWord(0, resetVector[0] | ((uint16_t) resetVector[1] << 8));
+
+			// Verify the programmed flash, up to 12 KB, the watchdog is kicked per byte
+			crc = 0xffff;
+			for (addr = 0; addr < length; addr++) {
+				WATCHDOG_KICK();
+				crc = iapCrc(crc, iapReadByte(addr));
+			}
+
+			if (crc == (header[6] | ((uint16_t) header[7] << 8))) {
+				iapSendResult(true, crc);
+				iapReset();
+			}
+
+			iapBootloaderVector();
+			iapSendResult(false, crc);
+			headerPos = 0;
+			break;
+
+		case UIS_TOKEN_IN | 2:
+			UEP2_T_LEN = 0;
+			UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
+			UIF_TRANSFER = 0;
+			break;
+
+		case UIS_TOKEN_SETUP | 0:
+			// Requests without data stage (SET_CONTROL_LINE_STATE) are acknowledged, all others stalled
+			if (USB_RX_LEN == 8 && !(Ep0Buffer[0] & USB_REQ_TYP_IN) && Ep0Buffer[6] == 0 && Ep0Buffer[7] == 0) {
+				UEP0_T_LEN = 0;
+				UEP0_CTRL = bUEP_R_TOG | bUEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK;
+			} else {
+				UEP0_CTRL = bUEP_R_TOG | bUEP_T_TOG | UEP_R_RES_STALL | UEP_T_RES_STALL;
+			}
+			UIF_TRANSFER = 0;
+			break;
+
+		default:
+			// EP0 status stage, EP1
+			UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+			UEP1_CTRL = (UEP1_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
+			UIF_TRANSFER = 0;
+			break;
+		}
+	}
+}
+
+/**
+ * Program a word of the code flash, the CH554 has no separate erase command
+ *
+ * @param addr Even address
+ * @param value Little endian
+ */
+static void iapWriteWord(uint16_t addr, uint16_t value) {
+	ROM_ADDR = addr;
+	ROM_DATA = value;
+	if (ROM_STATUS & bROM_ADDR_OK) {
+		ROM_CTRL = ROM_CMD_WRITE;
+	}
+}
+
+/**
+ * Read a byte of the code flash
+ */
+static uint8_t iapReadByte(uint16_t addr) {
+	return CODE_FLASH_READ(addr);
+}
+
+/**
+ * CRC-16/CCITT-FALSE, bitwise, lib/crc.c is in the overwritten area
+ */
+static uint16_t iapCrc(uint16_t crc, uint8_t value) {
+	uint8_t i;
+
+	crc ^= (uint16_t) value << 8;
+	for (i = 0; i < 8; i++) {
+		if (crc & 0x8000) {
+			crc = (crc << 1) ^ 0x1021;
+		} else {
+			crc <<= 1;
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * Reset vector: LJMP to the ROM bootloader
+ */
+static void iapBootloaderVector() {
+	iapWriteWord(0, 0x02 | ((BOOT_LOAD_ADDR >> 8) << 8));
+	iapWriteWord(2, BOOT_LOAD_ADDR & 0xff);
+}
+
+/**
+ * Send the result line, and wait until the host read it
+ *
+ * @param ok Image valid
+ * @param crc CRC of the programmed flash
+ */
+static void iapSendResult(bool ok, uint16_t crc) {
+	__xdata uint8_t* buffer = Ep2Buffer + MAX_PACKET_SIZE;
+	uint8_t pos = 2;
+	uint8_t i;
+	uint8_t nibble;
+
+	buffer[0] = 'U';
+	buffer[1] = ' ';
+	if (ok) {
+		buffer[pos++] = 'O';
+		buffer[pos++] = 'K';
+	} else {
+		buffer[pos++] = 'E';
+		buffer[pos++] = 'R';
+		buffer[pos++] = 'R';
+	}
+	buffer[pos++] = ' ';
+
+	for (i = 0; i < 4; i++) {
+		nibble = (crc >> 12) & 0x0f;
+		buffer[pos++] = nibble < 10 ? '0' + nibble : 'A' - 10 + nibble;
+		crc <<= 4;
+	}
+	buffer[pos++] = '\n';
+
+	// The previous packet was read, the answer is the only IN packet
+	UEP2_T_LEN = pos;
+	UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_ACK;
+
+	while (1) {
+		WATCHDOG_KICK();
+
+		if (UIF_BUS_RST) {
+			return;
+		}
+
+		if (UIF_TRANSFER) {
+			if ((USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP)) == (UIS_TOKEN_IN | 2)) {
+				UEP2_T_LEN = 0;
+				UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
+				UIF_TRANSFER = 0;
+				return;
+			}
+
+			if ((USB_INT_ST & MASK_UIS_TOKEN) == UIS_TOKEN_OUT) {
+				// Handled by the main loop, after the answer was sent
+				return;
+			}
+
+			UIF_TRANSFER = 0;
+		}
+	}
+}
+
+/**
+ * Software reset, starts the new application
+ */
+static void iapReset() {
+	SAFE_MOD = 0x55;
+	SAFE_MOD = 0xAA;
+	GLOBAL_CFG |= bSW_RESET;
+
+	while (1);
+}
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * In-application firmware update: the new image is streamed over the CDC
+ * bulk endpoint into the code flash, see test-tools/iap-update.py
+ *
+ * The loader is linked to IAP_ADDR (segment IAP, see build/Makefile), outside of
+ * the application area it overwrites. It uses no library functions and no fixed
+ * RAM variables, so a new application can still call it at the same address.
+ * The loader itself is only updated by the ROM bootloader.
+ *
+ * Protocol, after the command "U" of logic.c was answered with "U\n":
+ *   Header, 8 bytes: "IAPU", uint16_t image length, uint16_t CRC-16/CCITT-FALSE of the image
+ *   Image, from address 0, any packet size
+ *   Answer: "U OK <crc>\n", the device resets into the new application,
+ *   or "U ERR <crc>\n", the reset vector points to the ROM bootloader, the next header is expected
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+// Enabled in the Makefile
+#ifndef IAP_ENABLE
+#define IAP_ENABLE 1
+#endif
+
+/**
+ * Code flash address of the loader, the image can use the flash below, set in the Makefile
+ */
+#ifndef IAP_ADDR
+#define IAP_ADDR 0x3000
+#endif
+
+/**
+ * Header length
+ */
+#define IAP_HEADER_LEN 8
+
+/**
+ * Until the image is complete, the reset vector jumps to the ROM bootloader,
+ * so an interrupted update can be repeated with chflasher
+ */
+#define IAP_RESET_VECTOR_LEN 4
+
+/**
+ * Read a byte of the code flash, the host simulation provides its own
+ */
+#ifndef CODE_FLASH_READ
+#define CODE_FLASH_READ(addr) (*((__code uint8_t*) (addr)))
+#endif
+
+#if IAP_ENABLE
+
+/**
+ * Receive and program the image, never returns. Interrupts are disabled,
+ * the USB is polled, the device stays configured.
+ */
+void iapRun();
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Tokenized logging, the device sends only the log ID and the arguments
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "log.h"
+#include "frame.h"
+
+// No code if logging is disabled
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+/**
+ * Encoded length of an unsigned varint
+ *
+ * @param value Value
+ * @return 1 ... 5 bytes
+ */
+uint8_t logVarintLength(uint32_t value) {
+	uint8_t length = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		length++;
+	}
+
+	return length;
+}
+
+/**
+ * Add an unsigned varint to the frame, 7 bit per byte, low bits first,
+ * bit 7 is set if more bytes follow
+ *
+ * @param value Value
+ */
+void logVarint(uint32_t value) {
+	while (value >= 0x80) {
+		Frame_put((uint8_t) value | 0x80);
+		value >>= 7;
+	}
+
+	Frame_put(value);
+}
+
+/**
+ * Send a log frame, use the LOG_* macros
+ *
+ * @param id LOG_ID
+ * @param count Argument count, 0 ... 3
+ * @param a First argument
+ * @param b Second argument
+ * @param c Third argument
+ */
+void logWrite(uint16_t id, uint8_t count, uint32_t a, uint32_t b, uint32_t c) {
+	uint8_t length = 2;
+
+	if (count > 0) {
+		length += logVarintLength(a);
+	}
+	if (count > 1) {
+		length += logVarintLength(b);
+	}
+	if (count > 2) {
+		length += logVarintLength(c);
+	}
+
+	// Dropped if not connected
+	if (!Frame_begin(FRAME_TYPE_LOG, length)) {
+		return;
+	}
+
+	Frame_putU16(id);
+
+	if (count > 0) {
+		logVarint(a);
+	}
+	if (count > 1) {
+		logVarint(b);
+	}
+	if (count > 2) {
+		logVarint(c);
+	}
+
+	Frame_end();
+
+	// Sent immediately, so it's not overwritten by other output
+	Frame_flush();
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * Tokenized logging: the format strings stay on the host, the device sends only
+ * the log ID and the arguments, as frame (frame.h) of type FRAME_TYPE_LOG:
+ *   uint16_t ID, each argument as unsigned varint (7 bit per byte, low bits first)
+ *
+ * The ID is (LOG_MODULE << 12) | __LINE__, so each file which logs defines an own
+ * LOG_MODULE (1 ... 15) before including log.h, and there is max one log call per line.
+ * test-tools/log-dictionary.py extracts the format strings from the sources at build time,
+ * test-tools/log-view.py prints the received logs.
+ *
+ * Module IDs:
+ *   1  logic.c
+ *   2  lib/config.c
+ *
+ * Usage, up to 3 integer arguments, printf format (%u %d %x %c):
+ *   LOG_WARN("Unknown command %c", c);
+ *
+ * Calls above LOG_LEVEL are removed by the preprocessor. Not to be used in interrupts.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Selected in the Makefile
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_NONE
+#endif
+
+#ifndef LOG_MODULE
+#define LOG_MODULE 0
+#endif
+
+/**
+ * ID of the log call, the line number needs to fit into 12 bit
+ */
+#define LOG_ID ((uint16_t) ((LOG_MODULE << 12) | __LINE__))
+
+// Select the implementation by the argument count, the format string is not used on the device
+#define LOG_SELECT(format, a1, a2, a3, name, ...) name
+#define LOG_WRITE(...) LOG_SELECT(__VA_ARGS__, LOG_WRITE3, LOG_WRITE2, LOG_WRITE1, LOG_WRITE0, 0)(__VA_ARGS__)
+#define LOG_WRITE0(format) logWrite(LOG_ID, 0, 0, 0, 0)
+#define LOG_WRITE1(format, a) logWrite(LOG_ID, 1, (a), 0, 0)
+#define LOG_WRITE2(format, a, b) logWrite(LOG_ID, 2, (a), (b), 0)
+#define LOG_WRITE3(format, a, b, c) logWrite(LOG_ID, 3, (a), (b), (c))
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define LOG_ERROR(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define LOG_WARN(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define LOG_INFO(...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_WRITE(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...)
+#endif
+
+/**
+ * Send a log frame, use the LOG_* macros
+ *
+ * @param id LOG_ID
+ * @param count Argument count, 0 ... 3
+ * @param a First argument
+ * @param b Second argument
+ * @param c Third argument
+ */
+void logWrite(uint16_t id, uint8_t count, uint32_t a, uint32_t b, uint32_t c);
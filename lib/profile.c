@@ -0,0 +1,129 @@
+/**
+ * Cycle counting profiler, Timer 2 is used as free running counter with Fsys.
+ * The counters are read by the host with a vendor request, see usb-cdc.c
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "profile.h"
+#include "sof.h"
+
+#if PROFILE_ENABLE
+
+/**
+ * Profiling counters
+ */
+__xdata ProfileCounters g_Profile;
+
+/**
+ * Reset requested by the host, executed in the main loop
+ */
+volatile bool g_ProfileResetPending = false;
+
+/**
+ * Timer value of the last main loop call, or of the last step of the current iteration
+ */
+uint16_t g_ProfileLoopLast;
+
+/**
+ * Duration of the current main loop iteration, summed up by profileWaitStep()
+ */
+uint32_t g_ProfileLoopSteps;
+
+/**
+ * Timer value of the last busy waiting step
+ */
+uint16_t g_ProfileWaitLast;
+
+/**
+ * Setup Timer 2 as free running counter
+ */
+void profileSetup() {
+	// Timer mode, auto reload with 0 => counts 0 .. 0xffff
+	T2CON = 0;
+	RCAP2L = 0;
+	RCAP2H = 0;
+	TL2 = 0;
+	TH2 = 0;
+
+	// Count with Fsys
+	T2MOD |= bTMR_CLK | bT2_CLK;
+
+	// No interrupt needed
+	ET2 = 0;
+	TR2 = 1;
+
+	profileReset();
+}
+
+/**
+ * Called once per main loop iteration, resets the counters if requested
+ */
+void profileLoop() {
+	uint16_t now;
+	uint32_t duration;
+
+	if (g_ProfileResetPending) {
+		g_ProfileResetPending = false;
+		profileReset();
+		return;
+	}
+
+	PROFILE_NOW(now);
+	duration = g_ProfileLoopSteps + (uint16_t) (now - g_ProfileLoopLast);
+	g_ProfileLoopLast = now;
+	g_ProfileLoopSteps = 0;
+
+	g_Profile.loopCount++;
+	g_Profile.loopTotal += duration;
+	if (duration > g_Profile.loopMax) {
+		g_Profile.loopMax = duration;
+	}
+}
+
+/**
+ * Start busy waiting
+ */
+void profileWaitBegin() {
+	PROFILE_NOW(g_ProfileWaitLast);
+	g_Profile.putsWaitCount++;
+}
+
+/**
+ * Called in the busy waiting loop, the time is summed up
+ * in small steps, so also waits longer than the timer period are correct.
+ * The main loop iteration waits too, its duration is summed up the same way
+ */
+void profileWaitStep() {
+	uint16_t now;
+
+	PROFILE_NOW(now);
+	g_Profile.putsWaitTotal += (uint16_t) (now - g_ProfileWaitLast);
+	g_ProfileWaitLast = now;
+
+	g_ProfileLoopSteps += (uint16_t) (now - g_ProfileLoopLast);
+	g_ProfileLoopLast = now;
+}
+
+/**
+ * Reset all counters
+ */
+void profileReset() {
+	uint8_t i;
+	__xdata uint8_t* data = (__xdata uint8_t*) &g_Profile;
+
+	for (i = 0; i < sizeof(ProfileCounters); i++) {
+		data[i] = 0;
+	}
+
+#if SOF_ENABLE
+	// The drift is still valid, only updated once per window
+	g_Profile.sofDriftPpm = g_Sof.driftPpm;
+#endif
+
+	PROFILE_NOW(g_ProfileLoopLast);
+	g_ProfileLoopSteps = 0;
+}
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * Cycle counting profiler, Timer 2 is used as free running counter with Fsys.
+ * The counters are read by the host with a vendor request, see usb-cdc.c
+ *
+ * Durations are measured with 16 bit, at 24 MHz a single measurement
+ * must be shorter than 2.7ms. Waits which can be longer (UsbCdc_puts)
+ * are summed up in steps, also for the main loop duration.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+// Enabled in the Makefile
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE 0
+#endif
+
+// Count NAKed OUT packets, this enables the USB NAK interrupt,
+// which is triggered for each NAK (also IN), and therefore adds a lot of load
+#ifndef PROFILE_NAK
+#define PROFILE_NAK 0
+#endif
+
+#if !PROFILE_ENABLE
+#undef PROFILE_NAK
+#define PROFILE_NAK 0
+#endif
+
+/**
+ * Profiling counters, all durations in Fsys cycles
+ */
+typedef struct {
+	/**
+	 * Count of USB interrupts
+	 */
+	uint32_t usbIsrCount;
+
+	/**
+	 * Sum of the USB interrupt durations, average = usbIsrTotal / usbIsrCount
+	 */
+	uint32_t usbIsrTotal;
+
+	/**
+	 * Longest USB interrupt
+	 */
+	uint16_t usbIsrMax;
+
+	/**
+	 * Count of main loop iterations
+	 */
+	uint32_t loopCount;
+
+	/**
+	 * Sum of the main loop durations
+	 */
+	uint32_t loopTotal;
+
+	/**
+	 * Longest main loop iteration, 32 bit, an iteration may wait for the host
+	 */
+	uint32_t loopMax;
+
+	/**
+	 * Count of UsbCdc_puts calls, which needed to wait for the endpoint
+	 */
+	uint32_t putsWaitCount;
+
+	/**
+	 * Time busy waiting in UsbCdc_puts
+	 */
+	uint32_t putsWaitTotal;
+
+	/**
+	 * NAKed OUT packets on EP2, only counted with PROFILE_NAK
+	 */
+	uint32_t outNakCount;
+
+	/**
+	 * Drift of the tick counter against the USB frames in ppm, filtered,
+	 * and the measured / rejected windows, only with SOF_ENABLE, see sof.h
+	 */
+	int16_t sofDriftPpm;
+	uint16_t sofWindows;
+	uint16_t sofRejected;
+} ProfileCounters;
+
+#if PROFILE_ENABLE
+
+/**
+ * Profiling counters
+ */
+extern __xdata ProfileCounters g_Profile;
+
+/**
+ * Reset requested by the host, executed in the main loop
+ */
+extern volatile bool g_ProfileResetPending;
+
+/**
+ * Read the Timer 2 counter, the high byte is read twice,
+ * to detect an overflow of the low byte between the reads
+ */
+#define PROFILE_NOW(t) { \
+	uint8_t profileHigh; \
+	do { \
+		profileHigh = TH2; \
+		t = TL2; \
+	} while (profileHigh != TH2); \
+	t |= (uint16_t) profileHigh << 8; \
+}
+
+/**
+ * Start of the USB interrupt, needs to be the first statement
+ */
+#define PROFILE_ISR_BEGIN() \
+	uint16_t profileIsrStart; \
+	PROFILE_NOW(profileIsrStart)
+
+/**
+ * End of the USB interrupt, inlined, so no function call is needed in the interrupt
+ */
+#define PROFILE_ISR_END() { \
+	uint16_t profileIsrTime; \
+	PROFILE_NOW(profileIsrTime); \
+	profileIsrTime -= profileIsrStart; \
+	g_Profile.usbIsrCount++; \
+	g_Profile.usbIsrTotal += profileIsrTime; \
+	if (profileIsrTime > g_Profile.usbIsrMax) { \
+		g_Profile.usbIsrMax = profileIsrTime; \
+	} \
+}
+
+/**
+ * Count a NAKed OUT packet
+ */
+#define PROFILE_OUT_NAK() g_Profile.outNakCount++
+
+/**
+ * A SOF window was measured
+ */
+#define PROFILE_SOF_WINDOW(ppm) { \
+	g_Profile.sofDriftPpm = ppm; \
+	g_Profile.sofWindows++; \
+}
+
+/**
+ * A SOF window was rejected
+ */
+#define PROFILE_SOF_REJECTED() g_Profile.sofRejected++
+
+/**
+ * Setup Timer 2 as free running counter
+ */
+void profileSetup();
+
+/**
+ * Called once per main loop iteration, resets the counters if requested
+ */
+void profileLoop();
+
+/**
+ * Start busy waiting
+ */
+void profileWaitBegin();
+
+/**
+ * Called in the busy waiting loop, also sums up the main loop duration
+ */
+void profileWaitStep();
+
+/**
+ * Reset all counters
+ */
+void profileReset();
+
+#else
+
+#define PROFILE_ISR_BEGIN()
+#define PROFILE_ISR_END()
+#define PROFILE_OUT_NAK()
+#define PROFILE_SOF_WINDOW(ppm)
+#define PROFILE_SOF_REJECTED()
+#define profileSetup()
+#define profileLoop()
+#define profileWaitBegin()
+#define profileWaitStep()
+#define profileReset()
+
+#endif
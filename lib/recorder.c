@@ -0,0 +1,129 @@
+/**
+ * Flight recorder: ring of the last events with timestamp
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "recorder.h"
+#include "dataflash.h"
+
+#if RECORDER_ENABLE
+
+/**
+ * Marks a valid snapshot in the data flash
+ */
+#define RECORDER_SNAPSHOT_MAGIC 0xA5
+
+/**
+ * Event ring, not initialized by the startup code
+ */
+__xdata __at (RECORDER_XRAM_ADDR) Recorder g_Recorder;
+
+/**
+ * Store the last RECORDER_SNAPSHOT_EVENTS events in the data flash
+ */
+void recorderSnapshot() {
+#if RECORDER_SNAPSHOT
+	uint8_t header[2];
+	uint8_t pos = (g_Recorder.pos - RECORDER_SNAPSHOT_EVENTS) & (RECORDER_EVENTS - 1);
+	uint8_t i;
+
+	// Invalid while writing
+	header[0] = 0;
+	WriteDataFlash(RECORDER_FLASH_ADDR, header, 1);
+
+	// Oldest first
+	for (i = 0; i < RECORDER_SNAPSHOT_EVENTS; i++) {
+		WriteDataFlash(RECORDER_FLASH_ADDR + 2 + i * sizeof(RecorderEvent),
+				(uint8_t*) &g_Recorder.events[pos], sizeof(RecorderEvent));
+		pos = (pos + 1) & (RECORDER_EVENTS - 1);
+	}
+
+	header[0] = RECORDER_SNAPSHOT_MAGIC;
+	header[1] = RECORDER_SNAPSHOT_EVENTS;
+	WriteDataFlash(RECORDER_FLASH_ADDR, header, 2);
+#endif
+}
+
+/**
+ * Restore the snapshot from the data flash into the empty ring, and invalidate it,
+ * so it is restored only once
+ *
+ * @return Restored event count
+ */
+uint8_t recorderRestore() {
+#if RECORDER_SNAPSHOT
+	uint8_t header[2];
+	uint8_t i;
+
+	ReadDataFlash(RECORDER_FLASH_ADDR, 2, header);
+	if (header[0] != RECORDER_SNAPSHOT_MAGIC || header[1] > RECORDER_SNAPSHOT_EVENTS) {
+		return 0;
+	}
+
+	for (i = 0; i < header[1]; i++) {
+		ReadDataFlash(RECORDER_FLASH_ADDR + 2 + i * sizeof(RecorderEvent), sizeof(RecorderEvent),
+				(uint8_t*) &g_Recorder.events[i]);
+	}
+	g_Recorder.pos = header[1];
+
+	header[0] = 0;
+	WriteDataFlash(RECORDER_FLASH_ADDR, header, 1);
+
+	return header[1];
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Check the ring after reset, restore the snapshot, and add the boot event
+ */
+void recorderInit() {
+	uint8_t resetFlags = PCON & MASK_RST_FLAG;
+	uint8_t restored;
+
+	g_Recorder.frozen = false;
+
+	if (resetFlags == RST_FLAG_POR || g_Recorder.magic != RECORDER_MAGIC
+			|| g_Recorder.pos >= RECORDER_EVENTS) {
+		// XRAM content lost
+		memset(&g_Recorder, 0, sizeof(Recorder));
+		g_Recorder.magic = RECORDER_MAGIC;
+
+		restored = recorderRestore();
+		if (restored) {
+			RECORDER_ADD(RECORDER_EVENT_RESTORED, restored);
+		}
+	}
+
+	RECORDER_ADD(RECORDER_EVENT_BOOT, resetFlags);
+}
+
+/**
+ * Store the snapshot after a watchdog reset, called after the USB init,
+ * the data flash writes are not needed for the enumeration
+ */
+void recorderInitDeferred() {
+	if ((PCON & MASK_RST_FLAG) == RST_FLAG_WDOG) {
+		// Keep the events before the watchdog reset, also if the power is lost later
+		recorderSnapshot();
+	}
+}
+
+/**
+ * Add an event, outside of the interrupt, use RECORDER_ADD()
+ *
+ * @param type RECORDER_EVENT_*
+ * @param data Event specific
+ */
+void recorderAdd(uint8_t type, uint8_t data) {
+	bool interrupts = EA;
+
+	EA = 0;
+	RECORDER_ISR(type, data);
+	EA = interrupts;
+}
+
+#endif
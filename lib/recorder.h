@@ -0,0 +1,172 @@
+/**
+ * Flight recorder: ring of the last events with timestamp, in an XRAM
+ * region which is not cleared on startup, so it survives a watchdog reset.
+ * Read by the host with a vendor request, see test-tools/read-recorder.py
+ *
+ * On a watchdog reset, and before jumping to the bootloader, the last events are
+ * stored in the data flash, and restored into the ring on the next power on.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+#include "timer.h"
+#include "../usb-descriptor/usb-layout.h"
+
+// Enabled in the Makefile
+#ifndef RECORDER_ENABLE
+#define RECORDER_ENABLE 1
+#endif
+
+// Store a snapshot in the data flash
+#ifndef RECORDER_SNAPSHOT
+#define RECORDER_SNAPSHOT 1
+#endif
+
+/**
+ * XRAM address, after the USB buffers, outside of the range of the compiler
+ * (XRAM_LOC of usb-descriptor/usb-layout.mk), so the startup code does not clear it
+ */
+#define RECORDER_XRAM_ADDR USB_XRAM_END
+
+/**
+ * Event count, power of 2
+ */
+#define RECORDER_EVENTS 32
+
+/**
+ * Marks the ring as valid, if the XRAM content survived a reset
+ */
+#define RECORDER_MAGIC 0x5245
+
+/**
+ * Data flash address of the snapshot, after the configuration
+ */
+#define RECORDER_FLASH_ADDR 32
+
+/**
+ * Events in the data flash snapshot: header (2 bytes) and events fit into the 128 bytes data flash
+ */
+#define RECORDER_SNAPSHOT_EVENTS 15
+
+/**
+ * Waits for the upload endpoint from this duration on are recorded
+ */
+#define RECORDER_TX_STALL_MS 10
+
+// Event types, data byte in brackets, see test-tools/read-recorder.py
+#define RECORDER_EVENT_BOOT 1          // Reset flags, PCON & MASK_RST_FLAG
+#define RECORDER_EVENT_BUS_RESET 2
+#define RECORDER_EVENT_SUSPEND 3
+#define RECORDER_EVENT_SETUP 4         // bRequest
+#define RECORDER_EVENT_STALL 5         // bRequest
+#define RECORDER_EVENT_TOGGLE_ERROR 6  // Endpoint
+#define RECORDER_EVENT_CONFIGURED 7    // Configuration value
+#define RECORDER_EVENT_TX_STALL 8      // Wait for the upload endpoint, ms, max. 255
+#define RECORDER_EVENT_BOOTLOADER 9
+#define RECORDER_EVENT_RESTORED 10     // Events restored from the data flash
+#define RECORDER_EVENT_RECOVERED 11    // Resumed after a watchdog reset, ms since boot, max. 255
+
+/**
+ * Recorder event
+ */
+typedef struct {
+	/**
+	 * RECORDER_EVENT_*
+	 */
+	uint8_t type;
+
+	/**
+	 * Event specific
+	 */
+	uint8_t data;
+
+	/**
+	 * Ticks of timer.h
+	 */
+	uint32_t ticks;
+} RecorderEvent;
+
+/**
+ * Event ring, the layout is read by test-tools/read-recorder.py
+ */
+typedef struct {
+	/**
+	 * RECORDER_MAGIC
+	 */
+	uint16_t magic;
+
+	/**
+	 * Next event to write, the oldest event
+	 */
+	uint8_t pos;
+
+	/**
+	 * Recording is stopped while the host reads the ring
+	 */
+	uint8_t frozen;
+
+	/**
+	 * Events
+	 */
+	RecorderEvent events[RECORDER_EVENTS];
+} Recorder;
+
+#if RECORDER_ENABLE
+
+extern __xdata __at (RECORDER_XRAM_ADDR) Recorder g_Recorder;
+
+/**
+ * Add an event, in the USB interrupt, without function call
+ */
+#define RECORDER_ISR(eventType, eventData) { \
+	if (!g_Recorder.frozen) { \
+		__xdata RecorderEvent* recorderEvent = &g_Recorder.events[g_Recorder.pos]; \
+		g_Recorder.pos = (g_Recorder.pos + 1) & (RECORDER_EVENTS - 1); \
+		recorderEvent->type = (eventType); \
+		recorderEvent->data = (eventData); \
+		TIMER_GET_TICKS(recorderEvent->ticks); \
+	} \
+}
+
+/**
+ * Add an event, outside of the interrupt
+ */
+#define RECORDER_ADD(eventType, eventData) recorderAdd(eventType, eventData)
+
+/**
+ * Check the ring after reset, restore the snapshot, and add the boot event
+ */
+void recorderInit();
+
+/**
+ * Store the snapshot after a watchdog reset, called after the USB init,
+ * the data flash writes are not needed for the enumeration
+ */
+void recorderInitDeferred();
+
+/**
+ * Add an event, outside of the interrupt, use RECORDER_ADD()
+ *
+ * @param type RECORDER_EVENT_*
+ * @param data Event specific
+ */
+void recorderAdd(uint8_t type, uint8_t data);
+
+/**
+ * Store the last RECORDER_SNAPSHOT_EVENTS events in the data flash
+ */
+void recorderSnapshot();
+
+#else
+
+#define RECORDER_ISR(eventType, eventData)
+#define RECORDER_ADD(eventType, eventData)
+#define recorderInit()
+#define recorderInitDeferred()
+#define recorderSnapshot()
+
+#endif
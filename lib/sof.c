@@ -0,0 +1,177 @@
+/**
+ * USB start of frame timebase, and the pacer trimmed to it
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "sof.h"
+#include "profile.h"
+
+#if SOF_ENABLE
+
+/**
+ * Measured timebase
+ */
+__xdata SofState g_Sof;
+
+/**
+ * Frames left in the current window, tick counter at the window start
+ */
+uint16_t g_SofWindowCount;
+uint32_t g_SofWindowStart;
+
+/**
+ * Ticks of the last window, processed in the main loop
+ */
+volatile uint32_t g_SofWindowTicks;
+volatile bool g_SofWindowReady = false;
+
+/**
+ * The window start is valid
+ */
+bool g_SofWindowStarted = false;
+
+/**
+ * Filtered ticks per window * 16, 0 until the first window
+ */
+uint32_t g_SofFiltered = 0;
+
+/**
+ * Windows rejected in a row
+ */
+uint8_t g_SofRejectedInRow = 0;
+
+/**
+ * Initialize the state, before the USB interrupt is enabled
+ */
+void sofSetup() {
+	g_Sof.frames = 0;
+	g_Sof.ticksPerSecond = TIMER_TICKS_PER_SECOND;
+	g_Sof.driftPpm = 0;
+	g_Sof.windows = 0;
+	g_Sof.rejected = 0;
+
+	g_SofWindowCount = SOF_WINDOW_FRAMES;
+
+	// SOF are reported as transfer interrupt with the SOF token
+	USB_INT_EN |= bUIE_DEV_SOF;
+}
+
+/**
+ * Difference to the nominal window in ppm
+ *
+ * @param ticks16 Ticks per window * 16, within SOF_MAX_DRIFT_PPM
+ * @return ppm
+ */
+int16_t sofDriftPpm(uint32_t ticks16) {
+	return (int32_t) (ticks16 - SOF_WINDOW_TICKS * 16) * 1000 / (int32_t) (SOF_WINDOW_TICKS * 16 / 1000);
+}
+
+/**
+ * Called from the main loop, processes a measured window
+ */
+void sofLoop() {
+	uint32_t ticks;
+	int16_t deviation;
+
+	if (!g_SofWindowReady) {
+		return;
+	}
+
+	// The next window is ready in 1 s, no need to lock the interrupt
+	ticks = g_SofWindowTicks;
+	g_SofWindowReady = false;
+
+	if (ticks > SOF_WINDOW_TICKS + SOF_MAX_DRIFT_TICKS || ticks < SOF_WINDOW_TICKS - SOF_MAX_DRIFT_TICKS) {
+		g_Sof.rejected++;
+		PROFILE_SOF_REJECTED();
+		return;
+	}
+	ticks <<= 4;
+
+	if (g_SofFiltered) {
+		deviation = sofDriftPpm(ticks) - g_Sof.driftPpm;
+		if ((deviation > SOF_OUTLIER_PPM || deviation < -SOF_OUTLIER_PPM) && ++g_SofRejectedInRow < SOF_RELOCK_WINDOWS) {
+			g_Sof.rejected++;
+			PROFILE_SOF_REJECTED();
+			return;
+		}
+
+		if (g_SofRejectedInRow >= SOF_RELOCK_WINDOWS) {
+			// Start again with this window
+			g_SofFiltered = ticks;
+		} else {
+			// Low pass, 1/8 per window
+			g_SofFiltered += ((int32_t) (ticks - g_SofFiltered)) / 8;
+		}
+	} else {
+		g_SofFiltered = ticks;
+	}
+
+	g_SofRejectedInRow = 0;
+	g_Sof.windows++;
+	g_Sof.driftPpm = sofDriftPpm(g_SofFiltered);
+	g_Sof.ticksPerSecond = (g_SofFiltered >> 4) * 1000 / SOF_WINDOW_FRAMES;
+	PROFILE_SOF_WINDOW(g_Sof.driftPpm);
+}
+
+#endif
+
+/**
+ * Calculate the period for the current tick rate
+ *
+ * @param pacer Pacer
+ */
+void sofPacerTrim(__xdata SofPacer* pacer) {
+	uint32_t ticks;
+
+	pacer->ticksPerSecond = SOF_TICKS_PER_SECOND();
+	ticks = pacer->ticksPerSecond * pacer->divider;
+	pacer->period = ticks / pacer->rate;
+	pacer->remainder = ticks % pacer->rate;
+}
+
+/**
+ * Start the pacer, the first event is due immediately
+ *
+ * @param pacer Pacer
+ * @param rate Events per second * divider
+ * @param divider E.g. samples per frame, if the rate is given in samples per second
+ */
+void sofPacerStart(__xdata SofPacer* pacer, uint16_t rate, uint16_t divider) {
+	pacer->rate = rate;
+	pacer->divider = divider;
+	pacer->fraction = 0;
+	pacer->next = timerGetTicks();
+	sofPacerTrim(pacer);
+}
+
+/**
+ * Check if the next event is due, the pacer is advanced by one event if so.
+ * Late events are due back to back, so the average rate is kept
+ *
+ * @param pacer Pacer
+ * @return true if due
+ */
+bool sofPacerDue(__xdata SofPacer* pacer) {
+	if ((int32_t) (timerGetTicks() - pacer->next) < 0) {
+		return false;
+	}
+
+	// A new window was measured, the next periods use the trimmed rate
+	if (pacer->ticksPerSecond != SOF_TICKS_PER_SECOND()) {
+		sofPacerTrim(pacer);
+	}
+
+	// Compared before adding, fraction + remainder overflows 16 bit with a rate above 32768
+	pacer->next += pacer->period;
+	if (pacer->fraction >= pacer->rate - pacer->remainder) {
+		pacer->fraction -= pacer->rate - pacer->remainder;
+		pacer->next++;
+	} else {
+		pacer->fraction += pacer->remainder;
+	}
+
+	return true;
+}
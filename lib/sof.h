@@ -0,0 +1,201 @@
+/**
+ * USB start of frame timebase: the host sends a SOF every 1 ms, derived from its
+ * crystal. The SOF interrupt counts the frames, and latches the tick counter of
+ * timer.h every SOF_WINDOW_FRAMES frames. The main loop compares the ticks of each
+ * window with the nominal value, which gives the drift of the RC oscillator.
+ *
+ * The pacer generates events (e.g. sample frames) at a fixed rate from the tick
+ * counter. Its period is trimmed to the measured tick rate, so a long capture keeps
+ * the nominal rate in host time. Without SOF_ENABLE the nominal rate is used.
+ *
+ * CH554 has no frame number register in device mode, a missed SOF makes the window
+ * one frame longer, such windows are rejected.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+#include "timer.h"
+
+// Enabled in the Makefile, adds an USB interrupt per ms
+#ifndef SOF_ENABLE
+#define SOF_ENABLE 0
+#endif
+
+/**
+ * Frames per measurement window, 1.024 s, one tick is 0.5 ppm at 2 MHz
+ */
+#define SOF_WINDOW_FRAMES 1024
+
+/**
+ * Nominal ticks per window
+ */
+#define SOF_WINDOW_TICKS ((uint32_t) TIMER_TICKS_PER_SECOND * SOF_WINDOW_FRAMES / 1000)
+
+/**
+ * Windows deviating more are rejected: oscillator tolerance,
+ * windows with a suspend or bus reset are far longer
+ */
+#define SOF_MAX_DRIFT_PPM 25000
+#define SOF_MAX_DRIFT_TICKS (SOF_WINDOW_TICKS / 1000 * SOF_MAX_DRIFT_PPM / 1000)
+
+/**
+ * After the first window, windows deviating more than this from the filtered rate are rejected,
+ * a missed SOF adds 977 ppm
+ */
+#define SOF_OUTLIER_PPM 500
+
+/**
+ * After this many rejected windows in a row the filter starts again,
+ * the oscillator really changed (temperature)
+ */
+#define SOF_RELOCK_WINDOWS 4
+
+/**
+ * Measured timebase, see profile.h for the drift in the profiling counters
+ */
+typedef struct {
+	/**
+	 * Received SOF
+	 */
+	uint32_t frames;
+
+	/**
+	 * Filtered ticks per second of host time (1000 frames),
+	 * TIMER_TICKS_PER_SECOND until the first window is measured
+	 */
+	uint32_t ticksPerSecond;
+
+	/**
+	 * Filtered drift of the tick counter, positive if it is fast
+	 */
+	int16_t driftPpm;
+
+	/**
+	 * Accepted and rejected windows
+	 */
+	uint16_t windows;
+	uint16_t rejected;
+} SofState;
+
+/**
+ * Events at a fixed rate, see sofPacerStart()
+ */
+typedef struct {
+	/**
+	 * Tick of the next event
+	 */
+	uint32_t next;
+
+	/**
+	 * Tick rate the period was calculated with
+	 */
+	uint32_t ticksPerSecond;
+
+	/**
+	 * Whole ticks per event, and the rest in 1 / rate ticks
+	 */
+	uint32_t period;
+	uint16_t remainder;
+
+	/**
+	 * Accumulated rest, the next event is one tick later on overflow
+	 */
+	uint16_t fraction;
+
+	uint16_t rate;
+	uint16_t divider;
+} SofPacer;
+
+#if SOF_ENABLE
+
+extern __xdata SofState g_Sof;
+
+/**
+ * Frames left in the current window, tick counter at the window start
+ */
+extern uint16_t g_SofWindowCount;
+extern uint32_t g_SofWindowStart;
+
+/**
+ * Ticks of the last window, valid if g_SofWindowReady is set, processed in the main loop
+ */
+extern volatile uint32_t g_SofWindowTicks;
+extern volatile bool g_SofWindowReady;
+
+/**
+ * The window start is valid, cleared on bus reset / suspend
+ */
+extern bool g_SofWindowStarted;
+
+/**
+ * Start of frame, in the USB interrupt without function call
+ */
+#define SOF_ISR() { \
+	uint32_t sofTicks; \
+	g_Sof.frames++; \
+	if (--g_SofWindowCount == 0) { \
+		g_SofWindowCount = SOF_WINDOW_FRAMES; \
+		TIMER_GET_TICKS(sofTicks); \
+		if (g_SofWindowStarted) { \
+			g_SofWindowTicks = sofTicks - g_SofWindowStart; \
+			g_SofWindowReady = true; \
+		} \
+		g_SofWindowStart = sofTicks; \
+		g_SofWindowStarted = true; \
+	} \
+}
+
+/**
+ * Bus reset / suspend, the SOF stop, the current window is dropped
+ */
+#define SOF_RESET_ISR() { \
+	g_SofWindowCount = SOF_WINDOW_FRAMES; \
+	g_SofWindowStarted = false; \
+}
+
+/**
+ * Measured tick rate, for the pacer
+ */
+#define SOF_TICKS_PER_SECOND() g_Sof.ticksPerSecond
+
+/**
+ * Initialize the state, before the USB interrupt is enabled
+ */
+void sofSetup();
+
+/**
+ * Called from the main loop, processes a measured window
+ */
+void sofLoop();
+
+#else
+
+#define SOF_ISR()
+#define SOF_RESET_ISR()
+#define SOF_TICKS_PER_SECOND() ((uint32_t) TIMER_TICKS_PER_SECOND)
+#define sofSetup()
+#define sofLoop()
+
+#endif
+
+/**
+ * Start the pacer, the first event is due immediately
+ *
+ * @param pacer Pacer
+ * @param rate Events per second * divider
+ * @param divider E.g. samples per frame, if the rate is given in samples per second
+ */
+void sofPacerStart(__xdata SofPacer* pacer, uint16_t rate, uint16_t divider);
+
+/**
+ * Check if the next event is due, the pacer is advanced by one event if so.
+ * Late events are due back to back, so the average rate is kept
+ *
+ * @param pacer Pacer
+ * @return true if due
+ */
+bool sofPacerDue(__xdata SofPacer* pacer);
@@ -12,14 +12,21 @@
  */
 volatile uint32_t g_Timer = 0;
 
+#if CLOCK_SYNC_ENABLE
+/**
+ * Answer of the clock sync request
+ */
+__xdata ClockSync g_ClockSync;
+#endif
+
 /**
  * Setup Timer
  */
 void timerSetup() {
-	// set timer 0 mode 1
+	// set timer 0 mode 1, the ticks start with 0, used as boot time reference
 	TMOD = 0x01;
-	TH0 = 0xFF;
-	TL0 = 0xFF;
+	TH0 = 0x00;
+	TL0 = 0x00;
 
 	// start timer 0
 	TR0 = 1;
@@ -28,6 +35,17 @@ void timerSetup() {
 	ET0 = 1;
 }
 
+/**
+ * Current tick counter, TIMER_TICKS_PER_SECOND
+ *
+ * @return Ticks
+ */
+uint32_t timerGetTicks() {
+	uint32_t ticks;
+	TIMER_GET_TICKS(ticks);
+	return ticks;
+}
+
 /**
  * Called from timer interrupt
  */
@@ -9,16 +9,72 @@
 
 #include "inc.h"
 
+// Enabled in the Makefile
+#ifndef CLOCK_SYNC_ENABLE
+#define CLOCK_SYNC_ENABLE 1
+#endif
+
 /**
  * Internal timer
  */
 extern volatile uint32_t g_Timer;
 
+/**
+ * Ticks of Timer 0 per second, Fsys / 12
+ */
+#define TIMER_TICKS_PER_SECOND (FREQ_SYS / 12)
+
+/**
+ * Read the 32 bit tick counter: the lower 16 bit of g_Timer and Timer 0.
+ * A macro, so it can be used in the USB interrupt without function call.
+ * If Timer 0 overflowed, but its interrupt did not run yet, the overflow is added.
+ *
+ * @param t uint32_t variable to write the ticks to
+ */
+#define TIMER_GET_TICKS(t) { \
+	uint8_t timerHigh; \
+	do { \
+		timerHigh = TH0; \
+		t = ((uint32_t) (uint16_t) g_Timer << 16) | TL0; \
+	} while (timerHigh != TH0); \
+	t |= (uint16_t) timerHigh << 8; \
+	if (TF0 && timerHigh < 0x80) { \
+		t += 0x10000; \
+	} \
+}
+
+#if CLOCK_SYNC_ENABLE
+/**
+ * Answer of the clock sync request, the host estimates offset and drift
+ * of the tick counter from many requests, see host/clock-sync.h
+ */
+typedef struct {
+	/**
+	 * Tick counter when the SETUP packet was received
+	 */
+	uint32_t ticks;
+
+	/**
+	 * Nominal TIMER_TICKS_PER_SECOND
+	 */
+	uint32_t ticksPerSecond;
+} ClockSync;
+
+extern __xdata ClockSync g_ClockSync;
+#endif
+
 /**
  * Setup Timer
  */
 void timerSetup();
 
+/**
+ * Current tick counter, TIMER_TICKS_PER_SECOND
+ *
+ * @return Ticks
+ */
+uint32_t timerGetTicks();
+
 /**
  * Called from timer interrupt
  */
@@ -10,31 +10,49 @@
 #include "inc.h"
 #include "usb-cdc.h"
 #include "hardware.h"
+#include "config.h"
+#include "profile.h"
+#include "usb-stats.h"
+#include "timer.h"
+#include "recorder.h"
+#include "watchdog.h"
+#include "boot.h"
+#include "vendor.h"
+#include "sof.h"
 #include "../logic.h"
 #include "../usb-descriptor/usb-descriptor.h"
 
+#if WATCHDOG_ENABLE && USBCDC_TRANSMIT_TIMEOUT_MS >= WATCHDOG_TIMEOUT_MS
+#error USBCDC_TRANSMIT_TIMEOUT_MS needs to be shorter than WATCHDOG_TIMEOUT_MS
+#endif
+
+// The replies of transmitXdataBlock() are sent in one packet
+#if USB_EP0_SIZE != DEFAULT_ENDP0_SIZE
+#error "endpoint0-size of usb-descriptor.json needs to be 64"
+#endif
 
 /**
  * Last setup request
  */
-uint8_t g_SetupReq;
+__data uint8_t g_SetupReq;
 
 /**
  * USB Configuration, can be read and written by the host
  */
-uint8_t g_UsbConfig;
+__data uint8_t g_UsbConfig;
 
 /**
- * Pointer to the current configuration data,
+ * Pointer to the current descriptor data in code memory,
  * this pointer is incremented on transmission,
- * if a block is sent, while g_SetupLen is decremented
+ * if a block is sent, while g_SetupLen is decremented.
+ * Not a generic pointer, so the copy loop in the interrupt stays cheap
  */
-const uint8_t* g_pDescr;
+__data const __code uint8_t* g_pDescr;
 
 /**
  * Setup length, is decremented if a block is sent, see g_pDescr
  */
-uint16_t g_SetupLen;
+__data uint16_t g_SetupLen;
 
 /**
  * Use the received data as Setup request
@@ -61,6 +79,51 @@ uint16_t g_SetupLen;
  */
 #define RESET_DEVICE_TO_BOOTLOADER 0x65
 
+/**
+ * Custom request to read the persisted device configuration
+ */
+#define GET_DEVICE_CONFIG 0x66
+
+/**
+ * Custom request to write the persisted device configuration,
+ * the new configuration is sent in the data stage
+ */
+#define SET_DEVICE_CONFIG 0x67
+
+/**
+ * Custom request to read the profiling counters,
+ * wValue = 1 resets the counters after reading
+ */
+#define GET_PROFILE_COUNTERS 0x68
+
+/**
+ * Custom request to read the USB statistics,
+ * wValue = 1 resets the statistics after reading
+ */
+#define GET_USB_STATS 0x69
+
+/**
+ * Custom request to read the flight recorder, wIndex is the byte offset,
+ * wValue = 1 stops recording, until the last block is read with wValue = 0
+ */
+#define GET_RECORDER 0x6A
+
+/**
+ * Custom request to read the watchdog state: resets and the last recovery time
+ */
+#define GET_WATCHDOG 0x6B
+
+/**
+ * Custom request to read the boot phase timestamps
+ */
+#define GET_BOOT_TIMES 0x6C
+
+/**
+ * Custom request for the clock synchronization: the tick counter, latched when
+ * the SETUP packet is processed, see host/clock-sync.h
+ */
+#define GET_CLOCK 0x6D
+
 /**
  * Baud rate, not needed for Virtual USB without hardware Serial
  * But may this is needed for another project, therefore this
@@ -68,16 +131,12 @@ uint16_t g_SetupLen;
  */
 uint32_t g_Baud = 0;
 
+#if USB_STATS_ENABLE
 /**
- * CDC parameter
- * The initial baud rate is 57600, 1 stop bit, no parity, 8 data bits.
- */
-__xdata uint8_t g_LineCoding[7] = { 0x00, 0xe1, 0x00, 0x00, 0x00, 0x00, 0x08 };
-
-/**
- * Buffer to send over USB-CDC
+ * USB statistics
  */
-__idata uint8_t g_UsbCDCTransmitBuffer[USBCDC_TRANSMIT_BUFFER_LEN];
+__xdata UsbStats g_UsbStats;
+#endif
 
 /**
  * The circular buffer write pointer, the bus reset needs to be initialized to 0
@@ -92,70 +151,38 @@ volatile __idata uint8_t g_Uart_Output_Point = 0;
 /**
  * Data received on behalf of the USB endpoint
  */
-volatile __idata uint8_t g_USBByteCount = 0;
+volatile __data uint8_t g_USBByteCount = 0;
 
 /**
  * Data pointer
  */
-volatile __idata uint8_t g_USBBufOutPoint = 0;
+volatile __data uint8_t g_USBBufOutPoint = 0;
 
 /**
  * Upload endpoint is busy flag
  */
-volatile __idata uint8_t g_UpPoint2_Busy = 0;
+volatile __data uint8_t g_UpPoint2_Busy = 0;
 
 /**
- * Handle USB Reset
+ * Echo received packets directly in the interrupt, until the port is closed
  */
-inline void usbResetInterrupt() {
-	UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
-	UEP1_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK;
-	UEP2_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
-	USB_DEV_AD = 0x00;
-	UIF_SUSPEND = 0;
-	UIF_TRANSFER = 0;
-
-	// Clear interrupt flag
-	UIF_BUS_RST = 0;
-
-	// Circular buffer input pointer
-	g_Uart_Input_Point = 0;
-
-	// Length received by the USB endpoint
-	g_USBByteCount = 0;
-
-	// Clear configuration value
-	g_UsbConfig = 0;
-	g_UpPoint2_Busy = 0;
-}
+volatile __data bool g_UsbCdcIsrEcho = false;
 
 /**
- * Handle USB Suspend
+ * The host requested the bootloader, see UsbCdc_processInput()
  */
-inline void usbWakeupSuspendInterrupt() {
-	if (USB_MIS_ST & bUMS_SUSPEND) {
-		while (XBUS_AUX & bUART0_TX) {
-			; // Waiting for transmission to complete
-		}
-
-		// Before turning of the CPU turn OFF the LEDs
-		//turnOffLeds();
+volatile bool g_UsbCdcBootloaderRequest = false;
 
-		SAFE_MOD = 0x55;
-		SAFE_MOD = 0xAA;
-
-		// USB or RXD0/1 can be woken up when there is a signal
-		WAKE_CTRL = bWAK_BY_USB | bWAK_RXD0_LO | bWAK_RXD1_LO;
-
-		// Sleep
-		PCON |= PD;
-
-		SAFE_MOD = 0x55;
-		SAFE_MOD = 0xAA;
-		WAKE_CTRL = 0x00;
-	}
-}
+/**
+ * Tick counter, when the last packet was received on EP2
+ */
+volatile uint32_t g_UsbCdcRxTicks = 0;
 
+/**
+ * The last UsbCdc_beginTransmit() returned NULL because the host did not read
+ * within USBCDC_TRANSMIT_TIMEOUT_MS, and not because the device is not configured
+ */
+bool g_UsbCdcTransmitTimeout = false;
 
 /**
  * Transmit a Setup Block, increment pointer,
@@ -164,12 +191,18 @@ inline void usbWakeupSuspendInterrupt() {
  *
  * @return Length
  */
-uint8_t transmitSetupBlock() {
+uint8_t transmitSetupBlock() __using(USB_ISR_BANK) {
+	uint8_t i;
+
 	// This transmission length
-	uint8_t len = g_SetupLen >= DEFAULT_ENDP0_SIZE ? DEFAULT_ENDP0_SIZE : g_SetupLen;
+	uint8_t len = g_SetupLen >= USB_EP0_SIZE ? USB_EP0_SIZE : g_SetupLen;
+
+	// Load upload data, increment pointer, so the data is transmitted in Blocks.
+	// No memcpy, it's not reentrant and works with generic pointers
+	for (i = 0; i < len; i++) {
+		Ep0Buffer[i] = g_pDescr[i];
+	}
 
-	// Load upload data, increment pointer, so the data is transmitted in Blocks
-	memcpy(Ep0Buffer, g_pDescr, len);
 	g_SetupLen -= len;
 	g_pDescr += len;
 
@@ -177,55 +210,49 @@ uint8_t transmitSetupBlock() {
 }
 
 /**
- * Process USB Standard setup request
+ * Transmit data from XRAM, which fits into one EP0 packet
  *
+ * @param data Data to send
+ * @param size Size of the data, max USB_EP0_SIZE
  * @return Length
  */
-inline uint8_t processUsbDescriptionRequest() {
-	uint8_t len = 0;
+uint8_t transmitXdataBlock(__xdata uint8_t* data, uint8_t size) __using(USB_ISR_BANK) {
+	uint8_t i;
 
-	switch (UsbSetupBuf->wValueH) {
-	// Device descriptor
-	case 1:
-		// Send the device descriptor to the buffer to be sent
-		len = sizeof(g_DescriptorDevice);
-		g_pDescr = g_DescriptorDevice;
-		break;
+	// Limit to the requested length
+	if (g_SetupLen < size) {
+		size = g_SetupLen;
+	}
 
-	// Configuration descriptor
-	case 2:
-		// Send the device descriptor to the buffer to be sent
-		g_pDescr = g_DescriptorConfiguration;
-		len = sizeof(g_DescriptorConfiguration);
-		break;
+	for (i = 0; i < size; i++) {
+		Ep0Buffer[i] = data[i];
+	}
 
-	case 3:
-		if (UsbSetupBuf->wValueL == 0) {
-			g_pDescr = g_DescriptorLanguage;
-			len = sizeof(g_DescriptorLanguage);
+	g_SetupLen = 0;
 
-		} else if (UsbSetupBuf->wValueL == 1) {
-			g_pDescr = g_DescriptorManufacturer;
-			len = sizeof(g_DescriptorManufacturer);
+	return size;
+}
 
-		} else if (UsbSetupBuf->wValueL == 2) {
-			g_pDescr = g_DescriptorProduct;
-			len = sizeof(g_DescriptorProduct);
-		} else {
-			g_pDescr = g_DescriptorSerial;
-			len = sizeof(g_DescriptorSerial);
-		}
-		break;
+/**
+ * Process GET_DESCRIPTOR with the generated descriptor table, see usb-descriptor/generate.py
+ *
+ * @return Length
+ */
+inline uint8_t processUsbDescriptionRequest() __using(USB_ISR_BANK) {
+	uint8_t type = UsbSetupBuf->wValueH;
+	__code const UsbDescriptor* descriptor;
 
-	default:
-		// Unsupported command or error
-		len = 0xff;
-		break;
+	if (type >= USB_DESCRIPTOR_TYPES || UsbSetupBuf->wValueL >= g_DescriptorTypeCount[type]) {
+		// Unsupported descriptor
+		return 0xff;
 	}
 
-	if (g_SetupLen > len) {
+	descriptor = &g_DescriptorTable[g_DescriptorTypeFirst[type] + UsbSetupBuf->wValueL];
+	g_pDescr = descriptor->data;
+
+	if (g_SetupLen > descriptor->length) {
 		// Limit total length
-		g_SetupLen = len;
+		g_SetupLen = descriptor->length;
 	}
 
 	return transmitSetupBlock();
@@ -236,7 +263,7 @@ inline uint8_t processUsbDescriptionRequest() {
  *
  * @return Length
  */
-inline uint8_t processStandardSetupClearRequest() {
+inline uint8_t processStandardSetupClearRequest() __using(USB_ISR_BANK) {
 	uint8_t len = 0;
 
 	// Clear device
@@ -297,7 +324,7 @@ inline uint8_t processStandardSetupClearRequest() {
  *
  * @return Length
  */
-inline uint8_t processStandardSetupSetFeatureRequest() {
+inline uint8_t processStandardSetupSetFeatureRequest() __using(USB_ISR_BANK) {
 	// defaults to operation failed
 	uint8_t len = 0xff;
 
@@ -333,6 +360,7 @@ inline uint8_t processStandardSetupSetFeatureRequest() {
 		if (UsbSetupBuf->wValueH == 0 && UsbSetupBuf->wValueL == 0x00 && UsbSetupBuf->wIndexH == 0) {
 			// result success
 			len = 0;
+			USB_STATS_INC(endpointHalt);
 
 			// UsbSetupBuf->wIndexH is not used in this case, only values <= 255 are used
 			// therefore this needs not to be checked here, it saves a few bytes!
@@ -383,7 +411,7 @@ inline uint8_t processStandardSetupSetFeatureRequest() {
  *
  * @return Length
  */
-inline uint8_t processStandardSetupRequest() {
+inline uint8_t processStandardSetupRequest() __using(USB_ISR_BANK) {
 	uint8_t len = 0;
 
 	// Request code
@@ -406,9 +434,27 @@ inline uint8_t processStandardSetupRequest() {
 
 	case USB_SET_CONFIGURATION:
 		g_UsbConfig = UsbSetupBuf->wValueL;
+		RECORDER_ISR(RECORDER_EVENT_CONFIGURED, g_UsbConfig);
+		BOOT_PHASE_ISR(BOOT_PHASE_CONFIGURED);
 		break;
 
 	case USB_GET_INTERFACE:
+		// The interfaces have no alternate settings
+		if (UsbSetupBuf->wIndexL >= USB_INTERFACES) {
+			len = 0xff;
+		} else {
+			Ep0Buffer[0] = 0x00;
+			if (g_SetupLen >= 1) {
+				len = 1;
+			}
+		}
+		break;
+
+	case USB_SET_INTERFACE:
+		// Only the alternate setting 0
+		if (UsbSetupBuf->wIndexL >= USB_INTERFACES || UsbSetupBuf->wValueL != 0) {
+			len = 0xff;
+		}
 		break;
 
 	// Clear Feature
@@ -445,24 +491,94 @@ inline uint8_t processStandardSetupRequest() {
  *
  * @return Length
  */
-inline uint8_t processNonStandardSetupRequest() {
+inline uint8_t processNonStandardSetupRequest() __using(USB_ISR_BANK) {
 	uint8_t len = 0;
+#if USB_STATS_ENABLE
+	uint8_t i;
+	__xdata uint8_t* stats;
+#endif
 
 	switch (g_SetupReq) {
 	// This request allows the host to find out the currently configured line coding.
 	case GET_LINE_CODING:
-		g_pDescr = g_LineCoding;
-		g_SetupLen = sizeof(g_LineCoding);
+		len = transmitXdataBlock(g_Config.lineCoding, sizeof(g_Config.lineCoding));
+		break;
+
+	case GET_DEVICE_CONFIG:
+		len = transmitXdataBlock((__xdata uint8_t*) &g_Config, sizeof(DeviceConfig));
+		break;
+
+	// Data is received in the data stage
+	case SET_DEVICE_CONFIG:
+		break;
 
-		len = transmitSetupBlock();
+#if USB_STATS_ENABLE
+	case GET_USB_STATS:
+		len = transmitXdataBlock((__xdata uint8_t*) &g_UsbStats, sizeof(UsbStats));
+		if (UsbSetupBuf->wValueL == 1) {
+			// Already copied into the EP0 buffer
+			stats = (__xdata uint8_t*) &g_UsbStats;
+			for (i = 0; i < sizeof(UsbStats); i++) {
+				stats[i] = 0;
+			}
+		}
+		break;
+#endif
+
+#if RECORDER_ENABLE
+	case GET_RECORDER:
+		g_Recorder.frozen = UsbSetupBuf->wValueL;
+		if (UsbSetupBuf->wIndexL < sizeof(Recorder)) {
+			len = sizeof(Recorder) - UsbSetupBuf->wIndexL;
+			if (len > USB_EP0_SIZE) {
+				len = USB_EP0_SIZE;
+			}
+			len = transmitXdataBlock((__xdata uint8_t*) &g_Recorder + UsbSetupBuf->wIndexL, len);
+		}
+		break;
+#endif
+
+#if WATCHDOG_ENABLE
+	case GET_WATCHDOG:
+		// Without the application state
+		len = transmitXdataBlock((__xdata uint8_t*) &g_WarmState, sizeof(WarmState) - WARM_APP_STATE_LEN);
+		break;
+#endif
+
+#if BOOT_TIMES_ENABLE
+	case GET_BOOT_TIMES:
+		len = transmitXdataBlock((__xdata uint8_t*) &g_BootTimes, sizeof(BootTimes));
+		break;
+#endif
+
+#if CLOCK_SYNC_ENABLE
+	case GET_CLOCK:
+		TIMER_GET_TICKS(g_ClockSync.ticks);
+		g_ClockSync.ticksPerSecond = TIMER_TICKS_PER_SECOND;
+		len = transmitXdataBlock((__xdata uint8_t*) &g_ClockSync, sizeof(ClockSync));
+		break;
+#endif
+
+#if PROFILE_ENABLE
+	case GET_PROFILE_COUNTERS:
+		len = transmitXdataBlock((__xdata uint8_t*) &g_Profile, sizeof(ProfileCounters));
+		if (UsbSetupBuf->wValueL == 1) {
+			g_ProfileResetPending = true;
+		}
 		break;
+#endif
 
 	// This request generates RS-232/V.24 style control signals
 	case SET_CONTROL_LINE_STATE:
+		// DTR dropped: the port was closed, leave the echo mode
+		if (!(UsbSetupBuf->wValueL & 0x01)) {
+			g_UsbCdcIsrEcho = false;
+		}
 		break;
 
 	case RESET_DEVICE_TO_BOOTLOADER:
-		jumpToBootloader();
+		// The snapshot writes the data flash, done in the main loop
+		g_UsbCdcBootloaderRequest = true;
 		break;
 
 	case SET_LINE_CODING:
@@ -482,7 +598,7 @@ inline uint8_t processNonStandardSetupRequest() {
  *
  * @return Length
  */
-uint8_t processSetupRequest() {
+inline uint8_t processSetupRequest() __using(USB_ISR_BANK) {
 	// The default is success and upload 0 length
 	uint8_t len = 0;
 
@@ -500,10 +616,33 @@ uint8_t processSetupRequest() {
 }
 
 /**
- * USB Setup Handler
+ * Echo the received EP2 packet, the upload endpoint needs to be free.
+ * Receiving stays enabled, the main loop does not see the data.
  */
-inline void usbSetupInterrupt() {
+inline void usbEchoPacket() __using(USB_ISR_BANK) {
+	uint8_t i;
+
+	// No memcpy, it's not reentrant
+	for (i = 0; i < g_USBByteCount; i++) {
+		Ep2Buffer[MAX_PACKET_SIZE + i] = Ep2Buffer[i];
+	}
+
+	UEP2_T_LEN = g_USBByteCount;
+	UEP2_CTRL = (UEP2_CTRL & ~(MASK_UEP_T_RES | MASK_UEP_R_RES)) | UEP_T_RES_ACK | UEP_R_RES_ACK;
+	g_UpPoint2_Busy = 1;
+	g_USBByteCount = 0;
+}
+
+/**
+ * USB Setup Handler, not on the streaming path, therefore
+ * a real function, using the same register bank as the interrupt
+ */
+void usbSetupInterrupt() __using(USB_ISR_BANK) {
 	uint8_t len;
+
+	USB_STATS_INC(ep0Setup);
+	RECORDER_ISR(RECORDER_EVENT_SETUP, UsbSetupBuf->bRequest);
+
 	if (USB_RX_LEN == sizeof(USB_SETUP_REQ)) {
 		len = processSetupRequest();
 	} else {
@@ -512,12 +651,14 @@ inline void usbSetupInterrupt() {
 	}
 
 	if (len == 0xff) {
+		USB_STATS_INC(ep0Stall);
+		RECORDER_ISR(RECORDER_EVENT_STALL, g_SetupReq);
 		g_SetupReq = 0xff;
 
 		// STALL
 		UEP0_CTRL = bUEP_R_TOG | bUEP_T_TOG | UEP_R_RES_STALL | UEP_T_RES_STALL;
 
-	} else if (len <= DEFAULT_ENDP0_SIZE) {
+	} else if (len <= USB_EP0_SIZE) {
 		// Upload data or status stage returns 0 length package
 
 		UEP0_T_LEN = len;
@@ -536,138 +677,270 @@ inline void usbSetupInterrupt() {
 }
 
 /**
- * Handle USB Data transfer
+ * Handle data stage of a control write (EP0 OUT), not on the streaming path
  */
-inline void usbTransferInterrupt() {
-	uint16_t len;
+void usbControlOutInterrupt() __using(USB_ISR_BANK) {
+	uint8_t i;
+	__xdata uint8_t* config;
 
-	switch (USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP)) {
-	// Endpoint 1# Endpoint interrupt upload
-	case UIS_TOKEN_IN | 1:
-		// Pre-use send length must be cleared
-		UEP1_T_LEN = 0;
+	if (!U_TOG_OK) {
+		USB_STATS_INC(ep0ToggleError);
+		RECORDER_ISR(RECORDER_EVENT_TOGGLE_ERROR, 0);
+	}
 
-		// Default response NAK
-		UEP1_CTRL = (UEP1_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
-		break;
+	//Set the serial port properties
+	if (g_SetupReq == SET_LINE_CODING) {
+		if (U_TOG_OK) {
+			// Only persist if changed, the host sets the line coding on each open
+			for (i = 0; i < sizeof(g_Config.lineCoding); i++) {
+				if (g_Config.lineCoding[i] != Ep0Buffer[i]) {
+					g_Config.lineCoding[i] = Ep0Buffer[i];
+					g_ConfigDirty = true;
+				}
+			}
 
-	// Endpoint 2# Endpoint bulk upload
-	case UIS_TOKEN_IN | 2:
-		// Pre-use send length must be cleared
-		UEP2_T_LEN = 0;
+			// Both little endian
+			g_Baud = *((__xdata uint32_t*) g_Config.lineCoding);
 
-		// Default response NAK
-		UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
+			if (g_Baud > 999999) {
+				g_Baud = 57600;
+			}
 
-		// Clear busy flag
-		g_UpPoint2_Busy = 0;
-		break;
+			UEP0_T_LEN = 0;
 
-	// Endpoint 3# Endpoint Batch Down
-	case UIS_TOKEN_OUT | 2:
-		// Out of sync packets will be dropped
+			// Ready to upload 0 packages
+			UEP0_CTRL |= UEP_R_RES_ACK | UEP_T_RES_ACK;
+		}
+	} else if (g_SetupReq == SET_DEVICE_CONFIG) {
 		if (U_TOG_OK) {
-			g_USBByteCount = USB_RX_LEN;
+			// Only accept a complete block of the current layout
+			if (USB_RX_LEN == sizeof(DeviceConfig) && Ep0Buffer[0] == CONFIG_MAGIC
+					&& Ep0Buffer[1] == CONFIG_VERSION) {
+				config = (__xdata uint8_t*) &g_Config;
+				for (i = 0; i < sizeof(DeviceConfig); i++) {
+					config[i] = Ep0Buffer[i];
+				}
+				g_ConfigDirty = true;
+			}
 
-			// Take data pointer reset
-			g_USBBufOutPoint = 0;
+			UEP0_T_LEN = 0;
 
-			// Receive a packet of data on the NAK,
-			// the main function is processed,
-			// and the main function modifies the response mode.
-			UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_R_RES) | UEP_R_RES_NAK;
+			// Ready to upload 0 packages
+			UEP0_CTRL |= UEP_R_RES_ACK | UEP_T_RES_ACK;
 		}
-		break;
+	} else {
+		UEP0_T_LEN = 0;
+		// Just ACK is fine.
+		UEP0_CTRL |= UEP_R_RES_ACK | UEP_T_RES_ACK;
+	}
+}
 
-	// SETUP transaction
-	case UIS_TOKEN_SETUP | 0:
-		usbSetupInterrupt();
-		break;
+/**
+ * USB Interrupt Handler, the prototype in usb-cdc.h is included by main.c,
+ * else SDCC won't generate the interrupt vector.
+ *
+ * Uses its own register bank, so no register context needs to be pushed.
+ * The streaming path (EP2 IN / OUT) is handled here directly without function calls,
+ * the control transfers are handled in functions using the same register bank.
+ */
+void usbInterrupt() __interrupt(INT_NO_USB) __using(USB_ISR_BANK) {
+	PROFILE_ISR_BEGIN();
+
+	// USB transfer completion flag
+	if (UIF_TRANSFER) {
+#if PROFILE_NAK
+		// NAK interrupt, only enabled for profiling, no data is transferred
+		if (U_IS_NAK) {
+			if ((USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP)) == (UIS_TOKEN_OUT | 2)) {
+				PROFILE_OUT_NAK();
+			}
+		} else
+#endif
+#if SOF_ENABLE
+		// Start of frame, every 1 ms, no data is transferred
+		if ((USB_INT_ST & MASK_UIS_TOKEN) == UIS_TOKEN_SOF) {
+			SOF_ISR();
+		} else
+#endif
+		switch (USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP)) {
+		// Endpoint 2# Endpoint bulk upload
+		case UIS_TOKEN_IN | 2:
+			USB_STATS_INC(ep2In);
+			USB_STATS_ADD(ep2InBytes, UEP2_T_LEN);
+
+			// Pre-use send length must be cleared
+			UEP2_T_LEN = 0;
+
+			// Default response NAK
+			UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
+
+			// Clear busy flag
+			g_UpPoint2_Busy = 0;
+			BOOT_PHASE_ISR(BOOT_PHASE_FIRST_TX);
+
+			// A packet waits for the echo
+			if (g_UsbCdcIsrEcho && g_USBByteCount) {
+				usbEchoPacket();
+			}
+			break;
+
+		// Endpoint 2# Endpoint Batch Down
+		case UIS_TOKEN_OUT | 2:
+			// Out of sync packets will be dropped
+			if (U_TOG_OK) {
+				g_USBByteCount = USB_RX_LEN;
+
+				USB_STATS_INC(ep2Out);
+				USB_STATS_ADD(ep2OutBytes, g_USBByteCount);
+				USB_STATS_MAX(ep2OutHighWater, g_USBByteCount);
+
+				TIMER_GET_TICKS(g_UsbCdcRxTicks);
+
+				// Take data pointer reset
+				g_USBBufOutPoint = 0;
+
+				if (g_UsbCdcIsrEcho && !g_UpPoint2_Busy) {
+					usbEchoPacket();
+					break;
+				}
+
+				// Receive a packet of data on the NAK,
+				// the main function is processed,
+				// and the main function modifies the response mode.
+				UEP2_CTRL = (UEP2_CTRL & ~ MASK_UEP_R_RES) | UEP_R_RES_NAK;
+			} else {
+				USB_STATS_INC(ep2ToggleError);
+				RECORDER_ISR(RECORDER_EVENT_TOGGLE_ERROR, 2);
+			}
+			break;
+
+		// Endpoint 1# Endpoint interrupt upload
+		case UIS_TOKEN_IN | 1:
+			USB_STATS_INC(ep1In);
 
-	// endpoint0 IN
-	case UIS_TOKEN_IN | 0:
-		switch (g_SetupReq) {
-		case USB_GET_DESCRIPTOR:
-			UEP0_T_LEN = transmitSetupBlock();;
+			// Pre-use send length must be cleared
+			UEP1_T_LEN = 0;
 
-			// Sync flag bit flip
-			UEP0_CTRL ^= bUEP_T_TOG;
+			// Default response NAK
+			UEP1_CTRL = (UEP1_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK;
 			break;
 
-		case USB_SET_ADDRESS:
-			USB_DEV_AD = (USB_DEV_AD & bUDA_GP_BIT) | g_SetupLen;
-			UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+#if VENDOR_BULK_ENABLE
+		// Endpoint 3# Vendor bulk upload
+		case UIS_TOKEN_IN | 3:
+			VENDOR_IN_ISR();
 			break;
 
-		default:
-			// The status phase completes the interrupt or is forced to upload 0 length packet end control transmission
-			UEP0_T_LEN = 0;
-			UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+		// Endpoint 3# Vendor bulk down
+		case UIS_TOKEN_OUT | 3:
+			VENDOR_OUT_ISR();
 			break;
-		}
-		break;
+#endif
 
-	// endpoint0 OUT
-	case UIS_TOKEN_OUT | 0:
-		//Set the serial port properties
-		if (g_SetupReq == SET_LINE_CODING) {
-			if (U_TOG_OK) {
-				memcpy(g_LineCoding, UsbSetupBuf, USB_RX_LEN);
-				*((uint8_t *) &g_Baud) = g_LineCoding[0];
-				*((uint8_t *) &g_Baud + 1) = g_LineCoding[1];
-				*((uint8_t *) &g_Baud + 2) = g_LineCoding[2];
-				*((uint8_t *) &g_Baud + 3) = g_LineCoding[3];
-
-				if (g_Baud > 999999) {
-					g_Baud = 57600;
-				}
+		// SETUP transaction
+		case UIS_TOKEN_SETUP | 0:
+			usbSetupInterrupt();
+			break;
 
-				UEP0_T_LEN = 0;
+		// endpoint0 IN
+		case UIS_TOKEN_IN | 0:
+			switch (g_SetupReq) {
+			case USB_GET_DESCRIPTOR:
+				UEP0_T_LEN = transmitSetupBlock();
+
+				// Sync flag bit flip
+				UEP0_CTRL ^= bUEP_T_TOG;
+				break;
 
-				// Ready to upload 0 packages
-				UEP0_CTRL |= UEP_R_RES_ACK | UEP_T_RES_ACK;
+			case USB_SET_ADDRESS:
+				USB_DEV_AD = (USB_DEV_AD & bUDA_GP_BIT) | g_SetupLen;
+				UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+				break;
+
+			default:
+				// The status phase completes the interrupt or is forced to upload 0 length packet end control transmission
+				UEP0_T_LEN = 0;
+				UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+				break;
 			}
-		} else {
-			UEP0_T_LEN = 0;
-			// Just ACK is fine.
-			UEP0_CTRL |= UEP_R_RES_ACK | UEP_T_RES_ACK;
-		}
-		break;
+			break;
 
-	default:
-		break;
-	}
-}
+		// endpoint0 OUT
+		case UIS_TOKEN_OUT | 0:
+			usbControlOutInterrupt();
+			break;
 
-/**
- * USB Interrupt Handler, this is called by main.c,
- * the main Hardware interrupt handler
- */
-void usbInterrupt() {
-	// USB transfer completion flag
-	if (UIF_TRANSFER) {
-		usbTransferInterrupt();
+		default:
+			break;
+		}
 
 		// Write 0 to clear interrupt
 		UIF_TRANSFER = 0;
-	}
 
 	// Device Mode USB Bus Reset Interrupt
-	if (UIF_BUS_RST) {
-		usbResetInterrupt();
-	}
+	} else if (UIF_BUS_RST) {
+		USB_STATS_INC(busReset);
+		RECORDER_ISR(RECORDER_EVENT_BUS_RESET, 0);
+		BOOT_PHASE_ISR(BOOT_PHASE_BUS_RESET);
+
+		UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+		UEP1_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK;
+		UEP2_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
+		VENDOR_RESET_ISR();
+		SOF_RESET_ISR();
+		USB_DEV_AD = 0x00;
+		UIF_SUSPEND = 0;
+		UIF_TRANSFER = 0;
+
+		// Clear interrupt flag
+		UIF_BUS_RST = 0;
+
+		// Circular buffer input pointer
+		g_Uart_Input_Point = 0;
+
+		// Length received by the USB endpoint
+		g_USBByteCount = 0;
+
+		// Clear configuration value
+		g_UsbConfig = 0;
+		g_UpPoint2_Busy = 0;
+		g_UsbCdcIsrEcho = false;
 
 	// USB bus suspend / wake up
-	if (UIF_SUSPEND) {
+	} else if (UIF_SUSPEND) {
 		UIF_SUSPEND = 0;
+		USB_STATS_INC(suspend);
+		RECORDER_ISR(RECORDER_EVENT_SUSPEND, 0);
+		SOF_RESET_ISR();
+
+		if (USB_MIS_ST & bUMS_SUSPEND) {
+			while (XBUS_AUX & bUART0_TX) {
+				; // Waiting for transmission to complete
+			}
 
-		usbWakeupSuspendInterrupt();
+			SAFE_MOD = 0x55;
+			SAFE_MOD = 0xAA;
+
+			// USB or RXD0/1 can be woken up when there is a signal
+			WAKE_CTRL = bWAK_BY_USB | bWAK_RXD0_LO | bWAK_RXD1_LO;
+
+			// Sleep
+			PCON |= PD;
+
+			SAFE_MOD = 0x55;
+			SAFE_MOD = 0xAA;
+			WAKE_CTRL = 0x00;
+		}
 	} else {
-		// Unexpected interruption, impossible situation
+		// Unexpected interruption, impossible situation.
+		// Only cleared if no other flag is pending, else a transfer
+		// completed while handling this interrupt would be lost
 
 		// Clear interrupt flag
 		USB_INT_FG = 0xFF;
 	}
+
+	PROFILE_ISR_END();
 }
 
 /**
@@ -676,34 +949,75 @@ void usbInterrupt() {
  * @param c Char to send
  */
 void UsbCdc_putc(uint8_t c) {
-	char str[2] = {c, 0};
-	UsbCdc_puts(str);
+	// Not with UsbCdc_puts(), so 0 can be sent, too
+	__xdata uint8_t* buffer = UsbCdc_beginTransmit();
+
+	if (buffer == NULL) {
+		USB_STATS_INC(putsDroppedBytes);
+		return;
+	}
+
+	buffer[0] = c;
+	UsbCdc_transmit(1);
 }
 
 /**
- * Send 0 terminated string over USB CDC Serial port
+ * Wait until the upload endpoint is free, the caller writes the data directly
+ * into the returned buffer and sends it with UsbCdc_transmit()
  *
- * @param str String to send (0 Terminator will not be sent), max USBCDC_TRANSMIT_BUFFER_LEN (64 Byte)
+ * @return Transmit buffer, USBCDC_TRANSMIT_BUFFER_LEN bytes, NULL if not configured
+ *         or USBCDC_TRANSMIT_TIMEOUT_MS passed, see g_UsbCdcTransmitTimeout
  */
-void UsbCdc_puts(char* str) {
-	uint8_t length;
+__xdata uint8_t* UsbCdc_beginTransmit() {
+	uint32_t waitTicks;
+
+	g_UsbCdcTransmitTimeout = false;
 
 	// The endpoint is not busy (the first packet of data after idle, only used to trigger the upload)
 	if (!g_UsbConfig) {
-		return;
+		return NULL;
 	}
 
-	while(g_UpPoint2_Busy) {
-		// The endpoint is not busy (the first packet of data after idle, only used to trigger the upload)
-	}
+	if (g_UpPoint2_Busy) {
+		profileWaitBegin();
+		waitTicks = timerGetTicks();
 
-	length = strlen(str);
-	if (length > USBCDC_TRANSMIT_BUFFER_LEN) {
-		length = USBCDC_TRANSMIT_BUFFER_LEN - g_Uart_Output_Point;
+		while(g_UpPoint2_Busy) {
+			// The endpoint is not busy (the first packet of data after idle, only used to trigger the upload)
+			profileWaitStep();
+
+			// The host does not read, the watchdog is not kicked here, a hang is still detected
+			if (timerGetTicks() - waitTicks >= USBCDC_TRANSMIT_TIMEOUT_MS * (TIMER_TICKS_PER_SECOND / 1000)) {
+				break;
+			}
+		}
+
+#if RECORDER_ENABLE
+		// The host did not read for a long time
+		waitTicks = timerGetTicks() - waitTicks;
+		if (waitTicks >= RECORDER_TX_STALL_MS * (TIMER_TICKS_PER_SECOND / 1000)) {
+			waitTicks /= TIMER_TICKS_PER_SECOND / 1000;
+			RECORDER_ADD(RECORDER_EVENT_TX_STALL, waitTicks > 255 ? 255 : waitTicks);
+		}
+#endif
+
+		if (g_UpPoint2_Busy) {
+			USB_STATS_INC(ep2InTimeout);
+			g_UsbCdcTransmitTimeout = true;
+			return NULL;
+		}
 	}
 
-	// Write upload endpoint
-	memcpy(Ep2Buffer + MAX_PACKET_SIZE, str, length);
+	return Ep2Buffer + MAX_PACKET_SIZE;
+}
+
+/**
+ * Send the data written into the buffer returned by UsbCdc_beginTransmit()
+ *
+ * @param length Length, max USBCDC_TRANSMIT_BUFFER_LEN
+ */
+void UsbCdc_transmit(uint8_t length) {
+	USB_STATS_MAX(ep2InHighWater, length);
 
 	// Pre-use send length must be cleared
 	UEP2_T_LEN = length;
@@ -713,6 +1027,32 @@ void UsbCdc_puts(char* str) {
 	g_UpPoint2_Busy = 1;
 }
 
+/**
+ * Send 0 terminated string over USB CDC Serial port
+ *
+ * @param str String to send (0 Terminator will not be sent), max USBCDC_TRANSMIT_BUFFER_LEN (64 Byte)
+ */
+void UsbCdc_puts(char* str) {
+	uint8_t length = strlen(str);
+	__xdata uint8_t* buffer = UsbCdc_beginTransmit();
+
+	if (buffer == NULL) {
+		USB_STATS_ADD(putsDroppedBytes, length);
+		return;
+	}
+
+	if (length > USBCDC_TRANSMIT_BUFFER_LEN) {
+		USB_STATS_INC(putsTruncated);
+		USB_STATS_ADD(putsDroppedBytes, length - USBCDC_TRANSMIT_BUFFER_LEN + g_Uart_Output_Point);
+		length = USBCDC_TRANSMIT_BUFFER_LEN - g_Uart_Output_Point;
+	}
+
+	// Write upload endpoint
+	memcpy(buffer, str, length);
+
+	UsbCdc_transmit(length);
+}
+
 /**
  * Send uint8_t over CDC Serial port
  */
@@ -735,10 +1075,30 @@ void UsbCdc_puti(uint8_t value) {
 	UsbCdc_puts(data + i);
 }
 
+/**
+ * Echo all received packets in the interrupt, without the main loop,
+ * until the host closes the port (DTR is cleared) or the bus is reset
+ */
+void UsbCdc_startIsrEcho() {
+	g_UsbCdcIsrEcho = true;
+}
+
 /**
  * Receive data from USB and process it, process only one byte at once
  */
 void UsbCdc_processInput() {
+	// Data flash is not written from the USB interrupt, the request is already answered
+	if (g_UsbCdcBootloaderRequest) {
+		RECORDER_ADD(RECORDER_EVENT_BOOTLOADER, 0);
+		recorderSnapshot();
+		jumpToBootloader();
+	}
+
+	// Handled in the interrupt
+	if (g_UsbCdcIsrEcho) {
+		return;
+	}
+
 	while (g_USBByteCount) {
 		logicCharReceived(Ep2Buffer[g_USBBufOutPoint++]);
 
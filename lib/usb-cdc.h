@@ -16,18 +16,47 @@
  */
 #define USBCDC_TRANSMIT_BUFFER_LEN  64
 
+/**
+ * If the host does not read the previous packet within this time, the new packet is
+ * dropped. Shorter than the watchdog timeout, a host that does not read is no hang
+ */
+#define USBCDC_TRANSMIT_TIMEOUT_MS 100
+
+/**
+ * USB Configuration, set by the host, 0 if not configured
+ */
+extern uint8_t g_UsbConfig;
+
 /**
  * Current buffer remaining bytes to be sent over USB-CDC
  */
 extern volatile __idata uint8_t g_UartTransmitByteCount;
 
+/**
+ * Tick counter (timer.h), when the last packet was received
+ */
+extern volatile uint32_t g_UsbCdcRxTicks;
+
+/**
+ * The last UsbCdc_beginTransmit() returned NULL because the host did not read
+ * within USBCDC_TRANSMIT_TIMEOUT_MS, and not because the device is not configured
+ */
+extern bool g_UsbCdcTransmitTimeout;
+
 /**
  * Send usb data from buffer
  */
 void UsbCdc_processOutput();
 
 /**
- * Receive data from USB and process it, process only one byte at once
+ * Echo all received packets in the interrupt, without the main loop,
+ * until the host closes the port (DTR is cleared) or the bus is reset
+ */
+void UsbCdc_startIsrEcho();
+
+/**
+ * Receive data from USB and process it, process only one byte at once.
+ * Enters the bootloader, if requested by the host
  */
 void UsbCdc_processInput();
 
@@ -38,6 +67,22 @@ void UsbCdc_processInput();
  */
 void UsbCdc_putc(uint8_t c);
 
+/**
+ * Wait until the upload endpoint is free, the caller writes the data directly
+ * into the returned buffer and sends it with UsbCdc_transmit()
+ *
+ * @return Transmit buffer, USBCDC_TRANSMIT_BUFFER_LEN bytes, NULL if not configured
+ *         or USBCDC_TRANSMIT_TIMEOUT_MS passed, see g_UsbCdcTransmitTimeout
+ */
+__xdata uint8_t* UsbCdc_beginTransmit();
+
+/**
+ * Send the data written into the buffer returned by UsbCdc_beginTransmit()
+ *
+ * @param length Length, max USBCDC_TRANSMIT_BUFFER_LEN
+ */
+void UsbCdc_transmit(uint8_t length);
+
 /**
  * Send uint8_t over CDC Serial port
  */
@@ -51,6 +96,16 @@ void UsbCdc_puti(uint8_t value);
 void UsbCdc_puts(char* str);
 
 /**
- * USB Interrupt Handler
+ * Register bank used by the USB interrupt and all functions called by it,
+ * set in the Makefile, 0 only for the comparison of make bench-isr-bank.
+ * The functions must not be called outside of the interrupt, checked by
+ * test-tools/check-isr-bank.py
+ */
+#ifndef USB_ISR_BANK
+#define USB_ISR_BANK 1
+#endif
+
+/**
+ * USB Interrupt Handler, the prototype needs to be visible in main.c
  */
-void usbInterrupt();
+void usbInterrupt() __interrupt(INT_NO_USB) __using(USB_ISR_BANK);
@@ -0,0 +1,140 @@
+/**
+ * USB error and flow statistics, counted in the USB interrupt and
+ * in UsbCdc_puts, read by the host with a vendor request
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+
+// Enabled in the Makefile
+#ifndef USB_STATS_ENABLE
+#define USB_STATS_ENABLE 1
+#endif
+
+/**
+ * USB statistics, the layout is read by test-tools/read-usb-stats.py
+ */
+typedef struct {
+	/**
+	 * Bus resets
+	 */
+	uint16_t busReset;
+
+	/**
+	 * Suspend events
+	 */
+	uint16_t suspend;
+
+	/**
+	 * Received SETUP packets
+	 */
+	uint16_t ep0Setup;
+
+	/**
+	 * SETUP requests answered with STALL (unsupported / invalid)
+	 */
+	uint16_t ep0Stall;
+
+	/**
+	 * EP0 OUT data packets dropped because of a toggle mismatch
+	 */
+	uint16_t ep0ToggleError;
+
+	/**
+	 * Endpoint halt (STALL) set by the host with SET_FEATURE
+	 */
+	uint16_t endpointHalt;
+
+	/**
+	 * EP1 (CDC notification) IN packets
+	 */
+	uint16_t ep1In;
+
+	/**
+	 * EP2 IN packets sent
+	 */
+	uint32_t ep2In;
+
+	/**
+	 * EP2 IN bytes sent
+	 */
+	uint32_t ep2InBytes;
+
+	/**
+	 * EP2 OUT packets received
+	 */
+	uint32_t ep2Out;
+
+	/**
+	 * EP2 OUT bytes received
+	 */
+	uint32_t ep2OutBytes;
+
+	/**
+	 * EP2 OUT packets dropped because of a toggle mismatch
+	 */
+	uint16_t ep2ToggleError;
+
+	/**
+	 * Largest EP2 OUT packet, high water mark of the receive buffer
+	 */
+	uint8_t ep2OutHighWater;
+
+	/**
+	 * Largest EP2 IN packet, high water mark of the transmit buffer
+	 */
+	uint8_t ep2InHighWater;
+
+	/**
+	 * UsbCdc_puts calls with a string longer than the transmit buffer
+	 */
+	uint16_t putsTruncated;
+
+	/**
+	 * Bytes not sent by UsbCdc_puts, truncated or not configured
+	 */
+	uint32_t putsDroppedBytes;
+
+	/**
+	 * EP2 IN packets dropped, the host did not read within USBCDC_TRANSMIT_TIMEOUT_MS
+	 */
+	uint16_t ep2InTimeout;
+} UsbStats;
+
+#if USB_STATS_ENABLE
+
+/**
+ * USB statistics
+ */
+extern __xdata UsbStats g_UsbStats;
+
+/**
+ * Increment a counter
+ */
+#define USB_STATS_INC(field) g_UsbStats.field++
+
+/**
+ * Add to a counter
+ */
+#define USB_STATS_ADD(field, value) g_UsbStats.field += (value)
+
+/**
+ * Update a high water mark
+ */
+#define USB_STATS_MAX(field, value) { \
+	if ((value) > g_UsbStats.field) { \
+		g_UsbStats.field = (value); \
+	} \
+}
+
+#else
+
+#define USB_STATS_INC(field)
+#define USB_STATS_ADD(field, value)
+#define USB_STATS_MAX(field, value)
+
+#endif
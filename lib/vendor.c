@@ -0,0 +1,74 @@
+/**
+ * Vendor specific bulk interface on EP3
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "vendor.h"
+#include "hardware.h"
+#include "usb-cdc.h"
+
+#if VENDOR_BULK_ENABLE
+
+/**
+ * EP3 IN packet is waiting for the host
+ */
+volatile __data uint8_t g_VendorInBusy = 0;
+
+/**
+ * EP3 OUT packet received, the endpoint NAKs until vendorReceiveDone()
+ */
+volatile __data uint8_t g_VendorOutReceived = 0;
+
+/**
+ * Length of the received EP3 OUT packet, can be 0
+ */
+volatile __data uint8_t g_VendorOutLength = 0;
+
+/**
+ * Transmit buffer, if the endpoint is free, does not wait
+ *
+ * @return Transmit buffer, VENDOR_PACKET_LEN bytes, NULL if busy or not configured
+ */
+__xdata uint8_t* vendorBeginTransmit() {
+	if (!g_UsbConfig || g_VendorInBusy) {
+		return NULL;
+	}
+
+	return Ep3Buffer + VENDOR_PACKET_LEN;
+}
+
+/**
+ * Send the data written into the buffer returned by vendorBeginTransmit()
+ *
+ * @param length Length, max VENDOR_PACKET_LEN
+ */
+void vendorTransmit(uint8_t length) {
+	UEP3_T_LEN = length;
+	g_VendorInBusy = 1;
+	UEP3_CTRL = (UEP3_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_ACK;
+}
+
+/**
+ * Received packet
+ *
+ * @return Receive buffer, NULL if nothing received, the length is g_VendorOutLength
+ */
+__xdata uint8_t* vendorReceived() {
+	if (!g_VendorOutReceived) {
+		return NULL;
+	}
+
+	return Ep3Buffer;
+}
+
+/**
+ * The received packet is processed, receive the next one
+ */
+void vendorReceiveDone() {
+	g_VendorOutReceived = 0;
+	UEP3_CTRL = (UEP3_CTRL & ~ MASK_UEP_R_RES) | UEP_R_RES_ACK;
+}
+
+#endif
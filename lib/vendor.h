@@ -0,0 +1,100 @@
+/**
+ * Vendor specific bulk interface on EP3, next to the CDC interface, for raw
+ * libusb streaming without the tty layer of the host, see test-tools/vendor-reader.py
+ *
+ * The interface is described in usb-descriptor.json (option VENDOR_BULK).
+ * The interrupt only sets the flags, the main loop fills and empties the buffers.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+#include "../usb-descriptor/usb-layout.h"
+
+/**
+ * Packet size of both directions
+ */
+#define VENDOR_PACKET_LEN 64
+
+#if VENDOR_BULK_ENABLE
+
+/**
+ * EP3 IN packet is waiting for the host
+ */
+extern volatile __data uint8_t g_VendorInBusy;
+
+/**
+ * EP3 OUT packet received, the endpoint NAKs until vendorReceiveDone()
+ */
+extern volatile __data uint8_t g_VendorOutReceived;
+
+/**
+ * Length of the received EP3 OUT packet, can be 0
+ */
+extern volatile __data uint8_t g_VendorOutLength;
+
+/**
+ * EP3 IN complete, in the USB interrupt
+ */
+#define VENDOR_IN_ISR() { \
+	UEP3_T_LEN = 0; \
+	UEP3_CTRL = (UEP3_CTRL & ~ MASK_UEP_T_RES) | UEP_T_RES_NAK; \
+	g_VendorInBusy = 0; \
+}
+
+/**
+ * EP3 OUT received, in the USB interrupt, out of sync packets are dropped
+ */
+#define VENDOR_OUT_ISR() { \
+	if (U_TOG_OK) { \
+		g_VendorOutLength = USB_RX_LEN; \
+		g_VendorOutReceived = 1; \
+		UEP3_CTRL = (UEP3_CTRL & ~ MASK_UEP_R_RES) | UEP_R_RES_NAK; \
+	} \
+}
+
+/**
+ * Bus reset, in the USB interrupt
+ */
+#define VENDOR_RESET_ISR() { \
+	UEP3_CTRL = bUEP_AUTO_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK; \
+	g_VendorInBusy = 0; \
+	g_VendorOutReceived = 0; \
+}
+
+/**
+ * Transmit buffer, if the endpoint is free, does not wait
+ *
+ * @return Transmit buffer, VENDOR_PACKET_LEN bytes, NULL if busy or not configured
+ */
+__xdata uint8_t* vendorBeginTransmit();
+
+/**
+ * Send the data written into the buffer returned by vendorBeginTransmit()
+ *
+ * @param length Length, max VENDOR_PACKET_LEN
+ */
+void vendorTransmit(uint8_t length);
+
+/**
+ * Received packet
+ *
+ * @return Receive buffer, NULL if nothing received, the length is g_VendorOutLength
+ */
+__xdata uint8_t* vendorReceived();
+
+/**
+ * The received packet is processed, receive the next one
+ */
+void vendorReceiveDone();
+
+#else
+
+#define VENDOR_IN_ISR()
+#define VENDOR_OUT_ISR()
+#define VENDOR_RESET_ISR()
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * Watchdog, and the warm state kept over a watchdog reset
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "watchdog.h"
+#include "timer.h"
+
+#if WATCHDOG_ENABLE
+
+/**
+ * Warm state, not initialized by the startup code
+ */
+__xdata __at (WARM_XRAM_ADDR) WarmState g_WarmState;
+
+/**
+ * Booted after a watchdog reset, the application state is valid
+ */
+bool g_WatchdogRecovered = false;
+
+/**
+ * Check the reset reason and the warm state, and enable the watchdog
+ */
+void watchdogSetup() {
+	if ((PCON & MASK_RST_FLAG) == RST_FLAG_WDOG && g_WarmState.magic == WARM_MAGIC) {
+		g_WarmState.watchdogResets++;
+		g_WatchdogRecovered = true;
+	} else if ((PCON & MASK_RST_FLAG) == RST_FLAG_POR || g_WarmState.magic != WARM_MAGIC) {
+		// XRAM content lost
+		memset(&g_WarmState, 0, sizeof(WarmState));
+		g_WarmState.magic = WARM_MAGIC;
+	} else {
+		// Software or pin reset: statistics are kept, the application starts fresh
+		memset(g_WarmState.app, 0, WARM_APP_STATE_LEN);
+	}
+
+	WATCHDOG_KICK();
+
+	SAFE_MOD = 0x55;
+	SAFE_MOD = 0xAA;
+	GLOBAL_CFG |= bWDOG_EN;
+	SAFE_MOD = 0x00;
+}
+
+/**
+ * The application resumed after a watchdog reset, store the recovery time
+ */
+void watchdogRecovered() {
+	uint32_t ticks = timerGetTicks();
+	uint32_t ms = ticks / (TIMER_TICKS_PER_SECOND / 1000);
+
+	// The timer starts with 0 on boot
+	g_WarmState.recoveryTicks = ticks;
+	g_WatchdogRecovered = false;
+
+	RECORDER_ADD(RECORDER_EVENT_RECOVERED, ms > 255 ? 255 : ms);
+}
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * Watchdog: resets the device if the main loop hangs. The warm state in the
+ * XRAM region which is not cleared on startup (see recorder.h) survives the reset,
+ * so the application can resume after the device is enumerated again.
+ *
+ * The watchdog counts with Fsys / 65536 and resets on the overflow from 0xFF,
+ * so the max timeout is 699 ms at 24 MHz.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "inc.h"
+#include "recorder.h"
+
+// Enabled in the Makefile
+#ifndef WATCHDOG_ENABLE
+#define WATCHDOG_ENABLE 1
+#endif
+
+#ifndef WATCHDOG_TIMEOUT_MS
+#define WATCHDOG_TIMEOUT_MS 500
+#endif
+
+// Test build, the command H of logic.c hangs the firmware
+#ifndef WATCHDOG_TEST_ENABLE
+#define WATCHDOG_TEST_ENABLE 0
+#endif
+
+/**
+ * Watchdog counts until the reset
+ */
+#define WATCHDOG_COUNTS (WATCHDOG_TIMEOUT_MS * (FREQ_SYS / 1000L) / 65536L)
+
+#if WATCHDOG_COUNTS > 255 || WATCHDOG_COUNTS < 1
+#error WATCHDOG_TIMEOUT_MS out of range for FREQ_SYS
+#endif
+
+/**
+ * Value written on each kick
+ */
+#define WATCHDOG_RELOAD (256 - WATCHDOG_COUNTS)
+
+/**
+ * XRAM address of the warm state, after the recorder ring
+ */
+#define WARM_XRAM_ADDR (RECORDER_XRAM_ADDR + 0xE0)
+
+/**
+ * Marks the warm state as valid
+ */
+#define WARM_MAGIC 0x574D
+
+/**
+ * Bytes for the application state
+ */
+#define WARM_APP_STATE_LEN 16
+
+/**
+ * State kept over a watchdog reset, the first part is read by test-tools/watchdog-test.py
+ */
+typedef struct {
+	/**
+	 * WARM_MAGIC
+	 */
+	uint16_t magic;
+
+	/**
+	 * Watchdog resets since power on
+	 */
+	uint16_t watchdogResets;
+
+	/**
+	 * Last recovery: ticks of timer.h from the reset until the application resumed
+	 */
+	uint32_t recoveryTicks;
+
+	/**
+	 * Application state, e.g. the running stream of logic.c
+	 */
+	uint8_t app[WARM_APP_STATE_LEN];
+} WarmState;
+
+#if WATCHDOG_ENABLE
+
+extern __xdata __at (WARM_XRAM_ADDR) WarmState g_WarmState;
+
+/**
+ * Booted after a watchdog reset, the application state is valid
+ */
+extern bool g_WatchdogRecovered;
+
+/**
+ * Restart the watchdog timeout
+ */
+#define WATCHDOG_KICK() WDOG_COUNT = WATCHDOG_RELOAD
+
+/**
+ * Check the reset reason and the warm state, and enable the watchdog
+ */
+void watchdogSetup();
+
+/**
+ * The application resumed after a watchdog reset, store the recovery time
+ */
+void watchdogRecovered();
+
+#else
+
+#define g_WatchdogRecovered false
+#define WATCHDOG_KICK()
+#define watchdogSetup()
+#define watchdogRecovered()
+
+#endif
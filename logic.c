@@ -1,36 +1,743 @@
 /**
  * Main Project Logic
  *
+ * Test commands, used by test-tools/cdc-benchmark.py, one command per line:
+ *   T <bytes> <chunk> <pattern>  Transmit bytes to the host, in packets of chunk bytes (1 ... 64)
+ *   R <bytes>                    Receive bytes, answers "R <received> <errors>\n" when done
+ *   D <bytes> <chunk> <pattern>  Full duplex, T and R at the same time
+ *   E <bytes>                    Echo the next bytes
+ *   P <packets>                  Stream sequence numbered packets, 0 = until any byte is received
+ *   I                            Answers "I\n", then echo in the USB interrupt, until the port is closed
+ *   Q <id>                       Ping, answers "Q <id> <rx ticks> <tx ticks>\n", ticks of timer.h
+ *   F <frames> <rate>            Send binary sample frames (frame.h), see test-tools/frame-check.py,
+ *                                paced at rate samples per second (lib/sof.h), 0 = as fast as possible,
+ *                                "F 0" stops the frames
+ *   H                            Hang without kicking the watchdog, see test-tools/watchdog-test.py,
+ *                                only with WATCHDOG_TEST=1
+ *   U                            Answers "U\n", then firmware update, see lib/iap.h
+ *   V <packets>                  Stream packets on the vendor bulk interface (EP3), 0 = until a packet
+ *                                is received on EP3, see test-tools/vendor-reader.py
+ * Pattern: 0 = "ABCDEFGHIJKLMNOPQRSTUVWXY", 1 = counter (byte n is n & 0xff), 2 = zero.
+ * Received data is checked against the counter pattern.
+ * Packets received on the vendor bulk interface are echoed, if no stream is running there.
+ *
+ * Stream packet, 64 bytes, little endian, see test-tools/stream-check.py:
+ *   uint32_t sequence, 58 bytes payload (byte n = sequence + n), uint16_t CRC-16/CCITT-FALSE of the first 62 bytes
+ *
+ * Sample frame, FRAME_TYPE_SAMPLES, little endian:
+ *   uint16_t sequence, uint16_t sample of each channel in the channel mask of the configuration
+ *   (sample of channel n = sequence * FRAME_SAMPLES + n)
+ *
+ * After a watchdog reset the running stream / frames continue with the next sequence number,
+ * when the device is configured again, paced frames continue as fast as possible.
+ *
+ * A single 's' (without newline) sends 10000 bytes of pattern 0 and a newline,
+ * used by test-tools/serial-speedtest.py
+ *
+ * With the autostart flag of the configuration (lib/config.h) the output format is sent as soon
+ * as the host configured the device: the 's' text, endless stream packets (stopped by any byte),
+ * or sample frames at the configured sample rate (stopped by "F 0").
+ *
  * Andreas Butti, (c) 2020
  * License: MIT
  */
 
 #include "logic.h"
 #include "lib/usb-cdc.h"
+#include "lib/config.h"
+#include "lib/crc.h"
+#include "lib/timer.h"
+#include "lib/frame.h"
+#include "lib/watchdog.h"
+#include "lib/iap.h"
+#include "lib/vendor.h"
+#include "lib/sof.h"
+
+#define LOG_MODULE 1
+#include "lib/log.h"
+
+/**
+ * Max length of a command line
+ */
+#define COMMAND_LINE_LEN 32
+
+// Transmit patterns
+#define PATTERN_ALPHABET 0
+#define PATTERN_COUNTER 1
+#define PATTERN_ZERO 2
+
+/**
+ * Length of the alphabet pattern
+ */
+#define PATTERN_ALPHABET_LEN 25
+
+/**
+ * Stream packet layout
+ */
+#define STREAM_PACKET_LEN 64
+#define STREAM_PAYLOAD_OFFSET 4
+#define STREAM_CRC_OFFSET (STREAM_PACKET_LEN - 2)
+
+/**
+ * Channels of a sample frame, samples per frame if all are enabled
+ */
+#define FRAME_SAMPLES 8
+
+/**
+ * Frame count of logicStartFrames(): until the next F command
+ */
+#define FRAMES_ENDLESS 0xFFFFFFFF
 
 /**
  * Bytes to send for speedtest
  */
 uint32_t g_sendBytes = 0;
 
+/**
+ * Packet size to send
+ */
+uint8_t g_sendChunk = PATTERN_ALPHABET_LEN;
+
+/**
+ * Pattern to send
+ */
+uint8_t g_sendPattern = PATTERN_ALPHABET;
+
+/**
+ * Position in the pattern, so the packets form a continuous stream
+ */
+uint8_t g_sendPatternPos = 0;
+
+/**
+ * Send a newline after the data, for the speedtest
+ */
+bool g_sendNewline = false;
+
+/**
+ * Bytes still to receive
+ */
+uint32_t g_receiveBytes = 0;
+
+/**
+ * Bytes received, and bytes not matching the counter pattern
+ */
+uint32_t g_receivedCount = 0;
+uint32_t g_receiveErrors = 0;
+
+/**
+ * Receive completed, the result needs to be sent
+ */
+bool g_receiveDone = false;
+
+/**
+ * Bytes still to echo
+ */
+uint32_t g_echoBytes = 0;
+
+/**
+ * Stream packets still to send
+ */
+uint32_t g_streamPackets = 0;
+
+/**
+ * Stream until a byte is received
+ */
+bool g_streamEndless = false;
+
+/**
+ * Sequence number of the next stream packet
+ */
+uint32_t g_streamSequence = 0;
+
+/**
+ * Sample frames still to send, and the sequence number of the next frame
+ */
+uint32_t g_frameCount = 0;
+uint16_t g_frameSequence = 0;
+
+/**
+ * Send sample frames until the next F command
+ */
+bool g_frameEndless = false;
+
+/**
+ * Channels of the running sample frames, bit n = channel n
+ */
+uint8_t g_frameChannels = 0xff;
+
+/**
+ * Pacing of the sample frames, if a rate was given
+ */
+__xdata SofPacer g_framePacer;
+bool g_framePaced = false;
+
+#if VENDOR_BULK_ENABLE
+/**
+ * Stream packets on the vendor bulk interface: still to send, endless, next sequence number
+ */
+uint32_t g_vendorPackets = 0;
+bool g_vendorEndless = false;
+uint32_t g_vendorSequence = 0;
+#endif
+
+#if WATCHDOG_ENABLE
+/**
+ * Stream state in the warm state of watchdog.h, kept over a watchdog reset
+ */
+typedef struct {
+	uint32_t streamSequence;
+	uint32_t streamPackets;
+	uint32_t frameCount;
+	uint16_t frameSequence;
+	uint8_t endless;
+	uint8_t frameChannels;
+} LogicWarmState;
+
+// LogicWarmState.endless
+#define WARM_STREAM_ENDLESS 0x01
+#define WARM_FRAME_ENDLESS 0x02
+
+#define g_logicWarmState (*((__xdata LogicWarmState*) g_WarmState.app))
+#endif
+
+/**
+ * Received command line
+ */
+__xdata char g_commandLine[COMMAND_LINE_LEN];
+uint8_t g_commandLength = 0;
+
+/**
+ * Autostart already done for the current USB configuration
+ */
+bool g_autostartDone = false;
+
 /**
  * Initialize Hardware
  */
 void logicInit() {
+	// Load the configuration before USB is enabled,
+	// so the device enumerates already configured
+	configLoad();
+}
+
+/**
+ * Store the stream state into the warm state
+ */
+void logicSaveWarmState() {
+#if WATCHDOG_ENABLE
+	g_logicWarmState.streamSequence = g_streamSequence;
+	g_logicWarmState.streamPackets = g_streamPackets;
+	g_logicWarmState.endless = (g_streamEndless ? WARM_STREAM_ENDLESS : 0) | (g_frameEndless ? WARM_FRAME_ENDLESS : 0);
+	g_logicWarmState.frameCount = g_frameCount;
+	g_logicWarmState.frameSequence = g_frameSequence;
+	g_logicWarmState.frameChannels = g_frameChannels;
+#endif
+}
+
+/**
+ * Continue the stream after a watchdog reset
+ */
+void logicRestoreWarmState() {
+#if WATCHDOG_ENABLE
+	g_streamSequence = g_logicWarmState.streamSequence;
+	g_streamPackets = g_logicWarmState.streamPackets;
+	g_streamEndless = (g_logicWarmState.endless & WARM_STREAM_ENDLESS) != 0;
+	g_frameEndless = (g_logicWarmState.endless & WARM_FRAME_ENDLESS) != 0;
+	g_frameCount = g_logicWarmState.frameCount;
+	g_frameSequence = g_logicWarmState.frameSequence;
+	g_frameChannels = g_logicWarmState.frameChannels;
+#endif
+}
+
+/**
+ * Start sending
+ *
+ * @param bytes Byte count
+ * @param chunk Packet size
+ * @param pattern PATTERN_*
+ */
+void logicStartSend(uint32_t bytes, uint16_t chunk, uint8_t pattern) {
+	// Clamped before it is narrowed, 300 must not become 44
+	if (chunk == 0 || chunk > USBCDC_TRANSMIT_BUFFER_LEN) {
+		chunk = USBCDC_TRANSMIT_BUFFER_LEN;
+	}
+
+	g_sendChunk = (uint8_t) chunk;
+	g_sendPattern = pattern;
+	g_sendPatternPos = 0;
+	g_sendNewline = false;
+	g_sendBytes = bytes;
+	P3_2 = 0;
+}
+
+/**
+ * Start streaming packets
+ *
+ * @param packets Packet count, 0 = until any byte is received
+ */
+void logicStartStream(uint32_t packets) {
+	LOG_DEBUG("Stream %u packets", packets);
+	g_streamSequence = 0;
+	g_streamPackets = packets;
+	g_streamEndless = (packets == 0);
+	logicSaveWarmState();
+	P3_2 = 0;
+}
+
+/**
+ * Start sending sample frames, with the channels of the configuration
+ *
+ * @param frames Frame count, FRAMES_ENDLESS = until the next F command
+ * @param rate Samples per second, 0 = as fast as possible
+ */
+void logicStartFrames(uint32_t frames, uint16_t rate) {
+	g_frameEndless = (frames == FRAMES_ENDLESS);
+	g_frameSequence = 0;
+	g_frameCount = g_frameEndless ? 0 : frames;
+
+	// Taken at the start, a configuration change does not change the running frames
+	g_frameChannels = g_Config.channelMask;
+	if (g_frameChannels == 0) {
+		g_frameChannels = 0xff;
+	}
+
+	g_framePaced = (rate != 0);
+	if (g_framePaced) {
+		sofPacerStart(&g_framePacer, rate, FRAME_SAMPLES);
+	}
+	logicSaveWarmState();
+	P3_2 = 0;
+}
+
+/**
+ * Fill the next packet, and send it
+ */
+void logicSendPacket() {
+	__xdata uint8_t* buffer;
+	uint8_t length;
+	uint8_t i;
+
+	// Wait for send buffer empty
+	buffer = UsbCdc_beginTransmit();
+	if (buffer == NULL) {
+		// Not connected
+		g_sendBytes = 0;
+		return;
+	}
+
+	length = g_sendChunk;
+	if (g_sendBytes < length) {
+		length = g_sendBytes;
+	}
+
+	for (i = 0; i < length; i++) {
+		if (g_sendPattern == PATTERN_ALPHABET) {
+			buffer[i] = 'A' + g_sendPatternPos;
+			if (++g_sendPatternPos == PATTERN_ALPHABET_LEN) {
+				g_sendPatternPos = 0;
+			}
+		} else if (g_sendPattern == PATTERN_COUNTER) {
+			buffer[i] = g_sendPatternPos++;
+		} else {
+			buffer[i] = 0;
+		}
+	}
+
+	UsbCdc_transmit(length);
+	g_sendBytes -= length;
+
+	if (g_sendBytes == 0 && g_sendNewline) {
+		// To detect end by test script
+		UsbCdc_putc('\n');
+	}
+}
+
+/**
+ * Fill a stream packet, STREAM_PACKET_LEN bytes
+ *
+ * @param buffer Transmit buffer
+ * @param sequence Sequence number
+ */
+void logicFillStreamPacket(__xdata uint8_t* buffer, uint32_t sequence) {
+	uint16_t crc;
+	uint8_t value;
+	uint8_t i;
+
+	// Both little endian
+	*((__xdata uint32_t*) buffer) = sequence;
+
+	value = (uint8_t) sequence;
+	for (i = STREAM_PAYLOAD_OFFSET; i < STREAM_CRC_OFFSET; i++) {
+		buffer[i] = value++;
+	}
+
+	crc = crc16(CRC16_INIT, buffer, STREAM_CRC_OFFSET);
+	buffer[STREAM_CRC_OFFSET] = crc;
+	buffer[STREAM_CRC_OFFSET + 1] = crc >> 8;
+}
+
+/**
+ * Fill the next stream packet, and send it
+ */
+void logicSendStreamPacket() {
+	__xdata uint8_t* buffer;
+
+	buffer = UsbCdc_beginTransmit();
+	if (buffer == NULL) {
+		if (g_UsbCdcTransmitTimeout) {
+			// The packet is lost, the host sees the gap in the sequence numbers
+			g_streamSequence++;
+			if (g_streamPackets) {
+				g_streamPackets--;
+			}
+		} else {
+			// Not connected
+			g_streamPackets = 0;
+			g_streamEndless = false;
+		}
+		logicSaveWarmState();
+		return;
+	}
+
+	logicFillStreamPacket(buffer, g_streamSequence);
+	UsbCdc_transmit(STREAM_PACKET_LEN);
+
+	g_streamSequence++;
+	if (g_streamPackets) {
+		g_streamPackets--;
+	}
+
+	logicSaveWarmState();
+}
+
+#if VENDOR_BULK_ENABLE
+/**
+ * Vendor bulk interface: send the next stream packet, or echo a received packet.
+ * Does not wait, the CDC interface continues while EP3 is busy.
+ */
+void logicVendorLoop() {
+	__xdata uint8_t* received = vendorReceived();
+	__xdata uint8_t* buffer;
+	uint8_t i;
+
+	if (!g_UsbConfig) {
+		g_vendorPackets = 0;
+		g_vendorEndless = false;
+		return;
+	}
+
+	if (received && (g_vendorPackets || g_vendorEndless)) {
+		// Any packet stops the stream
+		g_vendorPackets = 0;
+		g_vendorEndless = false;
+		vendorReceiveDone();
+		return;
+	}
+
+	if (!received && !g_vendorPackets && !g_vendorEndless) {
+		return;
+	}
+
+	buffer = vendorBeginTransmit();
+	if (buffer == NULL) {
+		return;
+	}
+
+	if (received) {
+		for (i = 0; i < g_VendorOutLength; i++) {
+			buffer[i] = received[i];
+		}
+		vendorTransmit(g_VendorOutLength);
+		vendorReceiveDone();
+		return;
+	}
+
+	logicFillStreamPacket(buffer, g_vendorSequence++);
+	vendorTransmit(STREAM_PACKET_LEN);
+
+	if (g_vendorPackets) {
+		g_vendorPackets--;
+	}
+}
+#endif
+
+/**
+ * Add the next sample frame, the frames are sent if the USB packet is full
+ */
+void logicSendSampleFrame() {
+	uint16_t sample;
+	uint8_t channels = 0;
+	uint8_t i;
+
+	for (i = 0; i < FRAME_SAMPLES; i++) {
+		if (g_frameChannels & (1 << i)) {
+			channels++;
+		}
+	}
+
+	if (!Frame_begin(FRAME_TYPE_SAMPLES, 2 + channels * 2)) {
+		if (g_UsbCdcTransmitTimeout) {
+			// The frame is lost, the host sees the gap in the sequence numbers
+			g_frameSequence++;
+			if (g_frameCount) {
+				g_frameCount--;
+			}
+		} else {
+			// Not connected
+			g_frameCount = 0;
+			g_frameEndless = false;
+		}
+		logicSaveWarmState();
+		return;
+	}
+
+	Frame_putU16(g_frameSequence);
+
+	sample = g_frameSequence * FRAME_SAMPLES;
+	for (i = 0; i < FRAME_SAMPLES; i++) {
+		if (g_frameChannels & (1 << i)) {
+			Frame_putU16(sample);
+		}
+		sample++;
+	}
+
+	Frame_end();
+
+	g_frameSequence++;
+	if (g_frameCount) {
+		g_frameCount--;
+	}
+
+	// Paced frames are sent without waiting for the next frame
+	if ((g_frameCount == 0 && !g_frameEndless) || g_framePaced) {
+		Frame_flush();
+	}
+
+	logicSaveWarmState();
+}
+
+/**
+ * Write a decimal number into the transmit buffer
+ *
+ * @param buffer Transmit buffer
+ * @param pos Position in the buffer
+ * @param value Value
+ * @param separator Char written after the number
+ * @return Position after the separator
+ */
+uint8_t logicFormatNumber(__xdata uint8_t* buffer, uint8_t pos, uint32_t value, char separator) {
+	char digits[10];
+	uint8_t i = 0;
+
+	do {
+		digits[i++] = (value % 10) + '0';
+		value /= 10;
+	} while (value > 0);
+
+	while (i) {
+		buffer[pos++] = digits[--i];
+	}
+
+	buffer[pos++] = separator;
+
+	return pos;
+}
+
+/**
+ * Send the result of the receive test: "R <received> <errors>\n"
+ */
+void logicSendReceiveResult() {
+	__xdata uint8_t* buffer = UsbCdc_beginTransmit();
+	uint8_t pos;
+
+	if (buffer == NULL) {
+		return;
+	}
+
+	buffer[0] = 'R';
+	buffer[1] = ' ';
+	pos = logicFormatNumber(buffer, 2, g_receivedCount, ' ');
+	pos = logicFormatNumber(buffer, pos, g_receiveErrors, '\n');
+
+	UsbCdc_transmit(pos);
+}
+
+/**
+ * Answer a ping: "Q <id> <rx ticks> <tx ticks>\n", the tick counter is taken
+ * when the packet was received in the interrupt, and just before sending
+ *
+ * @param id Ping ID
+ */
+void logicSendPing(uint32_t id) {
+	__xdata uint8_t* buffer = UsbCdc_beginTransmit();
+	uint8_t pos;
+
+	if (buffer == NULL) {
+		return;
+	}
+
+	buffer[0] = 'Q';
+	buffer[1] = ' ';
+	pos = logicFormatNumber(buffer, 2, id, ' ');
+	pos = logicFormatNumber(buffer, pos, g_UsbCdcRxTicks, ' ');
+	pos = logicFormatNumber(buffer, pos, timerGetTicks(), '\n');
+
+	UsbCdc_transmit(pos);
+}
+
+/**
+ * Parse the next decimal number of the command line
+ *
+ * @param pos Position in the command line, updated
+ * @return Value, 0 if there is none
+ */
+uint32_t logicParseNumber(uint8_t* pos) {
+	uint32_t value = 0;
+
+	while (*pos < g_commandLength && g_commandLine[*pos] == ' ') {
+		(*pos)++;
+	}
+
+	while (*pos < g_commandLength && g_commandLine[*pos] >= '0' && g_commandLine[*pos] <= '9') {
+		value = value * 10 + (g_commandLine[*pos] - '0');
+		(*pos)++;
+	}
+
+	return value;
+}
+
+/**
+ * Execute the received command line
+ */
+void logicExecuteCommand() {
+	uint8_t pos = 1;
+	uint32_t bytes = logicParseNumber(&pos);
+	uint16_t chunk = logicParseNumber(&pos);
+	uint8_t pattern = logicParseNumber(&pos);
+
+	// Pending frames are in the transmit buffer
+	Frame_flush();
+
+	switch (g_commandLine[0]) {
+	case 'D':
+	case 'R':
+		g_receiveBytes = bytes;
+		g_receivedCount = 0;
+		g_receiveErrors = 0;
+		g_receiveDone = (bytes == 0);
+
+		if (g_commandLine[0] == 'R') {
+			break;
+		}
+
+		// D also sends
+		/* fall through */
+
+	case 'T':
+		logicStartSend(bytes, chunk, pattern);
+		break;
+
+	case 'E':
+		g_echoBytes = bytes;
+		break;
+
+	case 'P':
+		logicStartStream(bytes);
+		break;
+
+	case 'I':
+		// Confirm, the echo starts with the next packet
+		UsbCdc_puts("I\n");
+		UsbCdc_startIsrEcho();
+		break;
+
+	case 'Q':
+		logicSendPing(bytes);
+		break;
+
+	case 'F':
+		// Second number: sample rate
+		logicStartFrames(bytes, chunk);
+		break;
+
+#if WATCHDOG_ENABLE && WATCHDOG_TEST_ENABLE
+	case 'H':
+		// Test the watchdog recovery: busy wait on the timer without kicking
+		// the watchdog, the main loop is not reached again
+		while (1) {
+			timerGetTicks();
+		}
+		break;
+#endif
+
+#if VENDOR_BULK_ENABLE
+	case 'V':
+		LOG_DEBUG("Vendor stream %u packets", bytes);
+		g_vendorSequence = 0;
+		g_vendorPackets = bytes;
+		g_vendorEndless = (bytes == 0);
+		break;
+#endif
+
+#if IAP_ENABLE
+	case 'U':
+		LOG_INFO("Firmware update");
+		UsbCdc_puts("U\n");
+
+		// Wait until the answer was read, the loader does not use the interrupt
+		UsbCdc_beginTransmit();
+		iapRun();
+		break;
+#endif
+
+	default:
+		LOG_WARN("Unknown command %c, length %u", g_commandLine[0], g_commandLength);
+		UsbCdc_puts("?\n");
+		break;
+	}
 }
 
 /**
  * Called from the main loop
  */
 void logicLoop() {
-	if (g_sendBytes) {
-		// Wait for send buffer empty
-		UsbCdc_puts("ABCDEFGHIJKLMNOPQRSTUVWXY");
-		g_sendBytes -= 25;
+	if (!g_UsbConfig) {
+		g_autostartDone = false;
+	} else if (!g_autostartDone) {
+		g_autostartDone = true;
+
+		if (g_WatchdogRecovered) {
+			// Continue the stream which was running before the watchdog reset
+			logicRestoreWarmState();
+			watchdogRecovered();
+		} else if (g_Config.flags & CONFIG_FLAG_AUTOSTART) {
+			// Start streaming without a command from the host
+			if (g_Config.outputFormat == CONFIG_OUTPUT_STREAM) {
+				logicStartStream(0);
+			} else if (g_Config.outputFormat == CONFIG_OUTPUT_FRAMES) {
+				logicStartFrames(FRAMES_ENDLESS, g_Config.sampleRate);
+			} else {
+				logicCharReceived('s');
+			}
+		}
+	}
 
-		if (g_sendBytes == 0) {
-			// To detect end by test script
-			UsbCdc_putc('\n');
+#if VENDOR_BULK_ENABLE
+	logicVendorLoop();
+#endif
+
+	if (g_receiveDone) {
+		g_receiveDone = false;
+		logicSendReceiveResult();
+	}
+
+	if (g_streamPackets || g_streamEndless) {
+		logicSendStreamPacket();
+	} else if (g_sendBytes) {
+		logicSendPacket();
+	} else if (g_frameCount || g_frameEndless) {
+		if (!g_framePaced || sofPacerDue(&g_framePacer)) {
+			logicSendSampleFrame();
 		}
 	} else {
 		P3_2 = 1;
@@ -43,10 +750,51 @@ void logicLoop() {
  * @param c Received char
  */
 void logicCharReceived(char c) {
-	if (c == 's') {
-		// 1 MByte
-		g_sendBytes = 10 * 1000;
-		P3_2 = 0;
+	// Any byte stops the endless stream
+	if (g_streamEndless) {
+		g_streamEndless = false;
+		g_streamPackets = 0;
+		logicSaveWarmState();
+		return;
+	}
+
+	// Data of the R / D command, not a command
+	if (g_receiveBytes) {
+		if ((uint8_t) c != (uint8_t) g_receivedCount) {
+			g_receiveErrors++;
+		}
+
+		g_receivedCount++;
+		g_receiveBytes--;
+		if (g_receiveBytes == 0) {
+			g_receiveDone = true;
+		}
+		return;
+	}
+
+	if (g_echoBytes) {
+		g_echoBytes--;
+		UsbCdc_putc(c);
+		return;
+	}
+
+	if (c == 's' && g_commandLength == 0) {
+		// 10 kByte
+		logicStartSend(10 * 1000, PATTERN_ALPHABET_LEN, PATTERN_ALPHABET);
+		g_sendNewline = true;
+		return;
+	}
+
+	if (c == '\n' || c == '\r') {
+		if (g_commandLength) {
+			logicExecuteCommand();
+			g_commandLength = 0;
+		}
+		return;
+	}
+
+	if (g_commandLength < COMMAND_LINE_LEN) {
+		g_commandLine[g_commandLength++] = c;
 	}
 }
 
@@ -55,6 +803,3 @@ void logicCharReceived(char c) {
  */
 void logicPowerDown() {
 }
-
-
-
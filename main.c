@@ -10,15 +10,15 @@
 #include "logic.h"
 #include "lib/usb-cdc.h"
 #include "lib/timer.h"
+#include "lib/config.h"
+#include "lib/profile.h"
+#include "lib/recorder.h"
+#include "lib/watchdog.h"
+#include "lib/boot.h"
+#include "lib/sof.h"
 
-/**
- * Interrupt needs to be here in the Main file
- * else it simple won't be called.
- */
-void DeviceInterrupt(void) __interrupt(INT_NO_USB) {
-	usbInterrupt();
-}
-
+// The USB interrupt is implemented in lib/usb-cdc.c, the prototype
+// in usb-cdc.h needs to be included here, else it simple won't be called.
 
 /**
  * Timer 0 interrupt
@@ -35,21 +35,41 @@ void main() {
 	// CH55x clock selection configuration
 	ConfigureSystemClock();
 
-	// Modify the main frequency and wait for the internal crystal to stabilize.
-	delay_ms(5);
-
-	// Initialize timer
+	// Initialize timer, directly after the clock switch, the ticks are the boot time reference
 	timerSetup();
 
-	// Initialize Hardware
+	// Watchdog, checks the warm state after a watchdog reset
+	watchdogSetup();
+
+	BOOT_PHASE(BOOT_PHASE_INIT);
+
+	// The internal oscillator needs a few ms after the clock switch, only the time not
+	// already used by the init above is waited. The data flash is not accessed before
+	clockWaitStable();
+
+	BOOT_PHASE(BOOT_PHASE_CLOCK);
+
+	// Flight recorder, needs the timer for the timestamps, restores the snapshot from the data flash
+	recorderInit();
+
+	// Initialize Hardware, loads the persisted configuration from the data flash
 	logicInit();
 
-	// Enable USB Port
+	// Enable USB Port, the pull-up is enabled first: the host waits at least
+	// 100 ms debounce time before the bus reset, the rest of the init runs in this time
 	USBDeviceCfg();
 
+	BOOT_PHASE(BOOT_PHASE_PULLUP);
+
 	// Endpoint configuration
 	USBDeviceEndPointCfg();
 
+	// USB / Timer priorities, before the interrupts get enabled
+	interruptPrioritySetup();
+
+	// SOF timebase, if enabled, before the USB interrupt
+	sofSetup();
+
 	// Interrupt initialization
 	USBDeviceIntCfg();
 
@@ -57,11 +77,37 @@ void main() {
 	UEP0_T_LEN = 0;
 	UEP1_T_LEN = 0;
 	UEP2_T_LEN = 0;
+#if VENDOR_BULK_ENABLE
+	UEP3_T_LEN = 0;
+#endif
+
+	BOOT_PHASE(BOOT_PHASE_USB_READY);
+
+	// Deferred init, not needed for the enumeration
+	WATCHDOG_KICK();
+
+	// Data flash snapshot of the flight recorder after a watchdog reset
+	recorderInitDeferred();
+
+	// Timer 2 as cycle counter, if profiling is enabled
+	profileSetup();
+
+	BOOT_PHASE(BOOT_PHASE_DEFERRED);
 
 	// Main Loop
 	while(1) {
+		WATCHDOG_KICK();
+
 		UsbCdc_processInput();
 
 		logicLoop();
+
+		// Drift of the timer against the USB frames
+		sofLoop();
+
+		// Persist configuration changes made by the host
+		configProcess();
+
+		profileLoop();
 	}
 }
@@ -0,0 +1,437 @@
+/**
+ * Host simulation: runs the firmware as coroutine, simulates the timers
+ * and calls the interrupt handlers
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include <ucontext.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "../lib/usb-cdc.h"
+
+/**
+ * Stack size of the firmware coroutine
+ */
+#define SIM_STACK_SIZE (256 * 1024)
+
+/**
+ * Simulated time of one main loop iteration
+ */
+#define SIM_LOOP_NS 1000
+
+/**
+ * Statistics of the simulation
+ */
+SimStats g_SimStats;
+
+/**
+ * Firmware jumped to the bootloader
+ */
+bool g_SimBootloader = false;
+
+/**
+ * The watchdog timer overflowed, the firmware is stopped until simReset()
+ */
+bool g_SimWatchdogReset = false;
+
+/**
+ * The firmware triggered a software reset, the firmware is stopped until simReset()
+ */
+bool g_SimSoftwareReset = false;
+
+/**
+ * Context of the simulated host
+ */
+ucontext_t g_SimHostContext;
+
+/**
+ * Context of the firmware
+ */
+ucontext_t g_SimFirmwareContext;
+
+/**
+ * Return point, if the bootloader is entered from an interrupt handler
+ */
+jmp_buf g_SimInterruptReturn;
+
+/**
+ * An interrupt handler is running
+ */
+bool g_SimInInterrupt = false;
+
+/**
+ * Remaining nanoseconds, not yet counted by Timer 0 / 2
+ */
+uint64_t g_SimTimer0Rest = 0;
+uint64_t g_SimTimer2Rest = 0;
+
+/**
+ * Remaining nanoseconds, not yet counted by the watchdog
+ */
+uint64_t g_SimWatchdogRest = 0;
+
+/**
+ * Simulated duration of one USB interrupt, 0: the interrupt takes no time
+ */
+uint32_t g_SimUsbIsrNs = 0;
+
+/**
+ * Simulated time of the Timer 0 overflow, valid while TF0 is set
+ */
+uint64_t g_SimTimer0OverflowNs = 0;
+
+/**
+ * Variables of the firmware, see FIRMWARE_SECTIONS in the Makefile
+ */
+extern uint8_t __start_sim_firmware_data[];
+extern uint8_t __stop_sim_firmware_data[];
+extern uint8_t __start_sim_firmware_bss[];
+extern uint8_t __stop_sim_firmware_bss[];
+
+/**
+ * Initial values of the firmware variables, copied on the first boot
+ */
+uint8_t* g_SimFirmwareData = NULL;
+
+/**
+ * The firmware coroutine is running, and not an interrupt handler
+ */
+bool g_SimInFirmware = false;
+
+/**
+ * Give control back to the simulated USB host
+ */
+void simYield() {
+	swapcontext(&g_SimFirmwareContext, &g_SimHostContext);
+}
+
+/**
+ * Switch to the firmware, until it yields
+ */
+static void simResume() {
+	g_SimInFirmware = true;
+	swapcontext(&g_SimHostContext, &g_SimFirmwareContext);
+	g_SimInFirmware = false;
+}
+
+/**
+ * Mock of the registers the firmware polls (TF0, WDOG_COUNT), see include/8051.h:
+ * an access of the firmware yields, so the host runs and the time advances
+ *
+ * @param reg Register variable
+ * @return reg
+ */
+volatile uint8_t* simPoll(volatile uint8_t* reg) {
+	if (g_SimInFirmware) {
+		simYield();
+	}
+
+	return reg;
+}
+
+/**
+ * Mock of the LJMP instruction, see include/compiler.h, the only
+ * jump target is the bootloader, the firmware is stopped
+ *
+ * @param addr Code address
+ */
+void simLongJump(uint16_t addr) {
+	(void) addr;
+	g_SimBootloader = true;
+
+	// The interrupt handlers run on the host stack, leave the handler
+	if (g_SimInInterrupt) {
+		longjmp(g_SimInterruptReturn, 1);
+	}
+
+	// Never return to the firmware
+	while (1) {
+		simYield();
+	}
+}
+
+/**
+ * Mock of the software reset bit, see include/8051.h, the firmware is stopped
+ */
+void simSoftwareReset() {
+	g_SimSoftwareReset = true;
+
+	while (1) {
+		simYield();
+	}
+}
+
+/**
+ * Start the firmware, returns on its first poll, see simPoll()
+ */
+void simBoot() {
+	if (g_SimFirmwareData == NULL) {
+		g_SimFirmwareData = malloc(__stop_sim_firmware_data - __start_sim_firmware_data);
+		memcpy(g_SimFirmwareData, __start_sim_firmware_data, __stop_sim_firmware_data - __start_sim_firmware_data);
+	}
+
+	// The simulated flash accepts all addresses
+	ROM_CTRL = bROM_ADDR_OK;
+
+	getcontext(&g_SimFirmwareContext);
+	g_SimFirmwareContext.uc_stack.ss_sp = malloc(SIM_STACK_SIZE);
+	g_SimFirmwareContext.uc_stack.ss_size = SIM_STACK_SIZE;
+	g_SimFirmwareContext.uc_link = NULL;
+	makecontext(&g_SimFirmwareContext, firmwareMain, 0);
+
+	simResume();
+}
+
+/**
+ * Reset the chip and start the firmware again, the XRAM content is kept
+ *
+ * @param resetFlags RST_FLAG_*, read by the firmware from PCON
+ */
+void simReset(uint8_t resetFlags) {
+	g_SimBootloader = false;
+	g_SimWatchdogReset = false;
+	g_SimSoftwareReset = false;
+	g_SimWatchdogRest = 0;
+
+	PCON = (PCON & ~MASK_RST_FLAG) | resetFlags;
+	GLOBAL_CFG = 0;
+	EA = 0;
+	UIF_TRANSFER = 0;
+	UIF_BUS_RST = 0;
+	UIF_SUSPEND = 0;
+
+	// Startup code
+	memcpy(__start_sim_firmware_data, g_SimFirmwareData, __stop_sim_firmware_data - __start_sim_firmware_data);
+	memset(__start_sim_firmware_bss, 0, __stop_sim_firmware_bss - __start_sim_firmware_bss);
+
+	simBoot();
+}
+
+/**
+ * Run the firmware main loop
+ *
+ * @param iterations Count of firmware polls, see simPoll()
+ */
+void simRun(uint32_t iterations) {
+	while (iterations-- && !g_SimBootloader && !g_SimWatchdogReset && !g_SimSoftwareReset) {
+		g_SimStats.loopCount++;
+		simResume();
+
+		simAdvance(SIM_LOOP_NS);
+		simDispatch();
+	}
+}
+
+/**
+ * Count Timer 0, 16 bit mode 1
+ *
+ * @param ticks Timer ticks
+ */
+void simCountTimer0(uint64_t ticks) {
+	uint32_t count = ((uint32_t) TH0 << 8) | TL0;
+
+	count += ticks;
+	if (count > 0xffff) {
+		// Mode 1 has no reload
+		TF0 = 1;
+	}
+
+	TL0 = count & 0xff;
+	TH0 = (count >> 8) & 0xff;
+}
+
+/**
+ * Count Timer 2, auto reload from RCAP2
+ *
+ * @param ticks Timer ticks
+ */
+void simCountTimer2(uint64_t ticks) {
+	uint32_t count = ((uint32_t) TH2 << 8) | TL2;
+	uint32_t reload = ((uint32_t) RCAP2H << 8) | RCAP2L;
+
+	while (ticks) {
+		uint32_t step = 0x10000 - count;
+		if (step > ticks) {
+			count += ticks;
+			break;
+		}
+
+		ticks -= step;
+		count = reload;
+		TF2 = 1;
+	}
+
+	TL2 = count & 0xff;
+	TH2 = (count >> 8) & 0xff;
+}
+
+/**
+ * Advance the simulated time, updates the timers
+ *
+ * @param ns Nanoseconds
+ */
+void simAdvance(uint32_t ns) {
+	uint64_t ticks;
+	bool pending;
+
+	g_SimStats.timeNs += ns;
+
+	if (TR0) {
+		// Fsys / 12, or Fsys / 4, Fsys
+		uint64_t freq = FREQ_SYS / 12;
+		if (T2MOD & bT0_CLK) {
+			freq = (T2MOD & bTMR_CLK) ? FREQ_SYS : FREQ_SYS / 4;
+		}
+
+		g_SimTimer0Rest += ns * freq;
+		ticks = g_SimTimer0Rest / 1000000000ULL;
+		g_SimTimer0Rest -= ticks * 1000000000ULL;
+
+		pending = TF0;
+		simCountTimer0(ticks);
+
+		// Mode 1 counts on from 0, the count is the time since the overflow
+		if (TF0 && !pending) {
+			g_SimTimer0OverflowNs = g_SimStats.timeNs - (((uint64_t) TH0 << 8) | TL0) * 1000000000ULL / freq;
+		}
+	}
+
+	if (TR2) {
+		uint64_t freq = FREQ_SYS / 12;
+		if (T2MOD & bT2_CLK) {
+			freq = (T2MOD & bTMR_CLK) ? FREQ_SYS : FREQ_SYS / 4;
+		}
+
+		g_SimTimer2Rest += ns * freq;
+		ticks = g_SimTimer2Rest / 1000000000ULL;
+		g_SimTimer2Rest -= ticks * 1000000000ULL;
+		simCountTimer2(ticks);
+	}
+
+	// Fsys / 65536, always counting, resets only if enabled
+	g_SimWatchdogRest += (uint64_t) ns * (FREQ_SYS / 1000);
+	ticks = g_SimWatchdogRest / (65536ULL * 1000000ULL);
+	g_SimWatchdogRest -= ticks * 65536ULL * 1000000ULL;
+	if (WDOG_COUNT + ticks > 0xff && (GLOBAL_CFG & bWDOG_EN)) {
+		g_SimWatchdogReset = true;
+	}
+	WDOG_COUNT += ticks;
+}
+
+/**
+ * Current host time
+ *
+ * @return Nanoseconds
+ */
+uint64_t simHostNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Call the Timer 0 interrupt handler, and count the latency from the overflow
+ */
+static void simTimer0Interrupt() {
+	uint64_t latency = g_SimStats.timeNs - g_SimTimer0OverflowNs;
+
+	g_SimStats.timerCount++;
+	g_SimStats.timerLatencyNs += latency;
+	if (latency > g_SimStats.timerLatencyMaxNs) {
+		g_SimStats.timerLatencyMaxNs = latency;
+	}
+
+	// Cleared by hardware on entry
+	TF0 = 0;
+	timer0();
+}
+
+/**
+ * Call the pending interrupt handlers, if interrupts are enabled.
+ *
+ * The priorities PT0 / IP_EX are applied: a high priority USB interrupt is served before
+ * a pending timer interrupt, a high priority timer interrupt preempts the USB interrupt
+ * while it runs for g_SimUsbIsrNs. With the same priority the timer is served first.
+ */
+void simDispatch() {
+	uint8_t i;
+	uint32_t ns;
+	uint32_t step;
+	uint64_t start;
+	uint64_t duration;
+	bool usbFirst = (IP_EX & bIP_USB) && !PT0;
+	bool timerPreempts = PT0 && !(IP_EX & bIP_USB);
+
+	if (!EA || g_SimBootloader || g_SimWatchdogReset || g_SimSoftwareReset) {
+		return;
+	}
+
+	if (ET0 && TF0 && !usbFirst) {
+		simTimer0Interrupt();
+	}
+
+	// The interrupt handles one flag per call
+	for (i = 0; i < 8 && IE_USB && (UIF_TRANSFER || UIF_BUS_RST || UIF_SUSPEND); i++) {
+		start = simHostNs();
+
+		g_SimInInterrupt = true;
+		if (setjmp(g_SimInterruptReturn) == 0) {
+			usbInterrupt();
+		}
+		g_SimInInterrupt = false;
+
+		if (g_SimBootloader) {
+			return;
+		}
+
+		duration = simHostNs() - start;
+
+		g_SimStats.isrCount++;
+		g_SimStats.isrNs += duration;
+		if (duration > g_SimStats.isrMaxNs) {
+			g_SimStats.isrMaxNs = duration;
+		}
+
+		for (ns = 0; ns < g_SimUsbIsrNs; ns += step) {
+			step = g_SimUsbIsrNs - ns < SIM_LOOP_NS ? g_SimUsbIsrNs - ns : SIM_LOOP_NS;
+			simAdvance(step);
+
+			if (timerPreempts && ET0 && TF0) {
+				simTimer0Interrupt();
+			}
+		}
+
+		if (ET0 && TF0 && !usbFirst) {
+			simTimer0Interrupt();
+		}
+	}
+
+	if (ET0 && TF0) {
+		simTimer0Interrupt();
+	}
+}
+
+/**
+ * Advance the simulated time of a bus transfer, the CPU serves the Timer 0 interrupt meanwhile
+ *
+ * @param ns Nanoseconds
+ */
+void simBusTime(uint32_t ns) {
+	uint32_t step;
+
+	while (ns) {
+		step = ns < SIM_LOOP_NS ? ns : SIM_LOOP_NS;
+		simAdvance(step);
+		ns -= step;
+
+		if (EA && ET0 && TF0 && !g_SimBootloader && !g_SimWatchdogReset && !g_SimSoftwareReset) {
+			simTimer0Interrupt();
+		}
+	}
+}
@@ -0,0 +1,84 @@
+/**
+ * Host simulation: data flash, replaces lib/dataflash.c, and code flash,
+ * the flash registers can't be simulated with plain variables
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include "../lib/dataflash.h"
+#include "sim.h"
+
+/**
+ * Data flash content, 128 bytes, erased state
+ */
+uint8_t g_SimDataFlash[SIM_DATA_FLASH_SIZE];
+
+/**
+ * Count of written bytes
+ */
+uint32_t g_SimDataFlashWrites = 0;
+
+/**
+ * Code flash content, erased state
+ */
+uint8_t g_SimCodeFlash[SIM_CODE_FLASH_SIZE];
+
+/**
+ * Program a word of the code flash
+ *
+ * @param addr Even address
+ * @param value Little endian
+ */
+void simCodeFlashWrite(uint16_t addr, uint16_t value) {
+	if (addr + 1 < SIM_CODE_FLASH_SIZE) {
+		g_SimCodeFlash[addr & ~1] = value & 0xff;
+		g_SimCodeFlash[(addr & ~1) + 1] = value >> 8;
+	}
+}
+
+/**
+ * Read a byte of the code flash
+ */
+uint8_t simCodeFlashRead(uint16_t addr) {
+	return addr < SIM_CODE_FLASH_SIZE ? g_SimCodeFlash[addr] : 0xff;
+}
+
+/**
+ * Write data flash (EEPROM)
+ *
+ * @param addr Address to write, 0 ... 127
+ * @param buf Buffer to write
+ * @param len Length in bytes
+ *
+ * @return Bytes written
+ */
+uint8_t WriteDataFlash(uint8_t addr, uint8_t* buf, uint8_t len) {
+	uint8_t i;
+
+	for (i = 0; i < len && addr + i < SIM_DATA_FLASH_SIZE; i++) {
+		g_SimDataFlash[addr + i] = buf[i];
+		g_SimDataFlashWrites++;
+	}
+
+	return i;
+}
+
+/**
+ * Read data flash (EEPROM)
+ *
+ * @param addr Address to write, 0 ... 127
+ * @param buf Buffer to put read data to
+ * @param len Length in bytes
+ *
+ * @return Bytes read
+ */
+uint8_t ReadDataFlash(uint8_t addr, uint8_t len, uint8_t* buf) {
+	uint8_t i;
+
+	for (i = 0; i < len && addr + i < SIM_DATA_FLASH_SIZE; i++) {
+		buf[i] = g_SimDataFlash[addr + i];
+	}
+
+	return i;
+}
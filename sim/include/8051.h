@@ -0,0 +1,55 @@
+/**
+ * Host simulation: replaces the SDCC 8051.h, only the port bits
+ * are needed, all other registers are declared in ch554.h
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "compiler.h"
+
+SBIT(P1_0, 0x90, 0);
+SBIT(P1_1, 0x90, 1);
+SBIT(P1_2, 0x90, 2);
+SBIT(P1_3, 0x90, 3);
+SBIT(P1_4, 0x90, 4);
+SBIT(P1_5, 0x90, 5);
+SBIT(P1_6, 0x90, 6);
+SBIT(P1_7, 0x90, 7);
+
+SBIT(P3_0, 0xB0, 0);
+SBIT(P3_1, 0xB0, 1);
+SBIT(P3_2, 0xB0, 2);
+SBIT(P3_3, 0xB0, 3);
+SBIT(P3_4, 0xB0, 4);
+SBIT(P3_5, 0xB0, 5);
+SBIT(P3_6, 0xB0, 6);
+SBIT(P3_7, 0xB0, 7);
+
+// The firmware waits in busy loops for the USB host and the timers, the loops
+// read the timer or kick the watchdog: these accesses give control back to the
+// simulated host, see simPoll(). Defined after the SFR declarations in ch554.h.
+volatile uint8_t* simPoll(volatile uint8_t* reg);
+
+#define TF0 (*simPoll(&TF0))
+#define WDOG_COUNT (*simPoll(&WDOG_COUNT))
+
+// Code flash write, ROM_STATUS is the same variable as ROM_CTRL,
+// the command leaves the status "address valid"
+void simCodeFlashWrite(uint16_t addr, uint16_t value);
+
+#undef ROM_CMD_WRITE
+#define ROM_CMD_WRITE (simCodeFlashWrite(ROM_ADDR, ROM_DATA), bROM_ADDR_OK)
+
+// Code flash read, the loader verifies the written image, see lib/iap.h
+uint8_t simCodeFlashRead(uint16_t addr);
+
+#define CODE_FLASH_READ(addr) simCodeFlashRead(addr)
+
+// Software reset, the firmware is stopped when setting the bit
+void simSoftwareReset();
+
+#undef bSW_RESET
+#define bSW_RESET (simSoftwareReset(), 0x10)
@@ -0,0 +1,47 @@
+/**
+ * Host simulation: replaces the SDCC compiler.h, SFRs are plain
+ * variables, defined once in sim/sfr.c, the SDCC keywords are removed.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// SDCC does not align, the structures sent over USB (DeviceConfig, UsbStats...)
+// need the same layout. System headers must be included before this file.
+#pragma pack(1)
+
+#define __xdata
+#define __data
+#define __idata
+#define __code
+
+// Variables at a fixed address are outside of the range the startup code initializes,
+// they keep the content over simReset()
+#define __at(x) __attribute__((section("sim_noinit")))
+#define __interrupt(x)
+#define __using(x)
+
+// The only inline assembler of the firmware is the jump to the bootloader,
+// "__asm LJMP addr __endasm;" calls simLongJump(addr)
+void simLongJump(uint16_t addr);
+
+#define __asm {
+#define LJMP simLongJump(
+#define __endasm );}
+
+#ifdef SIM_DEFINE_SFR
+#define SIM_SFR_STORAGE
+#else
+#define SIM_SFR_STORAGE extern
+#endif
+
+#define SFR(name, addr) SIM_SFR_STORAGE volatile uint8_t name
+#define SFR16(name, addr) SIM_SFR_STORAGE volatile uint16_t name
+
+// Bits are independent variables, the simulated SIE keeps the
+// bits the firmware reads (UIF_*, U_TOG_OK, U_IS_NAK) up to date
+#define SBIT(name, addr, bit) SIM_SFR_STORAGE volatile uint8_t name
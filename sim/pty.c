@@ -0,0 +1,359 @@
+/**
+ * Host simulation: runs the firmware and exposes the CDC port as
+ * pseudo terminal, so the test-tools run unchanged without a board.
+ *
+ * Control requests (vendor requests, line coding) are forwarded from a unix socket,
+ * used by test-tools/usbdevice.py if CH55X_SIM_SOCKET is set. Protocol per request:
+ *   Host -> sim: 8 byte SETUP packet, followed by wLength bytes for OUT requests
+ *   Sim -> host: int16 little endian length of the data stage, -1 on STALL,
+ *                followed by the data for IN requests
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sim.h"
+
+/**
+ * Main loop iterations without any transfer, before the runner sleeps
+ */
+#define SIM_IDLE_ITERATIONS 1000
+
+/**
+ * Pseudo terminal master
+ */
+int g_PtyMaster = -1;
+
+/**
+ * Listening control socket
+ */
+int g_ControlSocket = -1;
+
+/**
+ * Connected control client
+ */
+int g_ControlClient = -1;
+
+/**
+ * Data from the pseudo terminal, not yet accepted by the firmware
+ */
+uint8_t g_OutBuffer[MAX_PACKET_SIZE];
+uint8_t g_OutLength = 0;
+
+/**
+ * Data from the firmware, not yet written to the pseudo terminal
+ */
+uint8_t g_InBuffer[MAX_PACKET_SIZE];
+uint8_t g_InLength = 0;
+uint8_t g_InPos = 0;
+
+/**
+ * Create the pseudo terminal, in raw mode
+ *
+ * @param link Symlink to create to the slave, or NULL
+ * @return true on success
+ */
+bool ptyOpen(const char* link) {
+	struct termios tio;
+	const char* slave;
+	int fd;
+
+	g_PtyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+	if (g_PtyMaster < 0 || grantpt(g_PtyMaster) != 0 || unlockpt(g_PtyMaster) != 0) {
+		perror("posix_openpt");
+		return false;
+	}
+
+	slave = ptsname(g_PtyMaster);
+
+	// The slave side decides about the line discipline, no echo, no newline translation.
+	// The slave is kept open, else reading the master returns EIO while no client is connected
+	fd = open(slave, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(slave);
+		return false;
+	}
+
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+
+	fcntl(g_PtyMaster, F_SETFL, fcntl(g_PtyMaster, F_GETFL) | O_NONBLOCK);
+
+	if (link) {
+		unlink(link);
+		if (symlink(slave, link) != 0) {
+			perror(link);
+			return false;
+		}
+		printf("CDC port: %s -> %s\n", link, slave);
+	} else {
+		printf("CDC port: %s\n", slave);
+	}
+
+	return true;
+}
+
+/**
+ * Create the control socket
+ *
+ * @param path Socket path
+ * @return true on success
+ */
+bool controlOpen(const char* path) {
+	struct sockaddr_un addr;
+
+	g_ControlSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (g_ControlSocket < 0) {
+		perror("socket");
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	unlink(path);
+	if (bind(g_ControlSocket, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(g_ControlSocket, 1) != 0) {
+		perror(path);
+		return false;
+	}
+
+	fcntl(g_ControlSocket, F_SETFL, fcntl(g_ControlSocket, F_GETFL) | O_NONBLOCK);
+
+	printf("Control socket: %s (export CH55X_SIM_SOCKET=%s)\n", path, path);
+
+	return true;
+}
+
+/**
+ * Read exactly len bytes
+ *
+ * @return true on success
+ */
+bool readFully(int fd, uint8_t* data, uint16_t len) {
+	ssize_t r;
+
+	while (len) {
+		r = read(fd, data, len);
+		if (r <= 0) {
+			return false;
+		}
+
+		data += r;
+		len -= r;
+	}
+
+	return true;
+}
+
+/**
+ * Handle one control request of the connected client
+ *
+ * @return false if the client disconnected
+ */
+bool controlRequest(int fd) {
+	uint8_t setup[8];
+	uint8_t data[1024];
+	uint16_t length;
+	int16_t result;
+
+	if (!readFully(fd, setup, sizeof(setup))) {
+		return false;
+	}
+
+	length = setup[6] | (setup[7] << 8);
+	if (length > sizeof(data)) {
+		length = sizeof(data);
+	}
+
+	if (!(setup[0] & USB_REQ_TYP_IN) && !readFully(fd, data, length)) {
+		return false;
+	}
+
+	result = simControl(setup[0], setup[1], setup[2] | (setup[3] << 8),
+			setup[4] | (setup[5] << 8), length, data);
+
+	if (write(fd, &result, sizeof(result)) != sizeof(result)) {
+		return false;
+	}
+
+	if (result > 0 && (setup[0] & USB_REQ_TYP_IN)) {
+		if (write(fd, data, result) != result) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Accept a control client, and handle its requests, one per call,
+ * so the firmware main loop keeps running while the client is connected
+ *
+ * @return true if a request was handled
+ */
+bool pumpControl() {
+	struct pollfd fds;
+
+	if (g_ControlClient < 0) {
+		g_ControlClient = accept(g_ControlSocket, NULL, NULL);
+		if (g_ControlClient < 0) {
+			return false;
+		}
+
+		// Requests are read blocking, the client sends them at once
+		fcntl(g_ControlClient, F_SETFL, fcntl(g_ControlClient, F_GETFL) & ~O_NONBLOCK);
+	}
+
+	fds.fd = g_ControlClient;
+	fds.events = POLLIN;
+	if (poll(&fds, 1, 0) <= 0) {
+		return false;
+	}
+
+	if (!controlRequest(g_ControlClient)) {
+		close(g_ControlClient);
+		g_ControlClient = -1;
+	}
+
+	return true;
+}
+
+/**
+ * Move data between the pseudo terminal and the CDC endpoints
+ *
+ * @return true if data was transferred
+ */
+bool pumpData() {
+	bool active = false;
+	ssize_t r;
+
+	if (g_OutLength == 0) {
+		r = read(g_PtyMaster, g_OutBuffer, sizeof(g_OutBuffer));
+		if (r > 0) {
+			g_OutLength = r;
+		}
+	}
+
+	// Only if the firmware ACKs, else try again after the next main loop iteration
+	if (g_OutLength && simOut(2, g_OutBuffer, g_OutLength) == SIM_ACK) {
+		g_OutLength = 0;
+		active = true;
+	}
+
+	// No new IN token until the terminal took the last packet, like a host with full buffers
+	if (g_InPos == g_InLength) {
+		g_InPos = 0;
+		g_InLength = simBulkRead(g_InBuffer);
+	}
+
+	if (g_InPos < g_InLength) {
+		r = write(g_PtyMaster, g_InBuffer + g_InPos, g_InLength - g_InPos);
+		if (r > 0) {
+			g_InPos += r;
+			active = true;
+		}
+	}
+
+	return active;
+}
+
+/**
+ * Run the firmware, until it jumps to the bootloader
+ *
+ * sim-pty [-l link] [-s socket]
+ */
+int main(int argc, char** argv) {
+	const char* link = NULL;
+	const char* socketPath = "/tmp/ch55x-sim.sock";
+	uint32_t idle = 0;
+	uint64_t start;
+	struct pollfd fds[3];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:s:")) != -1) {
+		switch (opt) {
+		case 'l':
+			link = optarg;
+			break;
+		case 's':
+			socketPath = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-l link] [-s socket]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Erased data flash
+	memset(g_SimDataFlash, 0xff, SIM_DATA_FLASH_SIZE);
+	memset(g_SimCodeFlash, 0xff, SIM_CODE_FLASH_SIZE);
+
+	if (!ptyOpen(link) || !controlOpen(socketPath)) {
+		return 1;
+	}
+
+	simBoot();
+	if (!simEnumerate()) {
+		fprintf(stderr, "Enumeration failed\n");
+		return 1;
+	}
+
+	printf("Device enumerated\n");
+	fflush(stdout);
+
+	while (!g_SimBootloader) {
+		simRun(1);
+
+		if (g_SimWatchdogReset || g_SimSoftwareReset) {
+			// The host sees a disconnect, and enumerates the device again
+			printf(g_SimWatchdogReset ? "Watchdog reset\n" : "Software reset\n");
+			fflush(stdout);
+
+			simReset(g_SimWatchdogReset ? RST_FLAG_WDOG : RST_FLAG_SW);
+			if (!simEnumerate()) {
+				fprintf(stderr, "Enumeration failed\n");
+				return 1;
+			}
+			continue;
+		}
+
+		if (pumpControl() | pumpData()) {
+			idle = 0;
+		} else if (++idle > SIM_IDLE_ITERATIONS) {
+			// Nothing to do, wait for the terminal or a control client
+			fds[0].fd = g_PtyMaster;
+			fds[0].events = POLLIN;
+			fds[1].fd = g_ControlSocket;
+			fds[1].events = POLLIN;
+			fds[2].fd = g_ControlClient;
+			fds[2].events = POLLIN;
+			start = simHostNs();
+			poll(fds, g_ControlClient < 0 ? 2 : 3, 10);
+
+			// The simulated time follows the host time while waiting, so the timers
+			// and the watchdog keep running
+			simAdvance(simHostNs() - start);
+		}
+	}
+
+	printf("Device jumped to the bootloader\n");
+	unlink(socketPath);
+	if (link) {
+		unlink(link);
+	}
+
+	return 0;
+}
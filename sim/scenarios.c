@@ -0,0 +1,1190 @@
+/**
+ * Host simulation: test scenarios, each runs in an own process,
+ * so the firmware state is fresh for each scenario
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+#include "../lib/config.h"
+#include "../lib/usb-stats.h"
+#include "../lib/usb-cdc.h"
+#include "../lib/crc.h"
+#include "../lib/frame.h"
+#include "../lib/recorder.h"
+#include "../lib/watchdog.h"
+#include "../lib/boot.h"
+#include "../lib/hardware.h"
+#include "../lib/iap.h"
+#include "../lib/vendor.h"
+#include "../lib/timer.h"
+#include "../lib/sof.h"
+
+// CDC / vendor requests, see lib/usb-cdc.c
+#define SET_LINE_CODING 0x20
+#define GET_LINE_CODING 0x21
+#define SET_CONTROL_LINE_STATE 0x22
+#define RESET_DEVICE_TO_BOOTLOADER 0x65
+#define GET_DEVICE_CONFIG 0x66
+#define GET_USB_STATS 0x69
+#define GET_RECORDER 0x6A
+#define GET_WATCHDOG 0x6B
+#define GET_BOOT_TIMES 0x6C
+#define GET_CLOCK 0x6D
+
+/**
+ * Main loop iterations to give the firmware after a change
+ */
+#define SIM_SETTLE 100
+
+/**
+ * Check a condition, exit the scenario on failure
+ */
+#define SIM_CHECK(condition) if (!(condition)) { \
+	printf("    FAILED: %s, line %i\n", #condition, __LINE__); \
+	return false; \
+}
+
+extern UsbStats g_UsbStats;
+
+/**
+ * Boot the firmware and enumerate
+ */
+bool scenarioEnumerate() {
+	uint8_t data[64];
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+	simRun(SIM_SETTLE);
+
+	// The default line coding is 57600 8N1
+	SIM_CHECK(simControl(0xA1, GET_LINE_CODING, 0, 0, 7, data) == 7);
+	SIM_CHECK(data[0] == 0x00 && data[1] == 0xe1 && data[2] == 0x00 && data[6] == 8);
+
+	return true;
+}
+
+/**
+ * The line coding is persisted, but only written if changed
+ */
+bool scenarioLineCoding() {
+	uint8_t lineCoding[7] = { 0x00, 0xc2, 0x01, 0x00, 0x00, 0x00, 0x08 };
+	uint8_t data[64];
+	uint32_t writes;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simControl(0x21, SET_LINE_CODING, 0, 0, 7, lineCoding) == 7);
+	simRun(SIM_SETTLE);
+
+	SIM_CHECK(simControl(0xA1, GET_LINE_CODING, 0, 0, 7, data) == 7);
+	SIM_CHECK(memcmp(data, lineCoding, 7) == 0);
+
+	// Written to the data flash by the main loop
+	SIM_CHECK(g_SimDataFlashWrites == sizeof(DeviceConfig));
+	SIM_CHECK(memcmp(g_SimDataFlash + CONFIG_FLASH_ADDR + 2, lineCoding, 7) == 0);
+
+	// The host sets the same line coding on each open, this must not wear the flash
+	writes = g_SimDataFlashWrites;
+	SIM_CHECK(simControl(0x21, SET_LINE_CODING, 0, 0, 7, lineCoding) == 7);
+	simRun(SIM_SETTLE);
+	SIM_CHECK(g_SimDataFlashWrites == writes);
+
+	return true;
+}
+
+/**
+ * Autostart flag in the data flash starts streaming without a command
+ */
+bool scenarioAutostart() {
+	uint8_t data[64];
+	uint32_t received = 0;
+	uint32_t i;
+
+	// Erased data flash: defaults
+	configLoad();
+	g_Config.flags |= CONFIG_FLAG_AUTOSTART;
+	configSave();
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	for (i = 0; i < 100000 && received < 64; i++) {
+		simRun(1);
+		received += simBulkRead(data);
+	}
+
+	SIM_CHECK(received >= 64);
+	SIM_CHECK(data[0] == 'A');
+
+	return true;
+}
+
+/**
+ * Speedtest command, the same as test-tools/serial-speedtest.py
+ */
+bool scenarioStreaming() {
+	uint8_t data[64];
+	uint32_t received = 0;
+	uint8_t len;
+	uint32_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "s", 1) == 1);
+
+	for (i = 0; i < 1000000; i++) {
+		simRun(1);
+		len = simBulkRead(data);
+		received += len;
+
+		if (len && data[len - 1] == '\n') {
+			break;
+		}
+	}
+
+	// 10000 bytes and a newline
+	SIM_CHECK(received == 10001);
+	SIM_CHECK(g_SimStats.toggleErrors == 0);
+
+	printf("    %u bytes in %.2f ms simulated time\n", received, g_SimStats.timeNs / 1000000.0);
+
+	return true;
+}
+
+/**
+ * Read from the CDC bulk IN endpoint, until len bytes are received
+ *
+ * @return Bytes read
+ */
+uint32_t simReadBytes(uint8_t* data, uint32_t len) {
+	uint8_t packet[64];
+	uint32_t received = 0;
+	uint8_t packetLen;
+	uint32_t i;
+
+	for (i = 0; i < 100000 && received < len; i++) {
+		simRun(1);
+		packetLen = simBulkRead(packet);
+		if (received + packetLen > len) {
+			packetLen = len - received;
+		}
+
+		memcpy(data + received, packet, packetLen);
+		received += packetLen;
+	}
+
+	return received;
+}
+
+/**
+ * Parameterized test commands of logic.c
+ */
+bool scenarioCommands() {
+	uint8_t data[1000];
+	uint16_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	// Transmit with counter pattern, in 10 byte packets
+	SIM_CHECK(simBulkWrite((uint8_t*) "T 1000 10 1\n", 12) == 12);
+	SIM_CHECK(simReadBytes(data, 1000) == 1000);
+	for (i = 0; i < 1000; i++) {
+		SIM_CHECK(data[i] == (uint8_t) i);
+	}
+	SIM_CHECK(g_UsbStats.ep2InHighWater == 10);
+
+	// A chunk above the packet size is clamped, not truncated to 8 bits
+	SIM_CHECK(simBulkWrite((uint8_t*) "T 1000 300 1\n", 13) == 13);
+	SIM_CHECK(simReadBytes(data, 1000) == 1000);
+	SIM_CHECK(g_UsbStats.ep2InHighWater == USBCDC_TRANSMIT_BUFFER_LEN);
+
+	// Receive, checked against the counter pattern
+	SIM_CHECK(simBulkWrite((uint8_t*) "R 1000\n", 7) == 7);
+	SIM_CHECK(simBulkWrite(data, 1000) == 1000);
+	SIM_CHECK(simReadBytes(data, 9) == 9);
+	SIM_CHECK(memcmp(data, "R 1000 0\n", 9) == 0);
+
+	// Echo
+	SIM_CHECK(simBulkWrite((uint8_t*) "E 3\nabc", 7) == 7);
+	SIM_CHECK(simReadBytes(data, 3) == 3);
+	SIM_CHECK(memcmp(data, "abc", 3) == 0);
+
+	return true;
+}
+
+/**
+ * Sequence numbered stream packets with CRC
+ */
+bool scenarioStreamPackets() {
+	uint8_t data[64 * 100];
+	uint8_t* packet;
+	uint32_t sequence;
+	uint16_t crc;
+	uint16_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "P 100\n", 6) == 6);
+	SIM_CHECK(simReadBytes(data, sizeof(data)) == sizeof(data));
+
+	for (i = 0; i < 100; i++) {
+		packet = data + i * 64;
+		memcpy(&sequence, packet, 4);
+		SIM_CHECK(sequence == i);
+
+		crc = crc16(CRC16_INIT, packet, 62);
+		SIM_CHECK(packet[62] == (crc & 0xff) && packet[63] == (crc >> 8));
+	}
+
+	// Nothing more
+	SIM_CHECK(simReadBytes(data, 1) == 0);
+
+	return true;
+}
+
+/**
+ * Stream packets on the vendor bulk interface (EP3), started over CDC, stopped with
+ * an EP3 packet, which is echoed afterwards
+ */
+bool scenarioVendorBulk() {
+	uint8_t packet[64];
+	uint8_t descriptor[9];
+	uint32_t sequence;
+	uint16_t crc;
+	uint16_t i;
+	uint8_t len;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	// CDC control, CDC data, vendor
+	SIM_CHECK(simControl(0x80, USB_GET_DESCRIPTOR, 0x0200, 0, 9, descriptor) == 9);
+	SIM_CHECK(descriptor[4] == 3);
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "V 100\n", 6) == 6);
+
+	for (i = 0; i < 100; i++) {
+		SIM_CHECK(simInRetry(3, packet, &len) == SIM_ACK);
+		SIM_CHECK(len == 64);
+
+		memcpy(&sequence, packet, 4);
+		SIM_CHECK(sequence == i);
+
+		crc = crc16(CRC16_INIT, packet, 62);
+		SIM_CHECK(packet[62] == (crc & 0xff) && packet[63] == (crc >> 8));
+	}
+
+	// Nothing more, nothing on the CDC interface
+	simRun(SIM_SETTLE);
+	SIM_CHECK(simIn(3, packet, &len) == SIM_NAK);
+	SIM_CHECK(simBulkRead(packet) == 0);
+
+	// Endless, stopped by any packet
+	SIM_CHECK(simBulkWrite((uint8_t*) "V 0\n", 4) == 4);
+	for (i = 0; i < 1000; i++) {
+		SIM_CHECK(simInRetry(3, packet, &len) == SIM_ACK);
+	}
+	SIM_CHECK(simOutRetry(3, (uint8_t*) "x", 1) == SIM_ACK);
+
+	// The packet already queued
+	simRun(SIM_SETTLE);
+	simIn(3, packet, &len);
+	simRun(SIM_SETTLE);
+	SIM_CHECK(simIn(3, packet, &len) == SIM_NAK);
+
+	// Echo
+	for (i = 0; i < 64; i++) {
+		packet[i] = i * 3;
+	}
+	SIM_CHECK(simOutRetry(3, packet, 64) == SIM_ACK);
+	memset(packet, 0, sizeof(packet));
+	SIM_CHECK(simInRetry(3, packet, &len) == SIM_ACK);
+	SIM_CHECK(len == 64);
+	for (i = 0; i < 64; i++) {
+		SIM_CHECK(packet[i] == (uint8_t) (i * 3));
+	}
+
+	// Zero length packet
+	SIM_CHECK(simOutRetry(3, NULL, 0) == SIM_ACK);
+	SIM_CHECK(simInRetry(3, packet, &len) == SIM_ACK);
+	SIM_CHECK(len == 0);
+
+	return true;
+}
+
+/**
+ * Clock sync request: the latched tick counter follows the simulated time,
+ * also over Timer 0 overflows
+ */
+bool scenarioClockSync() {
+	ClockSync first;
+	ClockSync second;
+	uint64_t firstNs;
+	uint64_t expected;
+	uint32_t ticks;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simControl(0xC0, GET_CLOCK, 0, 0, sizeof(ClockSync), (uint8_t*) &first) == sizeof(ClockSync));
+	firstNs = g_SimStats.timeNs;
+	SIM_CHECK(first.ticksPerSecond == TIMER_TICKS_PER_SECOND);
+
+	// 100 ms, three Timer 0 overflows
+	simRun(100000);
+
+	SIM_CHECK(simControl(0xC0, GET_CLOCK, 0, 0, sizeof(ClockSync), (uint8_t*) &second) == sizeof(ClockSync));
+
+	// Latched in the SETUP stage, the host time is taken after the status stage
+	expected = (g_SimStats.timeNs - firstNs) * TIMER_TICKS_PER_SECOND / 1000000000ULL;
+	ticks = second.ticks - first.ticks;
+	SIM_CHECK(ticks > expected - expected / 100 && ticks < expected + expected / 100);
+
+	return true;
+}
+
+/**
+ * Send SOF for some frames, and read the paced sample frames in between
+ *
+ * @param frames SOF to send
+ * @param periodNs Frame period of the host
+ * @param skip SOF not sent, like a missed SOF, 0 for none
+ * @return Received sample frames
+ */
+uint32_t simSofFrames(uint32_t frames, uint32_t periodNs, uint32_t skip) {
+	uint64_t next = g_SimStats.timeNs;
+	uint8_t packet[64];
+	uint32_t received = 0;
+	uint32_t i;
+	uint8_t len;
+	uint8_t j;
+
+	for (i = 1; i <= frames; i++) {
+		if (i != skip) {
+			simSof();
+		}
+
+		next += periodNs;
+		while (g_SimStats.timeNs < next) {
+			simRun(1);
+			len = simBulkRead(packet);
+			for (j = 0; j < len; j++) {
+				if (packet[j] == 0) {
+					received++;
+				}
+			}
+		}
+	}
+
+	return received;
+}
+
+/**
+ * SOF timebase: the host frames are 2 % longer than the nominal 1 ms, so the timer is
+ * 20000 ppm fast compared to the host. After the first window is measured, the paced
+ * sample frames keep the rate in host frames, a missed SOF is rejected
+ */
+bool scenarioSofTimebase() {
+	uint32_t frames;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+	SIM_CHECK(g_Sof.ticksPerSecond == TIMER_TICKS_PER_SECOND);
+
+	// 1000 samples / s, a frame every 8 ms
+	SIM_CHECK(simBulkWrite((uint8_t*) "F 2000 1000\n", 12) == 12);
+
+	// Window start, and the first window
+	simSofFrames(2 * SOF_WINDOW_FRAMES, 1020000, 0);
+	SIM_CHECK(g_Sof.frames == 2 * SOF_WINDOW_FRAMES);
+	SIM_CHECK(g_Sof.windows == 1);
+	SIM_CHECK(g_Sof.driftPpm >= 19995 && g_Sof.driftPpm <= 20005);
+	SIM_CHECK(g_Sof.ticksPerSecond >= 2039990 && g_Sof.ticksPerSecond <= 2040010);
+
+	// 128 frames per 1024 host frames, untrimmed would be 130.6
+	frames = simSofFrames(SOF_WINDOW_FRAMES, 1020000, 0);
+	SIM_CHECK(frames >= 127 && frames <= 129);
+	SIM_CHECK(g_Sof.windows == 2);
+
+	// The window with a missed SOF is one frame longer, and rejected, the rate is kept
+	simSofFrames(SOF_WINDOW_FRAMES + 1, 1020000, 100);
+	SIM_CHECK(g_Sof.windows == 2 && g_Sof.rejected == 1);
+	frames = simSofFrames(SOF_WINDOW_FRAMES, 1020000, 0);
+	SIM_CHECK(frames >= 127 && frames <= 129);
+	SIM_CHECK(g_Sof.windows == 3 && g_Sof.rejected == 1);
+	SIM_CHECK(g_Sof.driftPpm >= 19995 && g_Sof.driftPpm <= 20005);
+
+	return true;
+}
+
+/**
+ * Assumed duration of one USB interrupt for the latency measurement, replace it
+ * with the "ISR ..." cycles of bench/run-bench.py once they are measured
+ */
+#define SIM_USB_ISR_NS 50000
+
+/**
+ * Timer 0 interrupt latency of the priority profiles, during back to back control
+ * transfers. The USB interrupts take SIM_USB_ISR_NS simulated time each
+ *
+ * @param pt0 PT0
+ * @param ipEx IP_EX
+ * @param name Profile name, for the output
+ * @return Longest latency in ns, 0 on failure
+ */
+uint64_t simTimerLatency(uint8_t pt0, uint8_t ipEx, const char* name) {
+	uint8_t descriptor[18];
+
+	PT0 = pt0;
+	IP_EX = ipEx;
+	g_SimStats.timerCount = 0;
+	g_SimStats.timerLatencyNs = 0;
+	g_SimStats.timerLatencyMaxNs = 0;
+
+	while (g_SimStats.timerCount < 40) {
+		if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 18, descriptor) != 18) {
+			return 0;
+		}
+
+		// The main loop kicks the watchdog
+		simRun(1);
+	}
+
+	printf("    %-11s timer latency max %6.1f us, mean %5.1f us, %u interrupts\n", name,
+			g_SimStats.timerLatencyMaxNs / 1000.0,
+			g_SimStats.timerLatencyNs / 1000.0 / g_SimStats.timerCount, g_SimStats.timerCount);
+
+	return g_SimStats.timerLatencyMaxNs;
+}
+
+/**
+ * Interrupt priorities: the firmware configures the INT_PRIORITY profile. Only with
+ * TIMER_FIRST the timer interrupt is not delayed by a running USB interrupt
+ */
+bool scenarioIntPriority() {
+	uint64_t usbFirst;
+	uint64_t timerFirst;
+	uint64_t plain;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+#if INT_PRIORITY == INT_PRIORITY_USB_FIRST
+	SIM_CHECK(PT0 == 0 && IP_EX == bIP_USB);
+#elif INT_PRIORITY == INT_PRIORITY_TIMER_FIRST
+	SIM_CHECK(PT0 == 1 && IP_EX == 0);
+#else
+	SIM_CHECK(PT0 == 0 && IP_EX == 0);
+#endif
+
+	g_SimUsbIsrNs = SIM_USB_ISR_NS;
+
+	usbFirst = simTimerLatency(0, bIP_USB, "USB_FIRST");
+	timerFirst = simTimerLatency(1, 0, "TIMER_FIRST");
+	plain = simTimerLatency(0, 0, "DEFAULT");
+	SIM_CHECK(usbFirst && timerFirst && plain);
+
+	// Preempted within one simulation step, else delayed up to a full USB interrupt
+	SIM_CHECK(timerFirst <= 1000);
+	SIM_CHECK(usbFirst > timerFirst && usbFirst <= SIM_USB_ISR_NS + 1000);
+	SIM_CHECK(plain > timerFirst && plain <= SIM_USB_ISR_NS + 1000);
+
+	return true;
+}
+
+/**
+ * Pacer with a rate above 32768: the rest of the period accumulates without overflow,
+ * one second of events takes exactly one second of ticks
+ */
+bool scenarioSofPacer() {
+	__xdata SofPacer pacer;
+	uint32_t start;
+	uint16_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	// 60000 samples / s, 8 per frame: 266 ticks and 40000 / 60000 per frame
+	sofPacerStart(&pacer, 60000, 8);
+	SIM_CHECK(pacer.period == 266 && pacer.remainder == 40000);
+
+	// All events of the next second are already due
+	pacer.next -= 2 * TIMER_TICKS_PER_SECOND;
+	start = pacer.next;
+	for (i = 0; i < 7500; i++) {
+		SIM_CHECK(sofPacerDue(&pacer));
+	}
+	SIM_CHECK(pacer.next - start == TIMER_TICKS_PER_SECOND);
+	SIM_CHECK(pacer.fraction == 0);
+
+	return true;
+}
+
+/**
+ * CRC check values of "123456789", for the strategy selected with CRC_STRATEGY
+ */
+bool scenarioCrc() {
+	uint8_t data[] = "123456789";
+	uint32_t crc = CRC32_INIT;
+	uint8_t i;
+
+	SIM_CHECK(crc8(CRC8_INIT, data, 9) == 0xF4);
+	SIM_CHECK(crc16(CRC16_INIT, data, 9) == 0x29B1);
+	SIM_CHECK(CRC32_FINAL(crc32(CRC32_INIT, data, 9)) == 0xCBF43926);
+
+	// Blocks and single bytes continue the same CRC
+	SIM_CHECK(crc16Byte(crc16(CRC16_INIT, data, 4), '5') == crc16(CRC16_INIT, data, 5));
+	for (i = 0; i < 9; i++) {
+		crc = crc32Byte(crc, data[i]);
+	}
+	SIM_CHECK(CRC32_FINAL(crc) == 0xCBF43926);
+
+	return true;
+}
+
+/**
+ * Decode a COBS encoded frame of lib/frame.h, and check the CRC
+ *
+ * @param encoded Encoded frame, including the 0 delimiter
+ * @param data Decoded frame
+ * @return Decoded length, 0 if invalid
+ */
+uint8_t simDecodeFrame(const uint8_t* encoded, uint8_t* data) {
+	uint8_t len = 0;
+	uint8_t code;
+	uint8_t i;
+	uint16_t crc;
+
+	while (*encoded) {
+		code = *encoded++;
+		for (i = 1; i < code; i++) {
+			if (*encoded == 0) {
+				return 0;
+			}
+			data[len++] = *encoded++;
+		}
+		if (*encoded && code != 0xff) {
+			data[len++] = 0;
+		}
+	}
+
+	if (len < 4 || data[1] != len - 4) {
+		return 0;
+	}
+
+	crc = crc16(CRC16_INIT, data, len - 2);
+	if (data[len - 2] != (crc & 0xff) || data[len - 1] != (crc >> 8)) {
+		return 0;
+	}
+
+	return len;
+}
+
+/**
+ * Binary sample frames, two frames are packed into one USB packet
+ */
+bool scenarioFrames() {
+	uint8_t packets[2][64];
+	uint8_t lengths[2] = {0};
+	uint8_t frame[64];
+	uint8_t count = 0;
+	uint16_t sequence;
+	uint16_t sample;
+	uint8_t i;
+	uint8_t n;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "F 3\n", 4) == 4);
+	for (i = 0; i < 200 && count < 2; i++) {
+		simRun(1);
+		lengths[count] = simBulkRead(packets[count]);
+		if (lengths[count]) {
+			count++;
+		}
+	}
+
+	// Frame: 18 bytes payload + 6 bytes overhead
+	SIM_CHECK(count == 2);
+	SIM_CHECK(lengths[0] == 48 && lengths[1] == 24);
+	SIM_CHECK(packets[0][23] == 0 && packets[0][47] == 0 && packets[1][23] == 0);
+
+	for (n = 0; n < 3; n++) {
+		SIM_CHECK(simDecodeFrame(n < 2 ? packets[0] + n * 24 : packets[1], frame) == 22);
+		SIM_CHECK(frame[0] == FRAME_TYPE_SAMPLES);
+
+		memcpy(&sequence, frame + 2, 2);
+		SIM_CHECK(sequence == n);
+		for (i = 0; i < 8; i++) {
+			memcpy(&sample, frame + 4 + i * 2, 2);
+			SIM_CHECK(sample == n * 8 + i);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Autostart with the output format sample frames: only the channels of the channel mask,
+ * until "F 0" is received
+ */
+bool scenarioAutostartFrames() {
+	uint8_t data[64];
+	uint8_t frame[64];
+	uint8_t len = 0;
+	uint16_t value;
+	uint8_t n;
+	uint32_t i;
+
+	configLoad();
+	g_Config.flags |= CONFIG_FLAG_AUTOSTART;
+	g_Config.outputFormat = CONFIG_OUTPUT_FRAMES;
+	g_Config.channelMask = 0x05;
+	g_Config.sampleRate = 0;
+	configSave();
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	for (i = 0; i < 1000 && len == 0; i++) {
+		simRun(1);
+		len = simBulkRead(data);
+	}
+
+	// Frame: 6 bytes payload (sequence, channel 0 and 2) + 6 bytes overhead, 5 frames per packet
+	SIM_CHECK(len == 60);
+	for (n = 0; n < 5; n++) {
+		SIM_CHECK(simDecodeFrame(data + n * 12, frame) == 10);
+		SIM_CHECK(frame[0] == FRAME_TYPE_SAMPLES);
+
+		memcpy(&value, frame + 2, 2);
+		SIM_CHECK(value == n);
+		memcpy(&value, frame + 4, 2);
+		SIM_CHECK(value == n * 8);
+		memcpy(&value, frame + 6, 2);
+		SIM_CHECK(value == n * 8 + 2);
+	}
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "F 0\n", 4) == 4);
+	for (i = 0; i < SIM_SETTLE; i++) {
+		simRun(1);
+		simBulkRead(data);
+	}
+
+	simRun(SIM_SETTLE);
+	SIM_CHECK(simBulkRead(data) == 0);
+
+	return true;
+}
+
+/**
+ * Tokenized log frame of an unknown command, built with LOG_LEVEL WARN
+ */
+bool scenarioLog() {
+	uint8_t data[64];
+	uint8_t frame[64];
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "Z\n", 2) == 2);
+
+	// ID: module 1 (logic.c) and line, arguments 'Z' and the length 1 as varint
+	SIM_CHECK(simReadBytes(data, 10) == 10);
+	SIM_CHECK(data[9] == 0);
+	SIM_CHECK(simDecodeFrame(data, frame) == 8);
+	SIM_CHECK(frame[0] == FRAME_TYPE_LOG);
+	SIM_CHECK((frame[3] >> 4) == 1);
+	SIM_CHECK(frame[4] == 'Z' && frame[5] == 1);
+
+	SIM_CHECK(simReadBytes(data, 2) == 2);
+	SIM_CHECK(memcmp(data, "?\n", 2) == 0);
+
+	return true;
+}
+
+/**
+ * Echo in the interrupt, and ping with timestamps
+ */
+bool scenarioEchoPing() {
+	uint8_t data[64];
+	uint8_t len;
+	uint32_t id;
+	uint32_t rx;
+	uint32_t tx;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simControl(0x21, SET_CONTROL_LINE_STATE, 0x03, 0, 0, NULL) == 0);
+	SIM_CHECK(simBulkWrite((uint8_t*) "I\n", 2) == 2);
+	SIM_CHECK(simReadBytes(data, 2) == 2);
+	SIM_CHECK(memcmp(data, "I\n", 2) == 0);
+
+	// Echoed by the interrupt, the main loop does not run in between
+	SIM_CHECK(simOut(2, (uint8_t*) "hello", 5) == SIM_ACK);
+	SIM_CHECK(simIn(2, data, &len) == SIM_ACK);
+	SIM_CHECK(len == 5 && memcmp(data, "hello", 5) == 0);
+
+	// IN endpoint busy: the second packet is echoed when the first one was sent
+	SIM_CHECK(simOut(2, (uint8_t*) "abc", 3) == SIM_ACK);
+	SIM_CHECK(simOut(2, (uint8_t*) "de", 2) == SIM_ACK);
+	SIM_CHECK(simIn(2, data, &len) == SIM_ACK && len == 3);
+	SIM_CHECK(simIn(2, data, &len) == SIM_ACK && len == 2);
+	SIM_CHECK(memcmp(data, "de", 2) == 0);
+
+	// Closing the port leaves the echo mode
+	SIM_CHECK(simControl(0x21, SET_CONTROL_LINE_STATE, 0x00, 0, 0, NULL) == 0);
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "Q 42\n", 5) == 5);
+	len = 0;
+	while (len == 0 && g_SimStats.loopCount < 100000) {
+		simRun(1);
+		len = simBulkRead(data);
+	}
+	data[len] = 0;
+
+	SIM_CHECK(sscanf((char*) data, "Q %u %u %u", &id, &rx, &tx) == 3);
+	SIM_CHECK(id == 42);
+	SIM_CHECK(tx >= rx);
+
+	printf("    Ping: %u ticks from receive to send\n", tx - rx);
+
+	return true;
+}
+
+/**
+ * Unsupported requests and descriptors are STALLed, and counted
+ */
+bool scenarioStall() {
+	UsbStats stats;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simControl(0xC0, 0x7f, 0, 0, 8, (uint8_t*) &stats) == -1);
+
+	// Descriptors not in the table: string index, BOS
+	SIM_CHECK(simControl(0x80, USB_GET_DESCRIPTOR, 0x03EE, 0, 8, (uint8_t*) &stats) == -1);
+	SIM_CHECK(simControl(0x80, USB_GET_DESCRIPTOR, 0x0F00, 0, 8, (uint8_t*) &stats) == -1);
+
+	// Interfaces of the configuration, without alternate settings
+	SIM_CHECK(simControl(0x81, USB_GET_INTERFACE, 0, USB_INTERFACES - 1, 1, (uint8_t*) &stats) == 1);
+	SIM_CHECK(((uint8_t*) &stats)[0] == 0);
+	SIM_CHECK(simControl(0x01, USB_SET_INTERFACE, 0, 0, 0, NULL) == 0);
+	SIM_CHECK(simControl(0x81, USB_GET_INTERFACE, 0, USB_INTERFACES, 1, (uint8_t*) &stats) == -1);
+	SIM_CHECK(simControl(0x01, USB_SET_INTERFACE, 1, 0, 0, NULL) == -1);
+
+	// Next SETUP clears the STALL
+	SIM_CHECK(simControl(0xC0, GET_USB_STATS, 0, 0, sizeof(UsbStats), (uint8_t*) &stats) == sizeof(UsbStats));
+	SIM_CHECK(stats.ep0Stall == 5);
+	SIM_CHECK(stats.busReset == 2);
+
+	return true;
+}
+
+/**
+ * The host does not read: the next packet is dropped after USBCDC_TRANSMIT_TIMEOUT_MS
+ * and counted, the main loop keeps running, so the watchdog does not reset
+ */
+bool scenarioTransmitTimeout() {
+	uint8_t data[64];
+	uint8_t sequence[3];
+	uint64_t start;
+	uint8_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	// The first packet is not read, the second waits for it
+	SIM_CHECK(simBulkWrite((uint8_t*) "T 20 10 1\n", 10) == 10);
+	start = g_SimStats.timeNs;
+	while (g_UsbStats.ep2InTimeout == 0 && !g_SimWatchdogReset
+			&& g_SimStats.timeNs - start < (USBCDC_TRANSMIT_TIMEOUT_MS + 10) * 1000000ULL) {
+		simRun(1);
+	}
+	SIM_CHECK(g_UsbStats.ep2InTimeout == 1);
+	SIM_CHECK(g_SimStats.timeNs - start >= USBCDC_TRANSMIT_TIMEOUT_MS * 1000000ULL);
+
+	// Longer than the watchdog timeout
+	simRun(2 * WATCHDOG_TIMEOUT_MS * 1000);
+	SIM_CHECK(!g_SimWatchdogReset);
+	SIM_CHECK(g_UsbStats.ep2InTimeout == 1);
+
+	// The first packet is still there, the next command is answered
+	SIM_CHECK(simReadBytes(data, 10) == 10);
+	SIM_CHECK(simBulkWrite((uint8_t*) "T 10 10 1\n", 10) == 10);
+	SIM_CHECK(simReadBytes(data + 10, 10) == 10);
+	for (i = 0; i < 20; i++) {
+		SIM_CHECK(data[i] == i % 10);
+	}
+
+	// A dropped stream packet leaves a gap in the sequence numbers, the stream continues
+	SIM_CHECK(simBulkWrite((uint8_t*) "P 4\n", 4) == 4);
+	simRun((USBCDC_TRANSMIT_TIMEOUT_MS + USBCDC_TRANSMIT_TIMEOUT_MS / 2) * 1000);
+	SIM_CHECK(g_UsbStats.ep2InTimeout == 2);
+	for (i = 0; i < 3; i++) {
+		SIM_CHECK(simReadBytes(data, 64) == 64);
+		sequence[i] = data[0];
+	}
+	SIM_CHECK(sequence[0] == 0 && sequence[1] == 2 && sequence[2] == 3);
+
+	return true;
+}
+
+/**
+ * A retransmitted OUT packet is ignored, and counted
+ */
+bool scenarioToggleError() {
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "x", 1) == 1);
+	simRun(SIM_SETTLE);
+
+	simForceToggleError(2);
+	SIM_CHECK(simBulkWrite((uint8_t*) "x", 1) == 1);
+	simRun(SIM_SETTLE);
+
+	SIM_CHECK(g_UsbStats.ep2ToggleError == 1);
+	SIM_CHECK(g_UsbStats.ep2Out == 1);
+
+	return true;
+}
+
+/**
+ * Vendor request to jump to the bootloader
+ */
+bool scenarioBootloader() {
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simControl(0x40, RESET_DEVICE_TO_BOOTLOADER, 0, 0, 0, NULL) == 0);
+	simRun(SIM_SETTLE);
+	SIM_CHECK(g_SimBootloader);
+
+	// The bootloader does not kick the watchdog
+	SIM_CHECK(!(GLOBAL_CFG & bWDOG_EN));
+
+	return true;
+}
+
+/**
+ * Find the newest event of a type in the recorder ring
+ *
+ * @param recorder Ring
+ * @param type RECORDER_EVENT_*
+ * @return Event, NULL if not found
+ */
+RecorderEvent* simFindEvent(Recorder* recorder, uint8_t type) {
+	uint8_t i;
+	uint8_t pos;
+
+	for (i = 1; i <= RECORDER_EVENTS; i++) {
+		pos = (recorder->pos - i) & (RECORDER_EVENTS - 1);
+		if (recorder->events[pos].type == type) {
+			return &recorder->events[pos];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Flight recorder: read by the host, snapshot before the bootloader,
+ * restored after power on
+ */
+bool scenarioRecorder() {
+	Recorder recorder;
+	uint8_t offset;
+	uint8_t len;
+	RecorderEvent* event;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	// Read in blocks, recording stopped until the last block
+	for (offset = 0; offset < sizeof(Recorder); offset += len) {
+		len = sizeof(Recorder) - offset > 64 ? 64 : sizeof(Recorder) - offset;
+		SIM_CHECK(simControl(0xC0, GET_RECORDER, offset + len < sizeof(Recorder), offset, len,
+				(uint8_t*) &recorder + offset) == len);
+	}
+	SIM_CHECK(recorder.magic == RECORDER_MAGIC && !g_Recorder.frozen);
+	SIM_CHECK(simFindEvent(&recorder, RECORDER_EVENT_BOOT) != NULL);
+	SIM_CHECK(simFindEvent(&recorder, RECORDER_EVENT_BUS_RESET) != NULL);
+	event = simFindEvent(&recorder, RECORDER_EVENT_CONFIGURED);
+	SIM_CHECK(event != NULL && event->data == 1);
+	event = simFindEvent(&recorder, RECORDER_EVENT_SETUP);
+	SIM_CHECK(event != NULL && event->data == GET_RECORDER);
+
+	// Snapshot
+	SIM_CHECK(simControl(0x40, RESET_DEVICE_TO_BOOTLOADER, 0, 0, 0, NULL) == 0);
+	simRun(SIM_SETTLE);
+	SIM_CHECK(g_SimBootloader);
+	SIM_CHECK(g_SimDataFlash[RECORDER_FLASH_ADDR] == 0xA5);
+
+	// Power on: the XRAM content is lost, the snapshot is restored once
+	memset(&g_Recorder, 0x55, sizeof(Recorder));
+	simReset(RST_FLAG_POR);
+
+	// The data flash is read after the clock settle wait, one poll per us
+	simRun(CLOCK_SETTLE_MS * 1000 + SIM_SETTLE);
+	SIM_CHECK(g_Recorder.magic == RECORDER_MAGIC);
+	SIM_CHECK(g_Recorder.events[RECORDER_SNAPSHOT_EVENTS - 1].type == RECORDER_EVENT_BOOTLOADER);
+	event = simFindEvent(&g_Recorder, RECORDER_EVENT_RESTORED);
+	SIM_CHECK(event != NULL && event->data == RECORDER_SNAPSHOT_EVENTS);
+	SIM_CHECK(g_SimDataFlash[RECORDER_FLASH_ADDR] == 0);
+
+	return true;
+}
+
+/**
+ * Watchdog: the hanging firmware is reset within the timeout, after the enumeration
+ * the stream continues with the next sequence number
+ */
+bool scenarioWatchdog() {
+	uint8_t packet[64];
+	WarmState state;
+	uint32_t expected = 0;
+	uint32_t sequence;
+	uint64_t hangNs;
+	uint32_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "P 1000\n", 7) == 7);
+	SIM_CHECK(simBulkWrite((uint8_t*) "H\n", 2) == 2);
+	hangNs = g_SimStats.timeNs;
+
+	// Read until the reset, the host reads faster than the device sends
+	for (i = 0; i < 2000000 && !g_SimWatchdogReset; i++) {
+		if (simBulkRead(packet) == 64) {
+			memcpy(&sequence, packet, 4);
+			SIM_CHECK(sequence == expected);
+			expected++;
+		}
+		simRun(1);
+	}
+	SIM_CHECK(g_SimWatchdogReset);
+	SIM_CHECK(expected > 0 && expected < 1000);
+	SIM_CHECK(g_SimStats.timeNs - hangNs >= (WATCHDOG_TIMEOUT_MS - 5) * 1000000ULL);
+	SIM_CHECK(g_SimStats.timeNs - hangNs <= (WATCHDOG_TIMEOUT_MS + 20) * 1000000ULL);
+
+	simReset(RST_FLAG_WDOG);
+
+	// The reset reason is checked before the clock settle wait
+	simRun(SIM_SETTLE);
+	SIM_CHECK(g_WatchdogRecovered);
+	SIM_CHECK(simEnumerate());
+
+	// Continues without a command
+	for (i = 0; i < 10; i++) {
+		SIM_CHECK(simReadBytes(packet, 64) == 64);
+		memcpy(&sequence, packet, 4);
+		SIM_CHECK(sequence == expected);
+		expected++;
+	}
+
+	SIM_CHECK(simControl(0xC0, GET_WATCHDOG, 0, 0, 8, (uint8_t*) &state) == 8);
+	SIM_CHECK(state.magic == WARM_MAGIC && state.watchdogResets == 1);
+
+	// Boot to resume, the enumeration takes the most time
+	SIM_CHECK(state.recoveryTicks > 0 && state.recoveryTicks < 100 * (TIMER_TICKS_PER_SECOND / 1000));
+	SIM_CHECK(simFindEvent(&g_Recorder, RECORDER_EVENT_RECOVERED) != NULL);
+	SIM_CHECK(g_SimDataFlash[RECORDER_FLASH_ADDR] == 0xA5);
+
+	return true;
+}
+
+/**
+ * Boot phases: all reached in order, the clock settle time is waited
+ */
+bool scenarioBoot() {
+	BootTimes times;
+	uint8_t data[64];
+	uint8_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "Q 1\n", 4) == 4);
+	SIM_CHECK(simReadBytes(data, 4) == 4);
+
+	SIM_CHECK(simControl(0xC0, GET_BOOT_TIMES, 0, 0, sizeof(BootTimes), (uint8_t*) &times) == sizeof(BootTimes));
+	SIM_CHECK(times.phases == (1 << BOOT_PHASES) - 1);
+
+	for (i = 1; i < BOOT_PHASES; i++) {
+		SIM_CHECK(times.ticks[i] >= times.ticks[i - 1]);
+	}
+	SIM_CHECK(times.ticks[BOOT_PHASE_CLOCK] >= CLOCK_SETTLE_MS * (TIMER_TICKS_PER_SECOND / 1000));
+
+	printf("    Configured after %.3f ms, first data after %.3f ms\n",
+			times.ticks[BOOT_PHASE_CONFIGURED] * 1000.0 / TIMER_TICKS_PER_SECOND,
+			times.ticks[BOOT_PHASE_FIRST_TX] * 1000.0 / TIMER_TICKS_PER_SECOND);
+
+	return true;
+}
+
+/**
+ * Write the header of lib/iap.h
+ */
+void simIapHeader(uint8_t* header, uint16_t length, uint16_t crc) {
+	memcpy(header, "IAPU", 4);
+	header[4] = length & 0xff;
+	header[5] = length >> 8;
+	header[6] = crc & 0xff;
+	header[7] = crc >> 8;
+}
+
+/**
+ * Firmware update: a wrong CRC leaves the ROM bootloader in the reset vector,
+ * a valid odd sized image is programmed and the device resets
+ */
+bool scenarioIap() {
+	uint8_t image[IAP_HEADER_LEN + 1001];
+	uint8_t* data = image + IAP_HEADER_LEN;
+	char answer[16];
+	char expected[16];
+	uint16_t crc = 0xffff;
+	uint16_t i;
+
+	simBoot();
+	SIM_CHECK(simEnumerate());
+
+	SIM_CHECK(simBulkWrite((uint8_t*) "U\n", 2) == 2);
+	SIM_CHECK(simReadBytes((uint8_t*) answer, 2) == 2);
+	SIM_CHECK(memcmp(answer, "U\n", 2) == 0);
+
+	for (i = 0; i < 1001; i++) {
+		data[i] = i * 7;
+		crc = crc16Byte(crc, data[i]);
+	}
+
+	// Wrong CRC
+	simIapHeader(image, 1001, crc ^ 1);
+	SIM_CHECK(simBulkWrite(image, sizeof(image)) == sizeof(image));
+	sprintf(expected, "U ERR %04X\n", crc);
+	SIM_CHECK(simReadBytes((uint8_t*) answer, 11) == 11);
+	SIM_CHECK(memcmp(answer, expected, 11) == 0);
+	SIM_CHECK(!g_SimSoftwareReset);
+	SIM_CHECK(g_SimCodeFlash[0] == 0x02 && g_SimCodeFlash[1] == (BOOT_LOAD_ADDR >> 8) && g_SimCodeFlash[2] == 0);
+
+	// The loader waits for the next header
+	simIapHeader(image, 1001, crc);
+	SIM_CHECK(simBulkWrite(image, sizeof(image)) == sizeof(image));
+	sprintf(expected, "U OK %04X\n", crc);
+	SIM_CHECK(simReadBytes((uint8_t*) answer, 10) == 10);
+	SIM_CHECK(memcmp(answer, expected, 10) == 0);
+
+	simRun(SIM_SETTLE);
+	SIM_CHECK(g_SimSoftwareReset);
+	SIM_CHECK(memcmp(g_SimCodeFlash, data, 1001) == 0);
+	SIM_CHECK(g_SimCodeFlash[1001] == 0xff);
+
+	simReset(RST_FLAG_SW);
+	SIM_CHECK(simEnumerate());
+
+	return true;
+}
+
+/**
+ * Scenario
+ */
+typedef struct {
+	const char* name;
+	bool (*run)();
+} Scenario;
+
+Scenario g_Scenarios[] = {
+	{ "enumerate", scenarioEnumerate },
+	{ "line-coding", scenarioLineCoding },
+	{ "autostart", scenarioAutostart },
+	{ "streaming", scenarioStreaming },
+	{ "commands", scenarioCommands },
+	{ "stream-packets", scenarioStreamPackets },
+	{ "crc", scenarioCrc },
+	{ "frames", scenarioFrames },
+	{ "autostart-frames", scenarioAutostartFrames },
+	{ "log", scenarioLog },
+	{ "echo-ping", scenarioEchoPing },
+	{ "stall", scenarioStall },
+	{ "transmit-timeout", scenarioTransmitTimeout },
+	{ "toggle-error", scenarioToggleError },
+	{ "bootloader", scenarioBootloader },
+	{ "recorder", scenarioRecorder },
+	{ "watchdog", scenarioWatchdog },
+	{ "boot", scenarioBoot },
+	{ "iap", scenarioIap },
+	{ "vendor-bulk", scenarioVendorBulk },
+	{ "clock-sync", scenarioClockSync },
+	{ "sof-timebase", scenarioSofTimebase },
+	{ "sof-pacer", scenarioSofPacer },
+	{ "int-priority", scenarioIntPriority },
+};
+
+/**
+ * Run all scenarios, or the scenarios given as arguments
+ */
+int main(int argc, char** argv) {
+	uint8_t i;
+	int j;
+	int failed = 0;
+	int status;
+	bool selected;
+
+	for (i = 0; i < sizeof(g_Scenarios) / sizeof(Scenario); i++) {
+		selected = argc < 2;
+		for (j = 1; j < argc; j++) {
+			if (strcmp(argv[j], g_Scenarios[i].name) == 0) {
+				selected = true;
+			}
+		}
+
+		if (!selected) {
+			continue;
+		}
+
+		printf("%s\n", g_Scenarios[i].name);
+		fflush(stdout);
+
+		if (fork() == 0) {
+			// Erased data flash
+			memset(g_SimDataFlash, 0xff, SIM_DATA_FLASH_SIZE);
+			memset(g_SimCodeFlash, 0xff, SIM_CODE_FLASH_SIZE);
+
+			if (!g_Scenarios[i].run()) {
+				fflush(stdout);
+				_exit(1);
+			}
+
+			printf("    OK, %u USB interrupts, %.0f ns per interrupt\n", g_SimStats.isrCount,
+					g_SimStats.isrCount ? (double) g_SimStats.isrNs / g_SimStats.isrCount : 0.0);
+			fflush(stdout);
+			_exit(0);
+		}
+
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed++;
+		}
+	}
+
+	if (failed) {
+		printf("%i scenario(s) failed\n", failed);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+/**
+ * Host simulation: definition of all SFRs
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#define SIM_DEFINE_SFR
+
+#include "../lib/base/ch554.h"
+#include <8051.h>
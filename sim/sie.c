@@ -0,0 +1,531 @@
+/**
+ * Host simulation: USB SIE of the CH554 in device mode,
+ * and a simple USB host using it
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#include <string.h>
+
+#include "sim.h"
+#include "../lib/hardware.h"
+
+/**
+ * Simulated time of a token without data, and per data byte (12 MBit/s)
+ */
+#define SIM_TOKEN_NS 3000
+#define SIM_BYTE_NS 670
+
+/**
+ * Address used by the host
+ */
+uint8_t g_SimAddress = 0;
+
+/**
+ * Data toggle the host uses / expects next, [0] = OUT, [1] = IN
+ */
+uint8_t g_SimToggle[2][4];
+
+/**
+ * Control register of an endpoint
+ */
+volatile uint8_t* simEndpointCtrl(uint8_t ep) {
+	switch (ep) {
+	case 0:
+		return &UEP0_CTRL;
+	case 1:
+		return &UEP1_CTRL;
+	case 2:
+		return &UEP2_CTRL;
+	default:
+		return &UEP3_CTRL;
+	}
+}
+
+/**
+ * Transmit length register of an endpoint
+ */
+volatile uint8_t* simEndpointTLen(uint8_t ep) {
+	switch (ep) {
+	case 0:
+		return &UEP0_T_LEN;
+	case 1:
+		return &UEP1_T_LEN;
+	case 2:
+		return &UEP2_T_LEN;
+	default:
+		return &UEP3_T_LEN;
+	}
+}
+
+/**
+ * Receive buffer of an endpoint, see USBDeviceEndPointCfg()
+ */
+uint8_t* simEndpointRxBuffer(uint8_t ep) {
+	switch (ep) {
+	case 0:
+		return Ep0Buffer;
+	case 2:
+		return Ep2Buffer;
+#if VENDOR_BULK_ENABLE
+	case 3:
+		return Ep3Buffer;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Transmit buffer of an endpoint, see USBDeviceEndPointCfg()
+ */
+uint8_t* simEndpointTxBuffer(uint8_t ep) {
+	switch (ep) {
+	case 0:
+		return Ep0Buffer;
+	case 1:
+		return Ep1Buffer;
+	case 2:
+		return Ep2Buffer + MAX_PACKET_SIZE;
+#if VENDOR_BULK_ENABLE
+	case 3:
+		return Ep3Buffer + MAX_PACKET_SIZE;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * The device answers tokens to this address
+ */
+bool simDeviceListening() {
+	if (!(USB_CTRL & bUC_DEV_PU_EN) || !(UDEV_CTRL & bUD_PORT_EN)) {
+		return false;
+	}
+
+	return (USB_DEV_AD & MASK_USB_ADDR) == g_SimAddress;
+}
+
+/**
+ * Set the transfer interrupt flag, and call the interrupt
+ *
+ * @param status USB_INT_ST
+ */
+void simTransferInterrupt(uint8_t status) {
+	USB_INT_ST = status;
+	U_TOG_OK = (status & bUIS_TOG_OK) ? 1 : 0;
+	U_IS_NAK = (status & bUIS_IS_NAK) ? 1 : 0;
+	UIF_TRANSFER = 1;
+
+	simDispatch();
+}
+
+/**
+ * Bus reset
+ */
+void simBusReset() {
+	memset(g_SimToggle, 0, sizeof(g_SimToggle));
+	g_SimAddress = 0;
+
+	simBusTime(10000000);
+
+	UIF_BUS_RST = 1;
+	simDispatch();
+}
+
+/**
+ * Start of frame, sent to all devices, interrupt only if enabled with bUIE_DEV_SOF
+ *
+ * @return SIM_ACK if the interrupt was called, SIM_IGNORED else
+ */
+uint8_t simSof() {
+	if (!(USB_CTRL & bUC_DEV_PU_EN) || !(UDEV_CTRL & bUD_PORT_EN)) {
+		return SIM_IGNORED;
+	}
+
+	simBusTime(SIM_TOKEN_NS);
+
+	// A pending interrupt flag drops the SOF, like a missed SOF on the bus
+	if (!(USB_INT_EN & bUIE_DEV_SOF) || UIF_TRANSFER) {
+		return SIM_IGNORED;
+	}
+
+	simTransferInterrupt(UIS_TOKEN_SOF);
+
+	return SIM_ACK;
+}
+
+/**
+ * SETUP token with 8 bytes data
+ *
+ * @return SIM_ACK, SIM_NAK or SIM_IGNORED
+ */
+uint8_t simSetup(const uint8_t* setup) {
+	if (!simDeviceListening()) {
+		return SIM_IGNORED;
+	}
+
+	// bUC_INT_BUSY: NAK while the interrupt flag is set
+	if (UIF_TRANSFER) {
+		return SIM_NAK;
+	}
+
+	simBusTime(SIM_TOKEN_NS + 8 * SIM_BYTE_NS);
+
+	memcpy(Ep0Buffer, setup, 8);
+	USB_RX_LEN = 8;
+
+	// Data stage and status stage start with DATA1
+	g_SimToggle[0][0] = 1;
+	g_SimToggle[1][0] = 1;
+
+	simTransferInterrupt(UIS_TOKEN_SETUP | 0 | bUIS_TOG_OK);
+
+	return SIM_ACK;
+}
+
+/**
+ * OUT token
+ *
+ * @param ep Endpoint number
+ * @param data Data
+ * @param len Length, max 64
+ * @return SIM_*
+ */
+uint8_t simOut(uint8_t ep, const uint8_t* data, uint8_t len) {
+	volatile uint8_t* ctrl = simEndpointCtrl(ep);
+	uint8_t* buffer = simEndpointRxBuffer(ep);
+	uint8_t togOk;
+
+	if (!simDeviceListening()) {
+		return SIM_IGNORED;
+	}
+
+	simBusTime(SIM_TOKEN_NS + len * SIM_BYTE_NS);
+
+	if (UIF_TRANSFER || buffer == NULL) {
+		return SIM_NAK;
+	}
+
+	switch (*ctrl & MASK_UEP_R_RES) {
+	case UEP_R_RES_STALL:
+		return SIM_STALL;
+
+	case UEP_R_RES_NAK:
+		if (USB_INT_EN & bUIE_DEV_NAK) {
+			simTransferInterrupt(UIS_TOKEN_OUT | ep | bUIS_IS_NAK);
+		}
+		return SIM_NAK;
+
+	case UEP_R_RES_TOUT:
+		return SIM_IGNORED;
+	}
+
+	togOk = (g_SimToggle[0][ep] == ((*ctrl & bUEP_R_TOG) ? 1 : 0));
+
+	memcpy(buffer, data, len);
+	USB_RX_LEN = len;
+
+	if (togOk && (*ctrl & bUEP_AUTO_TOG)) {
+		*ctrl ^= bUEP_R_TOG;
+	}
+
+	// The device ACKed, the host toggles
+	g_SimToggle[0][ep] ^= 1;
+	g_SimStats.packets++;
+
+	simTransferInterrupt(UIS_TOKEN_OUT | ep | (togOk ? bUIS_TOG_OK : 0));
+
+	return SIM_ACK;
+}
+
+/**
+ * IN token
+ *
+ * @param ep Endpoint number
+ * @param data Buffer, 64 bytes
+ * @param len Received length
+ * @return SIM_*
+ */
+uint8_t simIn(uint8_t ep, uint8_t* data, uint8_t* len) {
+	volatile uint8_t* ctrl = simEndpointCtrl(ep);
+	uint8_t* buffer = simEndpointTxBuffer(ep);
+	uint8_t toggle;
+
+	*len = 0;
+
+	if (!simDeviceListening()) {
+		return SIM_IGNORED;
+	}
+
+	simBusTime(SIM_TOKEN_NS);
+
+	if (UIF_TRANSFER || buffer == NULL) {
+		return SIM_NAK;
+	}
+
+	switch (*ctrl & MASK_UEP_T_RES) {
+	case UEP_T_RES_STALL:
+		return SIM_STALL;
+
+	case UEP_T_RES_NAK:
+		if (USB_INT_EN & bUIE_DEV_NAK) {
+			simTransferInterrupt(UIS_TOKEN_IN | ep | bUIS_IS_NAK);
+		}
+		return SIM_NAK;
+
+	case UEP_T_RES_TOUT:
+		return SIM_IGNORED;
+	}
+
+	*len = *simEndpointTLen(ep);
+	if (*len > MAX_PACKET_SIZE) {
+		*len = MAX_PACKET_SIZE;
+	}
+
+	memcpy(data, buffer, *len);
+	simBusTime(*len * SIM_BYTE_NS);
+
+	toggle = (*ctrl & bUEP_T_TOG) ? 1 : 0;
+
+	if (*ctrl & bUEP_AUTO_TOG) {
+		*ctrl ^= bUEP_T_TOG;
+	}
+
+	simTransferInterrupt(UIS_TOKEN_IN | ep | bUIS_TOG_OK);
+
+	if (toggle != g_SimToggle[1][ep]) {
+		// The host ACKs, but ignores the data, it's a retransmission
+		g_SimStats.toggleErrors++;
+		*len = 0;
+		return SIM_TOGGLE_ERROR;
+	}
+
+	g_SimToggle[1][ep] ^= 1;
+	g_SimStats.packets++;
+
+	return SIM_ACK;
+}
+
+/**
+ * Send a OUT token with a wrong data toggle
+ */
+void simForceToggleError(uint8_t ep) {
+	g_SimToggle[0][ep] ^= 1;
+}
+
+/**
+ * OUT token, NAKs are retried
+ *
+ * @return SIM_*
+ */
+uint8_t simOutRetry(uint8_t ep, const uint8_t* data, uint8_t len) {
+	uint16_t i;
+	uint8_t result = SIM_TIMEOUT;
+
+	for (i = 0; i < SIM_RETRY; i++) {
+		result = simOut(ep, data, len);
+		if (result != SIM_NAK) {
+			return result;
+		}
+
+		simRun(1);
+	}
+
+	return SIM_TIMEOUT;
+}
+
+/**
+ * IN token, NAKs are retried
+ *
+ * @return SIM_*
+ */
+uint8_t simInRetry(uint8_t ep, uint8_t* data, uint8_t* len) {
+	uint16_t i;
+	uint8_t result = SIM_TIMEOUT;
+
+	for (i = 0; i < SIM_RETRY; i++) {
+		result = simIn(ep, data, len);
+		if (result != SIM_NAK) {
+			return result;
+		}
+
+		simRun(1);
+	}
+
+	return SIM_TIMEOUT;
+}
+
+/**
+ * Control transfer on EP0
+ *
+ * @return Transferred bytes in the data stage, -1 on STALL / timeout
+ */
+int simControl(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, uint8_t* data) {
+	uint8_t setup[8] = {
+		type, request,
+		value & 0xff, value >> 8,
+		index & 0xff, index >> 8,
+		length & 0xff, length >> 8
+	};
+	uint8_t packet[MAX_PACKET_SIZE];
+	uint8_t len;
+	uint16_t i;
+	int total = 0;
+
+	for (i = 0; i < SIM_RETRY; i++) {
+		if (simSetup(setup) == SIM_ACK) {
+			break;
+		}
+		simRun(1);
+	}
+
+	if (i == SIM_RETRY) {
+		return -1;
+	}
+
+	if (length && (type & USB_REQ_TYP_IN)) {
+		// Data stage IN, until a short packet
+		while (total < length) {
+			if (simInRetry(0, packet, &len) != SIM_ACK) {
+				return -1;
+			}
+
+			if (len > length - total) {
+				len = length - total;
+			}
+
+			memcpy(data + total, packet, len);
+			total += len;
+
+			if (len < DEFAULT_ENDP0_SIZE) {
+				break;
+			}
+		}
+
+		// Status stage
+		if (simOutRetry(0, NULL, 0) != SIM_ACK) {
+			return -1;
+		}
+
+		return total;
+	}
+
+	// Data stage OUT
+	while (total < length) {
+		len = length - total > DEFAULT_ENDP0_SIZE ? DEFAULT_ENDP0_SIZE : length - total;
+
+		if (simOutRetry(0, data + total, len) != SIM_ACK) {
+			return -1;
+		}
+
+		total += len;
+	}
+
+	// Status stage, zero length IN
+	if (simInRetry(0, packet, &len) != SIM_ACK || len != 0) {
+		return -1;
+	}
+
+	return total;
+}
+
+/**
+ * Enumerate the device like Linux: reset, address, descriptors, configuration
+ *
+ * @return true on success
+ */
+bool simEnumerate() {
+	uint8_t descriptor[256];
+	uint16_t totalLength;
+	uint8_t i;
+
+	simBusReset();
+	simRun(10);
+
+	// Linux reads the first 64 bytes of the device descriptor to get the EP0 size
+	if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 64, descriptor) != 18) {
+		return false;
+	}
+
+	simBusReset();
+	simRun(10);
+
+	if (simControl(0x00, USB_SET_ADDRESS, SIM_ADDRESS, 0, 0, NULL) != 0) {
+		return false;
+	}
+	g_SimAddress = SIM_ADDRESS;
+
+	if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0100, 0, 18, descriptor) != 18) {
+		return false;
+	}
+
+	if (descriptor[0] != 18 || descriptor[1] != USB_DESCR_TYP_DEVICE) {
+		return false;
+	}
+
+	if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0200, 0, 9, descriptor) != 9) {
+		return false;
+	}
+
+	totalLength = descriptor[2] | (descriptor[3] << 8);
+	if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0200, 0, totalLength, descriptor) != totalLength) {
+		return false;
+	}
+
+	// Language, manufacturer, product, serial
+	for (i = 0; i < 4; i++) {
+		if (simControl(0x80, USB_GET_DESCRIPTOR, 0x0300 | i, 0x0409, 255, descriptor) <= 2) {
+			return false;
+		}
+	}
+
+	if (simControl(0x00, USB_SET_CONFIGURATION, 1, 0, 0, NULL) != 0) {
+		return false;
+	}
+
+	// Bulk endpoints start with DATA0 after SET_CONFIGURATION
+	memset(g_SimToggle[0] + 1, 0, 3);
+	memset(g_SimToggle[1] + 1, 0, 3);
+
+	return true;
+}
+
+/**
+ * Write data to the CDC bulk OUT endpoint, NAKs are retried
+ *
+ * @return Bytes written
+ */
+uint16_t simBulkWrite(const uint8_t* data, uint16_t len) {
+	uint16_t total = 0;
+	uint8_t packet;
+
+	while (total < len) {
+		packet = len - total > MAX_PACKET_SIZE ? MAX_PACKET_SIZE : len - total;
+
+		if (simOutRetry(2, data + total, packet) != SIM_ACK) {
+			break;
+		}
+
+		total += packet;
+	}
+
+	return total;
+}
+
+/**
+ * Read one packet from the CDC bulk IN endpoint
+ *
+ * @return Bytes read, 0 on NAK
+ */
+uint8_t simBulkRead(uint8_t* data) {
+	uint8_t len;
+
+	if (simIn(2, data, &len) != SIM_ACK) {
+		return 0;
+	}
+
+	return len;
+}
@@ -0,0 +1,285 @@
+/**
+ * Host simulation of the firmware: the firmware runs as coroutine,
+ * which yields when it reads the timer or kicks the watchdog, the simulated
+ * SIE calls the interrupt handlers, and a scripted USB host drives
+ * SETUP / IN / OUT tokens.
+ *
+ * Andreas Butti, (c) 2020
+ * License: MIT
+ */
+
+#pragma once
+
+#include "../lib/inc.h"
+
+/**
+ * Size of the data flash
+ */
+#define SIM_DATA_FLASH_SIZE 128
+
+/**
+ * Code flash size, up to the ROM bootloader
+ */
+#define SIM_CODE_FLASH_SIZE 0x3800
+
+/**
+ * Address assigned by simEnumerate()
+ */
+#define SIM_ADDRESS 7
+
+/**
+ * How often a NAKed token is retried, the firmware main loop runs once between retries
+ */
+#define SIM_RETRY 2000
+
+// Transaction result
+#define SIM_ACK 0
+#define SIM_NAK 1
+#define SIM_STALL 2
+#define SIM_TOGGLE_ERROR 3
+#define SIM_IGNORED 4
+#define SIM_TIMEOUT 5
+
+/**
+ * Data flash content
+ */
+extern uint8_t g_SimDataFlash[SIM_DATA_FLASH_SIZE];
+
+/**
+ * Count of bytes written to the data flash
+ */
+extern uint32_t g_SimDataFlashWrites;
+
+/**
+ * Code flash content, written by the IAP loader (lib/iap.c)
+ */
+extern uint8_t g_SimCodeFlash[SIM_CODE_FLASH_SIZE];
+
+/**
+ * Statistics of the simulation
+ */
+typedef struct {
+	/**
+	 * USB interrupt calls
+	 */
+	uint32_t isrCount;
+
+	/**
+	 * Host time spent in the USB interrupt
+	 */
+	uint64_t isrNs;
+
+	/**
+	 * Longest USB interrupt
+	 */
+	uint64_t isrMaxNs;
+
+	/**
+	 * Timer 0 interrupt calls
+	 */
+	uint32_t timerCount;
+
+	/**
+	 * Simulated time from the Timer 0 overflow to the interrupt call
+	 */
+	uint64_t timerLatencyNs;
+
+	/**
+	 * Longest Timer 0 interrupt latency
+	 */
+	uint64_t timerLatencyMaxNs;
+
+	/**
+	 * Firmware main loop iterations
+	 */
+	uint64_t loopCount;
+
+	/**
+	 * ACKed data packets
+	 */
+	uint32_t packets;
+
+	/**
+	 * Toggle errors detected by the host
+	 */
+	uint32_t toggleErrors;
+
+	/**
+	 * Simulated time
+	 */
+	uint64_t timeNs;
+} SimStats;
+
+/**
+ * Statistics of the simulation
+ */
+extern SimStats g_SimStats;
+
+/**
+ * Firmware jumped to the bootloader
+ */
+extern bool g_SimBootloader;
+
+/**
+ * The watchdog timer overflowed, the firmware is stopped until simReset()
+ */
+extern bool g_SimWatchdogReset;
+
+/**
+ * The firmware triggered a software reset, the firmware is stopped until simReset()
+ */
+extern bool g_SimSoftwareReset;
+
+/**
+ * Simulated duration of one USB interrupt, 0: the interrupt takes no time
+ */
+extern uint32_t g_SimUsbIsrNs;
+
+// Firmware entry points ------------------------------------------------------
+
+/**
+ * main() of the firmware, renamed by the Makefile
+ */
+void firmwareMain();
+
+/**
+ * Timer 0 interrupt, main.c
+ */
+void timer0();
+
+// CPU ------------------------------------------------------------------------
+
+/**
+ * Start the firmware, returns on its first poll, see simPoll()
+ */
+void simBoot();
+
+/**
+ * Reset the chip and start the firmware again, the XRAM content is kept
+ *
+ * @param resetFlags RST_FLAG_*, read by the firmware from PCON
+ */
+void simReset(uint8_t resetFlags);
+
+/**
+ * Run the firmware main loop
+ *
+ * @param iterations Count of firmware polls, see simPoll()
+ */
+void simRun(uint32_t iterations);
+
+/**
+ * Advance the simulated time, updates the timers
+ *
+ * @param ns Nanoseconds
+ */
+void simAdvance(uint32_t ns);
+
+/**
+ * Advance the simulated time of a bus transfer, the CPU serves the Timer 0 interrupt meanwhile
+ *
+ * @param ns Nanoseconds
+ */
+void simBusTime(uint32_t ns);
+
+/**
+ * Current host time
+ *
+ * @return Nanoseconds
+ */
+uint64_t simHostNs();
+
+/**
+ * Call the pending interrupt handlers, if interrupts are enabled
+ */
+void simDispatch();
+
+// SIE ------------------------------------------------------------------------
+
+/**
+ * Bus reset
+ */
+void simBusReset();
+
+/**
+ * Start of frame, sent to all devices, interrupt only if enabled with bUIE_DEV_SOF
+ *
+ * @return SIM_ACK if the interrupt was called, SIM_IGNORED else
+ */
+uint8_t simSof();
+
+/**
+ * SETUP token with 8 bytes data
+ *
+ * @return SIM_ACK, SIM_NAK or SIM_IGNORED
+ */
+uint8_t simSetup(const uint8_t* setup);
+
+/**
+ * OUT token
+ *
+ * @param ep Endpoint number
+ * @param data Data
+ * @param len Length, max 64
+ * @return SIM_*
+ */
+uint8_t simOut(uint8_t ep, const uint8_t* data, uint8_t len);
+
+/**
+ * IN token
+ *
+ * @param ep Endpoint number
+ * @param data Buffer, 64 bytes
+ * @param len Received length
+ * @return SIM_*
+ */
+uint8_t simIn(uint8_t ep, uint8_t* data, uint8_t* len);
+
+/**
+ * Send a OUT token with a wrong data toggle
+ */
+void simForceToggleError(uint8_t ep);
+
+/**
+ * OUT token, NAKs are retried
+ *
+ * @return SIM_*
+ */
+uint8_t simOutRetry(uint8_t ep, const uint8_t* data, uint8_t len);
+
+/**
+ * IN token, NAKs are retried
+ *
+ * @return SIM_*
+ */
+uint8_t simInRetry(uint8_t ep, uint8_t* data, uint8_t* len);
+
+// Host -----------------------------------------------------------------------
+
+/**
+ * Control transfer on EP0
+ *
+ * @return Transferred bytes in the data stage, -1 on STALL / timeout
+ */
+int simControl(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, uint8_t* data);
+
+/**
+ * Enumerate the device like Linux: reset, address, descriptors, configuration
+ *
+ * @return true on success
+ */
+bool simEnumerate();
+
+/**
+ * Write data to the CDC bulk OUT endpoint, NAKs are retried
+ *
+ * @return Bytes written
+ */
+uint16_t simBulkWrite(const uint8_t* data, uint16_t len);
+
+/**
+ * Read one packet from the CDC bulk IN endpoint
+ *
+ * @return Bytes read, 0 on NAK
+ */
+uint8_t simBulkRead(uint8_t* data);
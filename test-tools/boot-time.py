@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+
+# Boot time: power on until the first CDC byte is received, and the boot phases
+# measured by the device (lib/boot.h)
+#
+# boot-time.py --power-cmd 'uhubctl -l 1-1 -p 2 -a cycle -d 1' -c 20
+#     Power cycle the device 20 times with a switchable hub, and print the statistic
+# boot-time.py
+#     Without power switch: wait for the device to be plugged in
+# boot-time.py /tmp/ttyCH55X --present
+#     The device is already connected (e.g. the host simulation), only the boot phases
+#     and the time until the first answer are printed
+#
+# The first byte is the answer to a ping (command Q of logic.c), sent as soon as the
+# port can be opened.
+
+import serial
+import argparse
+import subprocess
+import struct
+import json
+import time
+import sys
+import os
+from timeit import default_timer as timer
+
+GET_BOOT_TIMES = 0x6C
+
+# BootTimes in lib/boot.h
+BOOT_FORMAT = '<B8I'
+
+# BOOT_PHASE_*
+PHASE_NAMES = [
+	'Init',
+	'Clock stable',
+	'Pull-up enabled',
+	'USB ready',
+	'Deferred init',
+	'Bus reset',
+	'Configured',
+	'First data'
+]
+
+parser = argparse.ArgumentParser(description='Measure the boot time')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('--power-cmd', help='Shell command which power cycles the device, returns after power on')
+parser.add_argument('--present', action='store_true', help='The device is already connected, no power cycle')
+parser.add_argument('-c', '--count', type=int, default=1, help='Boot count, default 1')
+parser.add_argument('--timeout', type=float, default=10, help='Timeout per boot, default 10 s')
+parser.add_argument('--tick-hz', type=float, default=2e6, help='Timer ticks per second, FREQ_SYS / 12')
+args = parser.parse_args()
+
+
+def waitPort(exists, deadline):
+	"""
+	Wait until the port appears / disappears
+	"""
+	while os.path.exists(args.port) != exists:
+		if timer() > deadline:
+			return False
+		time.sleep(0.001)
+	return True
+
+
+def firstByte(deadline):
+	"""
+	Open the port and ping, until the answer is received
+
+	@return Time of the port open and of the first byte, None on timeout
+	"""
+	while timer() < deadline:
+		try:
+			ser = serial.Serial(args.port, 115200, timeout=0.01)
+		except serial.SerialException:
+			# Exists, but the driver is not ready yet
+			time.sleep(0.001)
+			continue
+
+		opened = timer()
+		with ser:
+			while timer() < deadline:
+				ser.write(b'Q 1\n')
+				if ser.read(1):
+					return opened, timer()
+	return None
+
+
+def readBootTimes():
+	"""
+	Boot phases of the device, in ms, None if not available
+	"""
+	try:
+		import usbdevice
+	except ImportError:
+		return None
+
+	path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+	with open(path + '/usb-descriptor.json', 'r') as f:
+		descriptor = json.load(f)
+
+	dev = usbdevice.find(int('0x' + descriptor['vendor'], 16), int('0x' + descriptor['product'], 16))
+	if dev is None:
+		return None
+
+	try:
+		data = bytes(dev.ctrl_transfer(0xC0, GET_BOOT_TIMES, 0, 0, struct.calcsize(BOOT_FORMAT)))
+	except usbdevice.USBError:
+		print('Request failed, firmware built with BOOT_TIMES=0?')
+		return None
+
+	values = struct.unpack(BOOT_FORMAT, data)
+	phases = values[0]
+	return [values[1 + i] * 1e3 / args.tick_hz if phases & (1 << i) else None for i in range(len(PHASE_NAMES))]
+
+
+def printStatistic(name, values):
+	if values:
+		print('%-28s min %8.1f ms  avg %8.1f ms  max %8.1f ms' % (name, min(values), sum(values) / len(values), max(values)))
+
+
+toPort = []
+toFirstByte = []
+deviceFirst = []
+
+for i in range(args.count):
+	start = None
+
+	if args.power_cmd:
+		subprocess.run(args.power_cmd, shell=True, check=True, stdout=subprocess.DEVNULL)
+		start = timer()
+	elif not args.present:
+		if os.path.exists(args.port):
+			print('Unplug the device...')
+			waitPort(False, timer() + 3600)
+		print('Plug in the device...')
+		waitPort(True, timer() + 3600)
+
+	portSeen = timer()
+	if not waitPort(True, portSeen + args.timeout):
+		print('Port ' + args.port + ' did not appear')
+		sys.exit(1)
+	portSeen = timer()
+
+	result = firstByte(portSeen + args.timeout)
+	if result is None:
+		print('No answer from the device')
+		sys.exit(1)
+	opened, received = result
+
+	line = 'Boot %d:' % (i + 1)
+	if start is not None:
+		toPort.append((portSeen - start) * 1e3)
+		toFirstByte.append((received - start) * 1e3)
+		line += ' power on -> port %.1f ms, -> first byte %.1f ms' % (toPort[-1], toFirstByte[-1])
+	else:
+		line += ' port open -> first byte %.1f ms' % ((received - opened) * 1e3)
+
+	phases = readBootTimes()
+	if phases and phases[-1] is not None:
+		deviceFirst.append(phases[-1])
+
+	print(line)
+
+	if phases and args.count == 1:
+		for name, ms in zip(PHASE_NAMES, phases):
+			print('  %-20s %s' % (name, '%10.3f ms' % ms if ms is not None else '         -'))
+
+if args.count > 1:
+	printStatistic('Power on -> port', toPort)
+	printStatistic('Power on -> first byte', toFirstByte)
+	printStatistic('Device: timer -> first data', deviceFirst)
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+
+# Throughput and latency of the CDC link, uses the test commands of logic.c
+#
+# cdc-benchmark.py                                All tests on /dev/ttyACM0
+# cdc-benchmark.py /tmp/ttyCH55X --tests rx,echo  Selected tests, e.g. on the host simulation
+# cdc-benchmark.py --csv result.csv --json result.json
+#
+# Tests:
+#   rx      Device to host
+#   tx      Host to device, the device checks the data
+#   duplex  Both directions at the same time
+#   echo    Round trip latency of single bytes, percentiles
+#   sweep   Device to host per packet size, host to device per write size
+
+import serial
+import argparse
+import threading
+import json
+import csv
+import sys
+from timeit import default_timer as timer
+
+PATTERN_COUNTER = 1
+
+parser = argparse.ArgumentParser(description='CDC throughput and latency benchmark')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('--tests', default='rx,tx,duplex,echo,sweep', help='Comma separated list of tests')
+parser.add_argument('--bytes', type=int, default=256 * 1024, help='Bytes per throughput test')
+parser.add_argument('--echo-count', type=int, default=1000, help='Round trips for the echo test')
+parser.add_argument('--csv', help='Write the results as CSV')
+parser.add_argument('--json', help='Write the results as JSON')
+args = parser.parse_args()
+
+results = []
+
+
+def counterPattern(length):
+	"""
+	Data matching PATTERN_COUNTER of the firmware
+	"""
+	return bytes(i & 0xff for i in range(length))
+
+
+def addResult(test, parameter, byteCount, elapsed, **extra):
+	result = {
+		'test': test,
+		'parameter': parameter,
+		'bytes': byteCount,
+		'seconds': elapsed,
+		'kBps': byteCount / elapsed / 1000 if elapsed > 0 else 0
+	}
+	result.update(extra)
+	results.append(result)
+
+	print('%-8s %-12s %10d bytes %8.3f s %10.1f kB/s %s' % (test, parameter, byteCount, elapsed, result['kBps'],
+			' '.join(k + '=' + str(v) for k, v in extra.items())))
+
+
+def readExact(ser, length):
+	"""
+	Read exactly length bytes, raises on timeout
+	"""
+	data = bytearray()
+	while len(data) < length:
+		chunk = ser.read(length - len(data))
+		if not chunk:
+			raise IOError('Timeout, received ' + str(len(data)) + ' of ' + str(length) + ' bytes')
+		data += chunk
+	return data
+
+
+def readResult(ser):
+	"""
+	Result line of the R / D command: R <received> <errors>
+	"""
+	line = ser.readline().decode('ascii').split()
+	if len(line) != 3 or line[0] != 'R':
+		raise IOError('Unexpected answer: ' + str(line))
+	return int(line[1]), int(line[2])
+
+
+def testRx(ser, byteCount, chunk):
+	ser.write(('T %d %d %d\n' % (byteCount, chunk, PATTERN_COUNTER)).encode('ascii'))
+	start = timer()
+	data = readExact(ser, byteCount)
+	elapsed = timer() - start
+
+	errors = sum(1 for a, b in zip(data, counterPattern(byteCount)) if a != b)
+	addResult('rx', 'chunk=' + str(chunk), byteCount, elapsed, errors=errors)
+
+
+def testTx(ser, byteCount, writeSize):
+	data = counterPattern(byteCount)
+	ser.write(('R %d\n' % byteCount).encode('ascii'))
+
+	start = timer()
+	for pos in range(0, byteCount, writeSize):
+		ser.write(data[pos:pos + writeSize])
+	ser.flush()
+	received, errors = readResult(ser)
+	elapsed = timer() - start
+
+	addResult('tx', 'write=' + str(writeSize), byteCount, elapsed, received=received, errors=errors)
+
+
+def testDuplex(ser, byteCount):
+	data = counterPattern(byteCount)
+	rx = {}
+
+	def reader():
+		rx['data'] = readExact(ser, byteCount)
+		rx['result'] = readResult(ser)
+
+	ser.write(('D %d 64 %d\n' % (byteCount, PATTERN_COUNTER)).encode('ascii'))
+	start = timer()
+	thread = threading.Thread(target=reader)
+	thread.start()
+	ser.write(data)
+	thread.join()
+	elapsed = timer() - start
+
+	received, errors = rx['result']
+	errors += sum(1 for a, b in zip(rx['data'], data) if a != b)
+	addResult('duplex', '', byteCount * 2, elapsed, received=received, errors=errors)
+
+
+def percentile(values, p):
+	return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def testEcho(ser, count):
+	ser.write(('E %d\n' % count).encode('ascii'))
+	times = []
+
+	for i in range(count):
+		c = bytes([0x30 + i % 10])
+		start = timer()
+		ser.write(c)
+		if ser.read(1) != c:
+			raise IOError('Echo mismatch')
+		times.append((timer() - start) * 1e6)
+
+	times.sort()
+	addResult('echo', 'count=' + str(count), count * 2, sum(times) / 1e6,
+			p50_us=round(percentile(times, 50), 1),
+			p90_us=round(percentile(times, 90), 1),
+			p99_us=round(percentile(times, 99), 1),
+			max_us=round(times[-1], 1))
+
+
+with serial.Serial(args.port, 115200, timeout=3) as ser:
+	ser.reset_input_buffer()
+
+	for test in args.tests.split(','):
+		if test == 'rx':
+			testRx(ser, args.bytes, 64)
+		elif test == 'tx':
+			testTx(ser, args.bytes, 4096)
+		elif test == 'duplex':
+			testDuplex(ser, args.bytes)
+		elif test == 'echo':
+			testEcho(ser, args.echo_count)
+		elif test == 'sweep':
+			for chunk in [1, 8, 16, 25, 32, 63, 64]:
+				testRx(ser, args.bytes // 4, chunk)
+			for writeSize in [1, 16, 64, 512, 4096]:
+				testTx(ser, args.bytes // (64 if writeSize == 1 else 4), writeSize)
+		else:
+			print('Unknown test ' + test)
+			sys.exit(1)
+
+if args.json:
+	with open(args.json, 'w') as f:
+		json.dump(results, f, indent=2)
+
+if args.csv:
+	keys = []
+	for r in results:
+		keys += [k for k in r.keys() if k not in keys]
+
+	with open(args.csv, 'w', newline='') as f:
+		writer = csv.DictWriter(f, fieldnames=keys)
+		writer.writeheader()
+		writer.writerows(results)
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+
+# Check the code areas of the SDCC linker map after linking: the application has to end
+# below the firmware update loader, only the segment IAP (lib/iap.h) may be above
+#
+# check-code-size.py ProjectName.map 0x3000 0x3800
+#
+# Exit code 1 if an area is too large, 2 if the map has no code areas
+
+import argparse
+import re
+import sys
+
+parser = argparse.ArgumentParser(description='Check the code size of the application and the loader')
+parser.add_argument('map', help='Linker map, .map')
+parser.add_argument('limit', help='End of the application, e.g. 0x3000')
+parser.add_argument('flashEnd', help='End of the loader, the ROM bootloader address, e.g. 0x3800')
+args = parser.parse_args()
+
+limit = int(args.limit, 0)
+flashEnd = int(args.flashEnd, 0)
+
+# CSEG    00000062    00000ABC =    2748. bytes (REL,CON,CODE)
+areaLine = re.compile(r'^(\w+)\s+([0-9A-Fa-f]+)\s+([0-9A-Fa-f]+)\s+=\s+\d+\.\s+bytes\s+\(([^)]*)\)')
+
+areas = []
+with open(args.map, 'r') as f:
+	for line in f:
+		m = areaLine.match(line.strip())
+		if m and 'CODE' in m.group(4).split(','):
+			areas.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+
+if not areas:
+	print('No code areas found in ' + args.map)
+	sys.exit(2)
+
+failed = False
+for name, addr, size in areas:
+	if size == 0:
+		continue
+
+	end = addr + size
+	areaLimit = flashEnd if name == 'IAP' else limit
+	if end > areaLimit:
+		print('%s: 0x%04X - 0x%04X, exceeds 0x%04X' % (name, addr, end, areaLimit))
+		failed = True
+
+appEnd = max([addr + size for name, addr, size in areas if name != 'IAP'] + [0])
+print('Application ends at 0x%04X, limit 0x%04X' % (appEnd, limit))
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+
+# Check that the functions on the register bank of the USB interrupt, __using(USB_ISR_BANK),
+# are only called by functions on the same bank. SDCC compiles them for this bank, called
+# from bank 0 they would use the registers of the interrupt.
+#
+# check-isr-bank.py ../lib/*.c ../lib/*.h ../*.c ../*.h
+#
+# Exit code 1 if such a function is called from another function, or from a macro
+
+import argparse
+import re
+import sys
+
+parser = argparse.ArgumentParser(description='Check the callers of the USB interrupt register bank functions')
+parser.add_argument('files', nargs='+', help='C sources and headers')
+args = parser.parse_args()
+
+USING = re.compile(r'__using\s*\(\s*USB_ISR_BANK\s*\)')
+FUNCTION = re.compile(r'(\w+)\s*\([^()]*\)[^()]*$')
+ATTRIBUTES = re.compile(r'(__using|__interrupt)\s*\([^()]*\)')
+
+
+def functionName(header):
+	"""
+	Name of the function declared by the header, None if it is no function
+	"""
+	m = FUNCTION.search(ATTRIBUTES.sub('', header).strip())
+	return m.group(1) if m else None
+
+
+def stripSource(text):
+	"""
+	Replace comments, strings and chars by spaces, the line numbers are kept
+	"""
+	result = []
+	i = 0
+	while i < len(text):
+		if text.startswith('/*', i):
+			end = text.find('*/', i + 2)
+			end = len(text) if end < 0 else end + 2
+			result.append(re.sub(r'[^\n]', ' ', text[i:end]))
+			i = end
+		elif text.startswith('//', i):
+			end = text.find('\n', i)
+			end = len(text) if end < 0 else end
+			result.append(' ' * (end - i))
+			i = end
+		elif text[i] in '"\'':
+			end = i + 1
+			while end < len(text) and text[end] != text[i] and text[end] != '\n':
+				end += 2 if text[end] == '\\' else 1
+			end = min(end + 1, len(text))
+			result.append(re.sub(r'[^\n]', ' ', text[i:end]))
+			i = end
+		else:
+			result.append(text[i])
+			i += 1
+
+	return ''.join(result)
+
+
+def splitPreprocessor(text):
+	"""
+	Preprocessor lines, and the code with these lines replaced by spaces
+
+	@return (code, [(line, directive)])
+	"""
+	code = []
+	directives = []
+	lines = text.split('\n')
+	i = 0
+	while i < len(lines):
+		if lines[i].lstrip().startswith('#'):
+			start = i
+			directive = lines[i]
+			while lines[i].endswith('\\') and i + 1 < len(lines):
+				i += 1
+				directive += '\n' + lines[i]
+				code.append('')
+			code.append('')
+			directives.append((start + 1, directive))
+		else:
+			code.append(lines[i])
+		i += 1
+
+	return '\n'.join(code), directives
+
+
+def functions(code):
+	"""
+	Top level blocks of the code
+
+	@return [(header, start, end)], header is the text before the block
+	"""
+	blocks = []
+	depth = 0
+	headerStart = 0
+	start = 0
+	for i, c in enumerate(code):
+		if c == '{':
+			if depth == 0:
+				start = i
+			depth += 1
+		elif c == '}':
+			depth -= 1
+			if depth == 0:
+				blocks.append((code[headerStart:start], start, i))
+				headerStart = i + 1
+		elif c == ';' and depth == 0:
+			headerStart = i + 1
+
+	return blocks
+
+
+sources = {}
+banked = set()
+
+for name in args.files:
+	with open(name, 'r') as f:
+		code, directives = splitPreprocessor(stripSource(f.read()))
+	sources[name] = (code, directives)
+
+	# Definitions and prototypes
+	for declaration in re.split(r'[;{}]', code):
+		function = functionName(declaration)
+		if USING.search(declaration) and function:
+			banked.add(function)
+
+errors = 0
+call = re.compile(r'\b(' + '|'.join(sorted(banked)) + r')\s*\(') if banked else None
+
+for name, (code, directives) in sources.items():
+	if call is None:
+		break
+
+	for header, start, end in functions(code):
+		function = functionName(header)
+		if function is None or USING.search(header):
+			continue
+
+		for c in call.finditer(code, start, end):
+			line = code.count('\n', 0, c.start()) + 1
+			print('%s:%d: %s() uses the register bank USB_ISR_BANK, but is called by %s()' % (name, line, c.group(1), function))
+			errors += 1
+
+	for line, directive in directives:
+		if not directive.lstrip('# \t').startswith('define'):
+			continue
+
+		for c in call.finditer(directive):
+			print('%s:%d: %s() uses the register bank USB_ISR_BANK, but is called by a macro' % (name, line, c.group(1)))
+			errors += 1
+
+sys.exit(1 if errors else 0)
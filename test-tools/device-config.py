@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+
+# Read / write the configuration persisted in the device data flash
+#
+# device-config.py                      Print the current configuration
+# device-config.py --autostart 1        Start streaming after enumeration
+# device-config.py --autostart 1 --output-format frames --sample-rate 500 --channel-mask 3
+# device-config.py --baud 115200
+
+import usbdevice
+import argparse
+import struct
+import sys
+import json
+import os
+
+GET_DEVICE_CONFIG = 0x66
+SET_DEVICE_CONFIG = 0x67
+
+# Layout of DeviceConfig in lib/config.h
+CONFIG_FORMAT = '<BB7sHBBBB'
+CONFIG_FLAG_AUTOSTART = 0x01
+
+# CONFIG_OUTPUT_*
+OUTPUT_FORMATS = ['text', 'stream', 'frames']
+
+path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+
+with open(path + '/usb-descriptor.json', 'r') as f:
+	descriptor = json.load(f)
+
+parser = argparse.ArgumentParser(description='Read / write the persisted device configuration')
+parser.add_argument('--baud', type=int, help='Line coding baud rate')
+parser.add_argument('--sample-rate', type=int, help='Sample frames on autostart: samples / s, 0 = as fast as possible')
+parser.add_argument('--channel-mask', type=lambda x: int(x, 0), help='Channels in a sample frame, bit n = channel n')
+parser.add_argument('--output-format', choices=OUTPUT_FORMATS, help='Sent on autostart')
+parser.add_argument('--autostart', type=int, choices=[0, 1], help='Start streaming after enumeration')
+args = parser.parse_args()
+
+vendor = int('0x' + descriptor['vendor'], 16)
+product = int('0x' + descriptor['product'], 16)
+
+dev = usbdevice.find(vendor, product)
+if dev is None:
+	print('Device (' + hex(vendor) + '/' + hex(product) + ') not found, may not running')
+	sys.exit(1)
+
+# Vendor request to the device, does not need to claim the CDC interfaces
+data = dev.ctrl_transfer(0xC0, GET_DEVICE_CONFIG, 0, 0, struct.calcsize(CONFIG_FORMAT))
+magic, version, lineCoding, sampleRate, channelMask, outputFormat, flags, checksum = struct.unpack(CONFIG_FORMAT, bytes(data))
+
+baud = struct.unpack('<I', lineCoding[0:4])[0]
+changed = False
+
+if args.baud is not None:
+	lineCoding = struct.pack('<I', args.baud) + lineCoding[4:]
+	changed = True
+
+if args.sample_rate is not None:
+	if args.sample_rate < 0 or args.sample_rate > 0xffff:
+		print('Sample rate: 0 ... 65535')
+		sys.exit(1)
+	sampleRate = args.sample_rate
+	changed = True
+
+if args.channel_mask is not None:
+	if args.channel_mask < 1 or args.channel_mask > 0xff:
+		print('Channel mask: 0x01 ... 0xff')
+		sys.exit(1)
+	channelMask = args.channel_mask
+	changed = True
+
+if args.output_format is not None:
+	outputFormat = OUTPUT_FORMATS.index(args.output_format)
+	changed = True
+
+if args.autostart is not None:
+	if args.autostart:
+		flags |= CONFIG_FLAG_AUTOSTART
+	else:
+		flags &= ~CONFIG_FLAG_AUTOSTART
+	changed = True
+
+if changed:
+	# Checksum is calculated by the device
+	data = struct.pack(CONFIG_FORMAT, magic, version, lineCoding, sampleRate, channelMask, outputFormat, flags, 0)
+	dev.ctrl_transfer(0x40, SET_DEVICE_CONFIG, 0, 0, data)
+	baud = struct.unpack('<I', lineCoding[0:4])[0]
+
+print('Baud:          ' + str(baud))
+print('Sample rate:   ' + str(sampleRate) + ' samples/s')
+print('Channel mask:  ' + hex(channelMask))
+print('Output format: ' + (OUTPUT_FORMATS[outputFormat] if outputFormat < len(OUTPUT_FORMATS) else str(outputFormat)))
+print('Autostart:     ' + ('yes' if flags & CONFIG_FLAG_AUTOSTART else 'no'))
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+
+# Receive binary sample frames from the device (command F of logic.c), check them,
+# and compare the size with the same samples sent as decimal text
+#
+# frame-check.py                     10000 frames from /dev/ttyACM0
+# frame-check.py /tmp/ttyCH55X -n 1000
+# frame-check.py -c 0x05             Channel mask of the device configuration, see device-config.py
+#
+# Exit code 1 if any frame was lost or invalid
+
+import serial
+import argparse
+import struct
+import sys
+from timeit import default_timer as timer
+
+from frame import FrameDecoder, FRAME_TYPE_SAMPLES
+
+# Channels, samples per frame if all are enabled, see logic.c
+FRAME_SAMPLES = 8
+
+parser = argparse.ArgumentParser(description='Check the binary sample frames')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('-n', '--frames', type=int, default=10000, help='Frame count, default 10000')
+parser.add_argument('-c', '--channel-mask', type=lambda x: int(x, 0), default=0xff, help='Channel mask of the device configuration, default 0xff')
+args = parser.parse_args()
+
+channels = [i for i in range(FRAME_SAMPLES) if args.channel_mask & (1 << i)]
+
+decoder = FrameDecoder()
+expected = 0
+lost = 0
+invalid = 0
+byteCount = 0
+textBytes = 0
+
+with serial.Serial(args.port, 115200, timeout=3) as ser:
+	ser.reset_input_buffer()
+	ser.write(('F %d\n' % args.frames).encode('ascii'))
+	start = timer()
+
+	while expected < args.frames:
+		data = ser.read(max(1, ser.in_waiting))
+		if not data:
+			break
+		byteCount += len(data)
+
+		for frameType, payload in decoder.feed(data):
+			if frameType != FRAME_TYPE_SAMPLES or len(payload) != 2 + len(channels) * 2:
+				invalid += 1
+				continue
+
+			values = struct.unpack('<%dH' % (len(channels) + 1), payload)
+
+			# 16 bit sequence number
+			sequence = expected + ((values[0] - expected) & 0xffff)
+			lost += sequence - expected
+
+			first = sequence * FRAME_SAMPLES
+			if list(values[1:]) != [(first + i) & 0xffff for i in channels]:
+				invalid += 1
+
+			expected = sequence + 1
+
+			# The same line as text: "<sequence> <sample> ... <sample>\n"
+			textBytes += len(' '.join(str(v) for v in values)) + 1
+
+	elapsed = timer() - start
+
+lost += args.frames - expected
+invalid += decoder.errors
+samples = decoder.frames * len(channels)
+
+print('Frames:     ' + str(decoder.frames))
+print('Lost:       ' + str(lost))
+print('Invalid:    ' + str(invalid))
+if samples:
+	print('Binary:     %.2f bytes per sample' % (byteCount / samples))
+	print('Text:       %.2f bytes per sample' % (textBytes / samples))
+	print('Samples/s:  %.0f' % (samples / elapsed))
+
+sys.exit(1 if lost or invalid else 0)
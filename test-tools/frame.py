@@ -0,0 +1,115 @@
+# Decoder for the binary frames of lib/frame.h
+#
+# Frame: uint8 type, uint8 length, payload, uint16 CRC-16/CCITT-FALSE (little endian),
+# COBS encoded and terminated with a 0 byte
+#
+# decoder = FrameDecoder()
+# for frameType, payload in decoder.feed(ser.read(ser.in_waiting or 1)):
+#     ...
+
+import binascii
+import struct
+
+# Frame types, see lib/frame.h
+FRAME_TYPE_SAMPLES = 0x01
+FRAME_TYPE_LOG = 0x02
+
+
+def cobsEncode(data):
+	"""
+	COBS encode, without the 0 delimiter
+	"""
+	result = bytearray()
+	block = bytearray()
+	for b in data:
+		if b == 0:
+			result.append(len(block) + 1)
+			result += block
+			block = bytearray()
+		else:
+			block.append(b)
+			if len(block) == 254:
+				result.append(255)
+				result += block
+				block = bytearray()
+	result.append(len(block) + 1)
+	result += block
+	return bytes(result)
+
+
+def cobsDecode(data):
+	"""
+	COBS decode a frame without the 0 delimiter, raises ValueError if invalid
+	"""
+	result = bytearray()
+	pos = 0
+	while pos < len(data):
+		code = data[pos]
+		if code == 0 or pos + code > len(data):
+			raise ValueError('Invalid COBS block')
+		result += data[pos + 1:pos + code]
+		pos += code
+		if code != 255 and pos < len(data):
+			result.append(0)
+	return bytes(result)
+
+
+def encodeFrame(frameType, payload):
+	"""
+	Encode a frame, as the firmware does, including the delimiter
+	"""
+	data = bytes([frameType, len(payload)]) + bytes(payload)
+	data += struct.pack('<H', binascii.crc_hqx(data, 0xffff))
+	return cobsEncode(data) + b'\0'
+
+
+class FrameDecoder:
+	"""
+	Stream decoder, feed it with any chunks of received data
+	"""
+
+	def __init__(self):
+		self.buffer = bytearray()
+		self.frames = 0
+		self.errors = 0
+
+	def feed(self, data):
+		"""
+		Returns a list of the completed frames, as (type, payload)
+		"""
+		frames = []
+		self.buffer += data
+
+		while True:
+			end = self.buffer.find(b'\0')
+			if end < 0:
+				break
+
+			encoded = bytes(self.buffer[:end])
+			del self.buffer[:end + 1]
+
+			frame = self.decode(encoded)
+			if frame is None:
+				self.errors += 1
+			else:
+				self.frames += 1
+				frames.append(frame)
+
+		return frames
+
+	def decode(self, encoded):
+		"""
+		Decode a single frame without the delimiter, None if invalid
+		"""
+		try:
+			data = cobsDecode(encoded)
+		except ValueError:
+			return None
+
+		if len(data) < 4 or data[1] != len(data) - 4:
+			return None
+
+		if binascii.crc_hqx(data[:-2], 0xffff) != struct.unpack('<H', data[-2:])[0]:
+			return None
+
+		return data[0], data[2:-2]
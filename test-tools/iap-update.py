@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+
+# Firmware update over the CDC port, without the ROM bootloader, see lib/iap.h
+#
+# iap-update.py ../build/ProjectName.ihx                        /dev/ttyACM0
+# iap-update.py ../build/ProjectName.bin /dev/ttyACM0 /dev/ttyACM1  Update several devices in parallel
+# iap-update.py ../build/ProjectName.ihx /tmp/ttyCH55X          Host simulation, see sim/pty.c
+#
+# The loader at 0x3000 is not part of the update: records of the .ihx within the loader are
+# skipped, a .bin is cut at 0x3000, if the .map next to it shows the application ends below.
+# Application data at or above 0x3000 is an error, the image would be incomplete.
+# If the update is interrupted, the device starts the ROM bootloader, and can be
+# flashed with chflasher (make flash).
+#
+# Exit code 1 if any device failed or the image is invalid
+
+import serial
+import argparse
+import binascii
+import os
+import re
+import struct
+import threading
+import time
+import sys
+from timeit import default_timer as timer
+
+# lib/iap.h
+IAP_ADDR = 0x3000
+IAP_MAGIC = b'IAPU'
+
+# ROM bootloader, the loader is below
+BOOT_ADDR = 0x3800
+
+parser = argparse.ArgumentParser(description='Update the firmware over the CDC port')
+parser.add_argument('image', help='Firmware, .ihx or .bin')
+parser.add_argument('ports', nargs='*', default=['/dev/ttyACM0'], help='Serial ports, default /dev/ttyACM0')
+parser.add_argument('--timeout', type=float, default=10, help='Timeout per device, default 10 s')
+args = parser.parse_args()
+
+
+def imageError(message):
+	print('Invalid image: ' + message)
+	sys.exit(1)
+
+
+def readMap(path):
+	"""
+	Code areas from the SDCC linker map next to the image, None if there is no map
+	"""
+	mapFile = os.path.splitext(path)[0] + '.map'
+	if not os.path.exists(mapFile):
+		return None
+
+	areas = []
+	with open(mapFile, 'r') as f:
+		for line in f:
+			m = re.match(r'^(\w+)\s+([0-9A-Fa-f]+)\s+([0-9A-Fa-f]+)\s+=\s+\d+\.\s+bytes\s+\(([^)]*)\)', line.strip())
+			if m and 'CODE' in m.group(4).split(','):
+				areas.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+	return areas
+
+
+def loaderRange(areas):
+	"""
+	Code range of the loader, the segment IAP of the map, else up to the ROM bootloader
+	"""
+	if areas:
+		for name, addr, size in areas:
+			if name == 'IAP':
+				return (addr, addr + size)
+
+	return (IAP_ADDR, BOOT_ADDR)
+
+
+def checkMap(areas):
+	"""
+	The application areas of the map need to end below the loader
+	"""
+	for name, addr, size in areas:
+		if name != 'IAP' and size and addr + size > IAP_ADDR:
+			imageError('%s ends at 0x%04X, the loader starts at 0x%04X' % (name, addr + size, IAP_ADDR))
+
+
+def readIhx(path):
+	"""
+	Intel HEX to binary, unused bytes are 0xff, records of the loader are skipped
+	"""
+	areas = readMap(path)
+	if areas:
+		checkMap(areas)
+	loaderBegin, loaderEnd = loaderRange(areas)
+
+	data = bytearray()
+	with open(path, 'r') as f:
+		for line in f:
+			line = line.strip()
+			if not line.startswith(':'):
+				continue
+
+			record = bytes.fromhex(line[1:])
+			length, addr, recordType = struct.unpack('>BHB', record[:4])
+			if recordType != 0 or length == 0:
+				continue
+
+			if addr >= loaderBegin and addr + length <= loaderEnd:
+				# The loader itself
+				continue
+
+			if addr + length > IAP_ADDR:
+				imageError('data at 0x%04X - 0x%04X, the application needs to end below 0x%04X'
+						% (addr, addr + length, IAP_ADDR))
+
+			if len(data) < addr + length:
+				data.extend(b'\xff' * (addr + length - len(data)))
+			data[addr:addr + length] = record[4:4 + length]
+	return bytes(data)
+
+
+def readImage(path):
+	if path.endswith('.ihx') or path.endswith('.hex'):
+		return readIhx(path)
+
+	with open(path, 'rb') as f:
+		data = f.read()
+
+	if len(data) <= IAP_ADDR:
+		return data
+
+	# The loader follows the application without gap, only the map tells where the application ends
+	areas = readMap(path)
+	if not areas:
+		imageError('%d bytes, larger than 0x%04X, and no .map next to it, use the .ihx' % (len(data), IAP_ADDR))
+	checkMap(areas)
+	return data[:IAP_ADDR]
+
+
+def update(port, image, results):
+	"""
+	Update one device, stores (ok, message) in results[port]
+	"""
+	start = timer()
+	try:
+		with serial.Serial(port, 115200, timeout=args.timeout) as ser:
+			ser.reset_input_buffer()
+			ser.write(b'U\n')
+			if ser.readline() != b'U\n':
+				results[port] = (False, 'No answer, firmware built with IAP=0?')
+				return
+
+			crc = binascii.crc_hqx(image, 0xffff)
+			ser.write(IAP_MAGIC + struct.pack('<HH', len(image), crc) + image)
+
+			answer = ser.readline().decode('ascii', 'replace').strip()
+			duration = timer() - start
+			if answer == 'U OK %04X' % crc:
+				results[port] = (True, '%.3f s, %.1f kB/s' % (duration, len(image) / duration / 1e3))
+			else:
+				results[port] = (False, 'Failed: "%s", expected CRC %04X' % (answer, crc))
+	except (serial.SerialException, OSError) as e:
+		results[port] = (False, str(e))
+
+
+image = readImage(args.image)
+if not image or len(image) > IAP_ADDR:
+	print('Invalid image, %d bytes, max. %d' % (len(image), IAP_ADDR))
+	sys.exit(1)
+
+print('Image %d bytes, CRC %04X' % (len(image), binascii.crc_hqx(image, 0xffff)))
+
+results = {}
+threads = [threading.Thread(target=update, args=(port, image, results)) for port in args.ports]
+
+start = timer()
+for t in threads:
+	t.start()
+for t in threads:
+	t.join()
+
+failed = False
+for port in args.ports:
+	ok, message = results.get(port, (False, 'No result'))
+	print('%-20s %s %s' % (port, 'OK ' if ok else 'ERR', message))
+	failed = failed or not ok
+
+print('Total %.3f s' % (timer() - start))
+sys.exit(1 if failed else 0)
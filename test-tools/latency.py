@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+# Round trip latency of the CDC link, per packet size
+#
+# latency.py                        All modes on /dev/ttyACM0
+# latency.py /tmp/ttyCH55X -m ping -n 500
+# latency.py --json latency.json
+#
+# Modes:
+#   loop  Echo in the main loop: UsbCdc_processInput -> logicCharReceived -> UsbCdc_puts, per byte
+#   isr   Echo directly in the USB interrupt, per packet
+#   ping  Timestamped ping, the device ticks split the round trip into device and host / USB time
+
+import serial
+import argparse
+import json
+from timeit import default_timer as timer
+
+parser = argparse.ArgumentParser(description='CDC round trip latency')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('-m', '--modes', default='loop,ping,isr', help='Comma separated list of modes')
+parser.add_argument('-s', '--sizes', default='1,8,32,63,64', help='Comma separated packet sizes for loop / isr')
+parser.add_argument('-n', '--count', type=int, default=1000, help='Round trips per size, default 1000')
+parser.add_argument('--tick-hz', type=float, default=2e6, help='Device ticks per second, FREQ_SYS / 12')
+parser.add_argument('--json', help='Write the results as JSON')
+args = parser.parse_args()
+
+results = []
+
+
+def percentile(values, p):
+	return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(mode, size, times, **extra):
+	"""
+	Print and store the distribution, times in microseconds
+	"""
+	times.sort()
+	result = {
+		'mode': mode,
+		'size': size,
+		'count': len(times),
+		'min_us': round(times[0], 1),
+		'p50_us': round(percentile(times, 50), 1),
+		'p90_us': round(percentile(times, 90), 1),
+		'p99_us': round(percentile(times, 99), 1),
+		'max_us': round(times[-1], 1)
+	}
+	result.update(extra)
+	results.append(result)
+
+	print('%-5s %4s  min %8.1f  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us %s' % (mode, size,
+			result['min_us'], result['p50_us'], result['p90_us'], result['p99_us'], result['max_us'],
+			' '.join(k + '=' + str(v) for k, v in extra.items())))
+
+
+def readExact(ser, length):
+	data = bytearray()
+	while len(data) < length:
+		chunk = ser.read(length - len(data))
+		if not chunk:
+			raise IOError('Timeout, received ' + str(len(data)) + ' of ' + str(length) + ' bytes')
+		data += chunk
+	return data
+
+
+def roundTrips(ser, size):
+	times = []
+	for i in range(args.count):
+		data = bytes((i + n) & 0xff for n in range(size))
+		start = timer()
+		ser.write(data)
+		if readExact(ser, size) != data:
+			raise IOError('Echo mismatch')
+		times.append((timer() - start) * 1e6)
+	return times
+
+
+def testLoop(ser, size):
+	ser.write(('E %d\n' % (size * args.count)).encode('ascii'))
+	report('loop', size, roundTrips(ser, size))
+
+
+def testIsr(ser, sizes):
+	# Echo mode ends when the port is closed
+	ser.write(b'I\n')
+	if ser.readline() != b'I\n':
+		raise IOError('Echo mode not confirmed')
+	for size in sizes:
+		report('isr', size, roundTrips(ser, size))
+
+
+def testPing(ser):
+	times = []
+	device = []
+
+	for i in range(args.count):
+		start = timer()
+		ser.write(('Q %d\n' % i).encode('ascii'))
+		line = ser.readline().decode('ascii').split()
+		times.append((timer() - start) * 1e6)
+
+		if len(line) != 4 or line[0] != 'Q' or int(line[1]) != i:
+			raise IOError('Unexpected answer: ' + str(line))
+
+		# 32 bit tick counter
+		device.append(((int(line[3]) - int(line[2])) & 0xffffffff) / args.tick_hz * 1e6)
+
+	device.sort()
+	report('ping', '', times, device_p50_us=round(percentile(device, 50), 1),
+			device_max_us=round(device[-1], 1))
+
+
+sizes = [int(s) for s in args.sizes.split(',')]
+modes = args.modes.split(',')
+
+for mode in modes:
+	with serial.Serial(args.port, 115200, timeout=3) as ser:
+		ser.reset_input_buffer()
+
+		if mode == 'loop':
+			for size in sizes:
+				testLoop(ser, size)
+		elif mode == 'isr':
+			testIsr(ser, sizes)
+		elif mode == 'ping':
+			testPing(ser)
+		else:
+			print('Unknown mode ' + mode)
+
+if args.json:
+	with open(args.json, 'w') as f:
+		json.dump(results, f, indent=2)
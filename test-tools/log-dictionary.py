@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+
+# Extract the format strings of the LOG_* calls (lib/log.h) into the log dictionary,
+# which is used by log-view.py to print the logs received from the device
+#
+# log-dictionary.py -o ProjectName-log.json ../lib/*.c ../*.c
+#
+# Exit code 1 if a file logs without LOG_MODULE, or a module ID is used twice
+
+import argparse
+import json
+import os
+import re
+import sys
+
+LEVELS = ['ERROR', 'WARN', 'INFO', 'DEBUG']
+
+parser = argparse.ArgumentParser(description='Create the log dictionary')
+parser.add_argument('files', nargs='+', help='C source files')
+parser.add_argument('-o', '--output', required=True, help='Dictionary, JSON')
+args = parser.parse_args()
+
+logCall = re.compile(r'\bLOG_(' + '|'.join(LEVELS) + r')\(\s*"((?:[^"\\]|\\.)*)"')
+moduleDefine = re.compile(r'^\s*#define\s+LOG_MODULE\s+(\d+)')
+formatSpec = re.compile(r'%[-0 #+]*\d*l*[udixXc]')
+
+# File names relative to the repository
+root = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
+
+dictionary = {}
+modules = {}
+error = False
+
+for filename in args.files:
+	name = os.path.relpath(os.path.realpath(filename), root)
+	module = None
+
+	with open(filename, 'r') as f:
+		lines = f.readlines()
+
+	for number, line in enumerate(lines, 1):
+		m = moduleDefine.match(line)
+		if m:
+			module = int(m.group(1))
+			if module in modules:
+				print(name + ': LOG_MODULE ' + str(module) + ' is already used by ' + modules[module])
+				error = True
+			modules[module] = name
+			continue
+
+		m = logCall.search(line)
+		if not m or line.lstrip().startswith(('//', '*')):
+			continue
+
+		if module is None:
+			print('%s:%d: LOG_%s without LOG_MODULE' % (name, number, m.group(1)))
+			error = True
+			continue
+
+		if number >= 4096:
+			print('%s:%d: line number does not fit into the log ID' % (name, number))
+			error = True
+			continue
+
+		fmt = m.group(2).encode('ascii').decode('unicode_escape')
+		if len(formatSpec.findall(fmt)) > 3:
+			print('%s:%d: more than 3 arguments' % (name, number))
+			error = True
+
+		dictionary['%d' % ((module << 12) | number)] = {
+			'level': m.group(1),
+			'file': name,
+			'line': number,
+			'format': fmt
+		}
+
+if error:
+	sys.exit(1)
+
+with open(args.output, 'w') as f:
+	json.dump(dictionary, f, indent=1, sort_keys=True)
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+
+# Print the tokenized logs of the device (lib/log.h), with the dictionary
+# created by log-dictionary.py at build time
+#
+# log-view.py ../build/ProjectName-log.json
+# log-view.py ../build/ProjectName-log.json /tmp/ttyCH55X --level INFO
+#
+# Other frames and data are ignored
+
+import serial
+import argparse
+import json
+import re
+import struct
+import time
+
+from frame import FrameDecoder, FRAME_TYPE_LOG
+
+LEVELS = ['ERROR', 'WARN', 'INFO', 'DEBUG']
+
+parser = argparse.ArgumentParser(description='Print the device logs')
+parser.add_argument('dictionary', help='Log dictionary, JSON')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('--level', default='DEBUG', choices=LEVELS, help='Max level to print')
+args = parser.parse_args()
+
+with open(args.dictionary, 'r') as f:
+	dictionary = json.load(f)
+
+formatSpec = re.compile(r'%[-0 #+]*\d*l*([udixXc])')
+
+
+def decodeVarints(data):
+	"""
+	Unsigned varints, 7 bit per byte, low bits first
+	"""
+	values = []
+	value = 0
+	shift = 0
+	for b in data:
+		value |= (b & 0x7f) << shift
+		shift += 7
+		if not b & 0x80:
+			values.append(value)
+			value = 0
+			shift = 0
+	return values
+
+
+def formatLog(fmt, values):
+	"""
+	printf style, the arguments are sent as unsigned 32 bit
+	"""
+	values = list(values)
+
+	def replace(m):
+		if not values:
+			return m.group(0)
+		value = values.pop(0)
+		if m.group(1) in 'di' and value & 0x80000000:
+			value -= 1 << 32
+		spec = m.group(0).replace('l', '')
+		if m.group(1) == 'u':
+			spec = spec[:-1] + 'd'
+		return spec % value
+
+	return formatSpec.sub(replace, fmt)
+
+
+def printLog(payload):
+	if len(payload) < 2:
+		return
+
+	logId = struct.unpack('<H', payload[:2])[0]
+	values = decodeVarints(payload[2:])
+	entry = dictionary.get(str(logId))
+	timestamp = time.strftime('%H:%M:%S')
+
+	if entry is None:
+		print('%s ?     Unknown log ID 0x%04x %s' % (timestamp, logId, values))
+		return
+
+	if LEVELS.index(entry['level']) > LEVELS.index(args.level):
+		return
+
+	print('%s %-5s %s:%d %s' % (timestamp, entry['level'], entry['file'], entry['line'],
+			formatLog(entry['format'], values)))
+
+
+decoder = FrameDecoder()
+
+with serial.Serial(args.port, 115200, timeout=1) as ser:
+	while True:
+		for frameType, payload in decoder.feed(ser.read(max(1, ser.in_waiting))):
+			if frameType == FRAME_TYPE_LOG:
+				printLog(payload)
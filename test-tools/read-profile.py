@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+
+# Read the profiling counters of a firmware built with PROFILE=1
+# A vendor request on EP0 is used, so the CDC data stream is not disturbed
+#
+# read-profile.py           Print the counters
+# read-profile.py --reset   Print and reset the counters
+# read-profile.py -i 1      Print the counters every second
+
+import usbdevice
+import argparse
+import struct
+import sys
+import json
+import os
+import time
+
+GET_PROFILE_COUNTERS = 0x68
+
+# Layout of ProfileCounters in lib/profile.h
+PROFILE_FORMAT = '<IIHIIIIIIhHH'
+
+path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+
+with open(path + '/usb-descriptor.json', 'r') as f:
+	descriptor = json.load(f)
+
+parser = argparse.ArgumentParser(description='Read the profiling counters')
+parser.add_argument('--reset', action='store_true', help='Reset the counters after reading')
+parser.add_argument('--freq', type=float, default=24e6, help='FREQ_SYS of the firmware, default 24 MHz')
+parser.add_argument('-i', '--interval', type=float, help='Repeat every n seconds')
+args = parser.parse_args()
+
+vendor = int('0x' + descriptor['vendor'], 16)
+product = int('0x' + descriptor['product'], 16)
+
+dev = usbdevice.find(vendor, product)
+if dev is None:
+	print('Device (' + hex(vendor) + '/' + hex(product) + ') not found, may not running')
+	sys.exit(1)
+
+def us(cycles):
+	return '%10.2f us' % (cycles * 1e6 / args.freq)
+
+def average(total, count):
+	if count == 0:
+		return 0
+	return total / count
+
+def readCounters():
+	try:
+		data = dev.ctrl_transfer(0xC0, GET_PROFILE_COUNTERS, 1 if args.reset else 0, 0, struct.calcsize(PROFILE_FORMAT))
+	except usbdevice.USBError:
+		print('Request failed, firmware built without PROFILE=1?')
+		sys.exit(2)
+
+	(usbIsrCount, usbIsrTotal, usbIsrMax,
+		loopCount, loopTotal, loopMax,
+		putsWaitCount, putsWaitTotal, outNakCount,
+		sofDriftPpm, sofWindows, sofRejected) = struct.unpack(PROFILE_FORMAT, bytes(data))
+
+	print('USB interrupt    count %10d  avg %s  max %s' % (usbIsrCount, us(average(usbIsrTotal, usbIsrCount)), us(usbIsrMax)))
+	print('Main loop        count %10d  avg %s  max %s' % (loopCount, us(average(loopTotal, loopCount)), us(loopMax)))
+	print('UsbCdc_puts wait count %10d  avg %s  total %s' % (putsWaitCount, us(average(putsWaitTotal, putsWaitCount)), us(putsWaitTotal)))
+	print('NAKed OUT packets      %10d' % outNakCount)
+	print('SOF timer drift        %10d ppm  windows %d  rejected %d' % (sofDriftPpm, sofWindows, sofRejected))
+
+while True:
+	readCounters()
+	if args.interval is None:
+		break
+
+	print()
+	time.sleep(args.interval)
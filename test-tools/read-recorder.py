@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+
+# Read the flight recorder of the device (lib/recorder.h), oldest event first
+# A vendor request on EP0 is used, so the CDC data stream is not disturbed
+#
+# read-recorder.py          Print the events
+# read-recorder.py --json   Print the events as JSON
+
+import usbdevice
+import argparse
+import struct
+import sys
+import json
+import os
+
+GET_RECORDER = 0x6A
+
+# Layout of Recorder in lib/recorder.h
+RECORDER_MAGIC = 0x5245
+RECORDER_EVENTS = 32
+HEADER_FORMAT = '<HBB'
+EVENT_FORMAT = '<BBI'
+
+# RECORDER_EVENT_*, with the meaning of the data byte
+EVENT_NAMES = {
+	1: ('Boot', 'reset flags'),
+	2: ('Bus reset', None),
+	3: ('Suspend', None),
+	4: ('SETUP', 'request'),
+	5: ('STALL', 'request'),
+	6: ('Toggle error', 'endpoint'),
+	7: ('Configured', 'configuration'),
+	8: ('TX stall', 'ms'),
+	9: ('Bootloader', None),
+	10: ('Restored from flash', 'events'),
+	11: ('Watchdog recovered', 'ms')
+}
+
+RESET_FLAGS = {0x00: 'software', 0x10: 'power on', 0x20: 'watchdog', 0x30: 'reset pin'}
+
+path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+
+with open(path + '/usb-descriptor.json', 'r') as f:
+	descriptor = json.load(f)
+
+parser = argparse.ArgumentParser(description='Read the flight recorder')
+parser.add_argument('--json', action='store_true', help='Print as JSON')
+parser.add_argument('--tick-hz', type=float, default=2e6, help='Timer ticks per second, FREQ_SYS / 12')
+args = parser.parse_args()
+
+vendor = int('0x' + descriptor['vendor'], 16)
+product = int('0x' + descriptor['product'], 16)
+
+dev = usbdevice.find(vendor, product)
+if dev is None:
+	print('Device (' + hex(vendor) + '/' + hex(product) + ') not found, may not running')
+	sys.exit(1)
+
+size = struct.calcsize(HEADER_FORMAT) + RECORDER_EVENTS * struct.calcsize(EVENT_FORMAT)
+data = b''
+
+try:
+	# Recording is stopped until the last block is read
+	while len(data) < size:
+		length = min(64, size - len(data))
+		freeze = 1 if len(data) + length < size else 0
+		data += bytes(dev.ctrl_transfer(0xC0, GET_RECORDER, freeze, len(data), length))
+except usbdevice.USBError:
+	print('Request failed, firmware built with RECORDER=0?')
+	sys.exit(2)
+
+magic, pos, frozen = struct.unpack_from(HEADER_FORMAT, data)
+if magic != RECORDER_MAGIC:
+	print('Invalid recorder data')
+	sys.exit(2)
+
+events = []
+offset = struct.calcsize(HEADER_FORMAT)
+for i in range(RECORDER_EVENTS):
+	index = (pos + i) % RECORDER_EVENTS
+	eventType, eventData, ticks = struct.unpack_from(EVENT_FORMAT, data,
+			offset + index * struct.calcsize(EVENT_FORMAT))
+	if eventType == 0:
+		continue
+	events.append({'type': eventType, 'data': eventData, 'ticks': ticks})
+
+if args.json:
+	print(json.dumps(events, indent=1))
+	sys.exit(0)
+
+last = None
+for event in events:
+	name, dataName = EVENT_NAMES.get(event['type'], ('Unknown ' + str(event['type']), 'data'))
+
+	# Time since the previous event, the tick counter restarts on boot
+	delta = ''
+	if last is not None and event['type'] != 1:
+		delta = '+%.3f ms' % (((event['ticks'] - last) & 0xffffffff) * 1e3 / args.tick_hz)
+	last = event['ticks']
+
+	detail = ''
+	if event['type'] == 1:
+		detail = RESET_FLAGS.get(event['data'], hex(event['data']))
+	elif dataName:
+		detail = dataName + ' ' + hex(event['data'])
+
+	print('%12.3f ms %14s  %-20s %s' % (event['ticks'] * 1e3 / args.tick_hz, delta, name, detail))
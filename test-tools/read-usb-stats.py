@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+
+# Read the USB error and flow statistics of the device
+# A vendor request on EP0 is used, so the CDC data stream is not disturbed
+#
+# read-usb-stats.py           Print the statistics
+# read-usb-stats.py --reset   Print and reset the statistics
+# read-usb-stats.py -i 1      Print the statistics every second
+
+import usbdevice
+import argparse
+import struct
+import sys
+import json
+import os
+import time
+
+GET_USB_STATS = 0x69
+
+# Layout of UsbStats in lib/usb-stats.h
+STATS_FORMAT = '<HHHHHHHIIIIHBBHIH'
+STATS_NAMES = [
+	'Bus resets',
+	'Suspend',
+	'EP0 SETUP',
+	'EP0 STALL',
+	'EP0 toggle errors',
+	'Endpoint halt by host',
+	'EP1 IN',
+	'EP2 IN packets',
+	'EP2 IN bytes',
+	'EP2 OUT packets',
+	'EP2 OUT bytes',
+	'EP2 OUT toggle errors',
+	'EP2 OUT high water',
+	'EP2 IN high water',
+	'UsbCdc_puts truncated',
+	'UsbCdc_puts dropped bytes',
+	'EP2 IN timeouts'
+]
+
+path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+
+with open(path + '/usb-descriptor.json', 'r') as f:
+	descriptor = json.load(f)
+
+parser = argparse.ArgumentParser(description='Read the USB statistics')
+parser.add_argument('--reset', action='store_true', help='Reset the statistics after reading')
+parser.add_argument('-i', '--interval', type=float, help='Repeat every n seconds')
+args = parser.parse_args()
+
+vendor = int('0x' + descriptor['vendor'], 16)
+product = int('0x' + descriptor['product'], 16)
+
+dev = usbdevice.find(vendor, product)
+if dev is None:
+	print('Device (' + hex(vendor) + '/' + hex(product) + ') not found, may not running')
+	sys.exit(1)
+
+def readStats():
+	try:
+		data = dev.ctrl_transfer(0xC0, GET_USB_STATS, 1 if args.reset else 0, 0, struct.calcsize(STATS_FORMAT))
+	except usbdevice.USBError:
+		print('Request failed, firmware built with USB_STATS=0?')
+		sys.exit(2)
+
+	values = struct.unpack(STATS_FORMAT, bytes(data))
+	for name, value in zip(STATS_NAMES, values):
+		print('%-26s %10d' % (name, value))
+
+while True:
+	readStats()
+	if args.interval is None:
+		break
+
+	print()
+	time.sleep(args.interval)
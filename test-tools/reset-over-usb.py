@@ -1,8 +1,7 @@
 #!/usr/bin/env python3
 
 
-import usb.core
-import usb.util
+import usbdevice
 import sys
 import json
 import os
@@ -16,21 +15,23 @@ with open(path + '/usb-descriptor.json', 'r') as f:
 vendor = int('0x' + descriptor['vendor'], 16)
 product = int('0x' + descriptor['product'], 16)
 
-dev = usb.core.find(idVendor = vendor, idProduct = product)
+dev = usbdevice.find(vendor, product)
 if dev is None:
     print('Device (' + hex(vendor) + '/' + hex(product) + ') not found, may not running')
     sys.exit()
 
 try:
 	# Detach interfaces if Linux already attached a driver on it.
-	for itf_num in [0, 1]:
+	# The simulation has no kernel driver to detach
+	for itf_num in ([] if getattr(dev, 'simulated', False) else [0, 1]):
 		#itf = usb.util.find_descriptor(dev.get_active_configuration(), bInterfaceNumber=itf_num)
 
 		if dev.is_kernel_driver_active(itf_num):
 			dev.detach_kernel_driver(itf_num)
+		import usb.util
 		usb.util.claim_interface(dev, itf_num)
 
-except usb.core.USBError as ex:
+except usbdevice.USBError as ex:
     print('Could not access USB Device')
 
     if str(ex).startswith('[Errno 13]') and platform.system() == 'Linux':
@@ -51,11 +52,14 @@ try:
 	RESET_DEVICE_TO_BOOTLOADER = 0x65
 	result = dev.ctrl_transfer(0x21, RESET_DEVICE_TO_BOOTLOADER, 0x01, 0, None)
 
-except usb.core.USBError as ex:
+	# The request is answered, the device jumps to the bootloader afterwards
+	print('Device resetting to the bootloader')
+
+except usbdevice.USBError as ex:
     print('Exception occured, probably is the device now resetted, all OK!')
-    
-    # Sleep, so the device is detected
-    time.sleep(1)
+
+# Sleep, so the device is detected
+time.sleep(1)
 
 
 
@@ -1,11 +1,17 @@
 #!/usr/bin/env python3
 
+# serial-speedtest.py [port], default /dev/ttyACM0
+# With the host simulation: make -C sim pty, serial-speedtest.py /tmp/ttyCH55X
+
 import serial
+import sys
 from timeit import default_timer as timer
 
+port = sys.argv[1] if len(sys.argv) > 1 else '/dev/ttyACM0'
+
 print("Measure Serial Speed")
 
-with serial.Serial('/dev/ttyACM0', 19200, timeout=3) as ser:
+with serial.Serial(port, 19200, timeout=3) as ser:
 	ser.write(b's') # Write to start speedtset
 	start = timer()
 	s = ser.readline()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+# Stream sequence numbered, CRC protected packets from the device (command P of logic.c),
+# and check them for loss, reordering / duplicates and corruption
+#
+# stream-check.py                           100000 packets from /dev/ttyACM0
+# stream-check.py /tmp/ttyCH55X -n 10000
+# stream-check.py -t 60                     Endless stream, stopped after 60 seconds
+#
+# Exit code 1 if any packet was lost, reordered, duplicated or corrupted
+
+import serial
+import argparse
+import binascii
+import struct
+import sys
+from timeit import default_timer as timer
+
+# Layout of the stream packet, see logic.c
+PACKET_LEN = 64
+CRC_OFFSET = PACKET_LEN - 2
+
+parser = argparse.ArgumentParser(description='Check the sequence numbered test stream')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('-n', '--packets', type=int, default=100000, help='Packet count, default 100000')
+parser.add_argument('-t', '--time', type=float, help='Stream endless, and stop after n seconds')
+args = parser.parse_args()
+
+
+def packetValid(packet):
+	crc = struct.unpack('<H', packet[CRC_OFFSET:])[0]
+	return binascii.crc_hqx(bytes(packet[:CRC_OFFSET]), 0xffff) == crc
+
+
+packets = 0
+lost = 0
+reordered = 0
+corrupted = 0
+skippedBytes = 0
+expected = 0
+buffer = bytearray()
+
+with serial.Serial(args.port, 115200, timeout=3) as ser:
+	ser.reset_input_buffer()
+
+	if args.time:
+		ser.write(b'P 0\n')
+	else:
+		ser.write(('P %d\n' % args.packets).encode('ascii'))
+
+	start = timer()
+	lastData = start
+	stopped = False
+
+	while True:
+		if args.time and not stopped and timer() - start > args.time:
+			# Any byte stops the stream, the remaining data is still checked
+			ser.write(b'x')
+			stopped = True
+
+		data = ser.read(max(PACKET_LEN, ser.in_waiting))
+		if not data:
+			break
+
+		buffer += data
+		lastData = timer()
+
+		while len(buffer) >= PACKET_LEN:
+			packet = buffer[:PACKET_LEN]
+
+			if not packetValid(packet):
+				# Resync: drop one byte, until a valid packet starts
+				if skippedBytes == 0:
+					corrupted += 1
+				skippedBytes += 1
+				del buffer[0]
+				continue
+
+			skippedBytes = 0
+			del buffer[:PACKET_LEN]
+
+			sequence = struct.unpack('<I', packet[:4])[0]
+			if sequence > expected:
+				lost += sequence - expected
+			elif sequence < expected:
+				reordered += 1
+				continue
+
+			packets += 1
+			expected = sequence + 1
+
+		if not args.time and expected >= args.packets:
+			break
+
+	elapsed = lastData - start
+
+if not args.time and expected < args.packets:
+	lost += args.packets - expected
+
+if buffer:
+	corrupted += 1
+
+byteCount = packets * PACKET_LEN
+print('Packets:    ' + str(packets))
+print('Lost:       ' + str(lost))
+print('Reordered:  ' + str(reordered) + ' (or duplicated)')
+print('Corrupted:  ' + str(corrupted))
+print('Time:       %.3f s' % elapsed)
+print('Throughput: %.1f kB/s' % (byteCount / elapsed / 1000))
+
+sys.exit(1 if lost or reordered or corrupted else 0)
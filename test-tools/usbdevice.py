@@ -0,0 +1,74 @@
+# Find the device with pyusb, or connect to the host simulation (sim/pty.c)
+# if the environment variable CH55X_SIM_SOCKET is set:
+#
+# make -C sim pty
+# CH55X_SIM_SOCKET=/tmp/ch55x-sim.sock ./read-usb-stats.py
+
+import os
+import socket
+import struct
+
+SIM_SOCKET = os.environ.get('CH55X_SIM_SOCKET')
+
+if SIM_SOCKET:
+	class USBError(IOError):
+		pass
+else:
+	import usb.core
+	USBError = usb.core.USBError
+
+
+class SimDevice:
+	"""
+	Stand-in for a pyusb device, control transfers are forwarded to the simulation
+	"""
+
+	simulated = True
+
+	def __init__(self, path):
+		self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+		self.sock.connect(path)
+
+	def _read(self, length):
+		data = b''
+		while len(data) < length:
+			chunk = self.sock.recv(length - len(data))
+			if not chunk:
+				raise USBError('Simulation disconnected')
+			data += chunk
+		return data
+
+	def ctrl_transfer(self, bmRequestType, bRequest, wValue = 0, wIndex = 0, data_or_wLength = None, timeout = None):
+		if bmRequestType & 0x80:
+			length = data_or_wLength or 0
+			data = b''
+		else:
+			data = bytes(data_or_wLength or b'')
+			length = len(data)
+
+		self.sock.sendall(struct.pack('<BBHHH', bmRequestType, bRequest, wValue, wIndex, length) + data)
+		result = struct.unpack('<h', self._read(2))[0]
+
+		if result < 0:
+			raise USBError('Pipe error (STALL)')
+
+		if bmRequestType & 0x80:
+			return bytearray(self._read(result))
+
+		return result
+
+	def is_kernel_driver_active(self, interface):
+		return False
+
+
+def find(vendor, product):
+	"""
+	Find the device, None if not found
+	"""
+	if SIM_SOCKET:
+		try:
+			return SimDevice(SIM_SOCKET)
+		except OSError:
+			return None
+
+	return usb.core.find(idVendor = vendor, idProduct = product)
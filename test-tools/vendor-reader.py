@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+
+# Read the stream of the vendor bulk interface (EP3, firmware built with VENDOR_BULK=1)
+# with asynchronous libusb transfers, several are queued, so the host controller
+# always has a buffer for the next packet. The stream is started with the command V
+# of logic.c over the CDC port, and checked like stream-check.py.
+#
+# vendor-reader.py                           100000 packets, 8 transfers queued
+# vendor-reader.py -n 10000 -q 32 -s 4096    32 transfers of 4096 bytes
+# vendor-reader.py -t 60 /dev/ttyACM1        Endless stream, stopped after 60 seconds
+#
+# Needs python-libusb1 (pip install libusb1), the simulation has no vendor endpoint on the socket.
+# Exit code 1 if any packet was lost, reordered, duplicated or corrupted
+
+import usb1
+import serial
+import argparse
+import binascii
+import struct
+import sys
+import json
+import os
+from timeit import default_timer as timer
+
+path = os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor'
+with open(path + '/usb-descriptor.json', 'r') as f:
+	descriptor = json.load(f)
+
+# Interface number and endpoints of the vendor interface in usb-descriptor.json
+VENDOR_INTERFACE = 2
+EP_IN = 0x83
+EP_OUT = 0x03
+
+# Layout of the stream packet, see logic.c
+PACKET_LEN = 64
+CRC_OFFSET = PACKET_LEN - 2
+
+parser = argparse.ArgumentParser(description='Read the vendor bulk stream with queued libusb transfers')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='CDC port to start the stream, default /dev/ttyACM0')
+parser.add_argument('-n', '--packets', type=int, default=100000, help='Packet count, default 100000')
+parser.add_argument('-t', '--time', type=float, help='Stream endless, and stop after n seconds')
+parser.add_argument('-q', '--queue', type=int, default=8, help='Transfers queued, default 8')
+parser.add_argument('-s', '--size', type=int, default=1024, help='Bytes per transfer, multiple of 64, default 1024')
+args = parser.parse_args()
+
+if args.size % PACKET_LEN:
+	print('Transfer size needs to be a multiple of %d' % PACKET_LEN)
+	sys.exit(1)
+
+
+class StreamCheck:
+	"""
+	Sequence and CRC check of the received packets
+	"""
+
+	def __init__(self):
+		self.packets = 0
+		self.lost = 0
+		self.reordered = 0
+		self.corrupted = 0
+		self.expected = 0
+		self.bytes = 0
+
+	def add(self, data):
+		self.bytes += len(data)
+		for pos in range(0, len(data) - PACKET_LEN + 1, PACKET_LEN):
+			packet = data[pos:pos + PACKET_LEN]
+			crc = struct.unpack('<H', packet[CRC_OFFSET:])[0]
+			if binascii.crc_hqx(bytes(packet[:CRC_OFFSET]), 0xffff) != crc:
+				self.corrupted += 1
+				continue
+
+			sequence = struct.unpack('<I', packet[:4])[0]
+			if sequence > self.expected:
+				self.lost += sequence - self.expected
+			elif sequence < self.expected:
+				self.reordered += 1
+			self.expected = sequence + 1
+			self.packets += 1
+
+
+check = StreamCheck()
+transfers = []
+running = True
+done = False
+
+# Time of the first and last completed transfer
+firstCompletion = None
+lastCompletion = None
+
+
+def onTransfer(transfer):
+	global done, firstCompletion, lastCompletion
+
+	status = transfer.getStatus()
+	if status in (usb1.TRANSFER_COMPLETED, usb1.TRANSFER_TIMED_OUT):
+		# A timed out transfer can contain data, too
+		if transfer.getActualLength():
+			lastCompletion = timer()
+			if firstCompletion is None:
+				firstCompletion = lastCompletion
+			check.add(transfer.getBuffer()[:transfer.getActualLength()])
+	else:
+		# Cancelled or device gone
+		done = True
+		return
+
+	if not args.time and check.packets + check.lost >= args.packets:
+		done = True
+
+	if running and not done:
+		# Queue the transfer again, the buffer is reused
+		transfer.submit()
+
+
+with usb1.USBContext() as context:
+	handle = context.openByVendorIDAndProductID(int('0x' + descriptor['vendor'], 16),
+		int('0x' + descriptor['product'], 16), skip_on_error=True)
+	if handle is None:
+		print('Device not found')
+		sys.exit(1)
+
+	configuration = handle.getDevice()[0]
+	if configuration.getNumInterfaces() <= VENDOR_INTERFACE:
+		print('No vendor interface, firmware built with VENDOR_BULK=0?')
+		sys.exit(1)
+
+	handle.claimInterface(VENDOR_INTERFACE)
+
+	for i in range(args.queue):
+		transfer = handle.getTransfer()
+		transfer.setBulk(EP_IN, args.size, callback=onTransfer, timeout=1000)
+		transfer.submit()
+		transfers.append(transfer)
+
+	with serial.Serial(args.port, 115200, timeout=3) as ser:
+		start = timer()
+		if args.time:
+			ser.write(b'V 0\n')
+		else:
+			ser.write(('V %d\n' % args.packets).encode('ascii'))
+
+		try:
+			while not done:
+				context.handleEventsTimeout(0.1)
+				if args.time and timer() - start >= args.time:
+					break
+				if not args.time and lastCompletion is not None and timer() - lastCompletion > 3:
+					# Stream ended early
+					break
+		except KeyboardInterrupt:
+			pass
+
+		duration = (lastCompletion or timer()) - start
+		running = False
+
+		if args.time:
+			# Any packet on EP3 OUT stops the endless stream
+			handle.bulkWrite(EP_OUT, b'x', timeout=1000)
+
+		for transfer in transfers:
+			try:
+				transfer.cancel()
+			except usb1.USBError:
+				pass
+		while any(t.isSubmitted() for t in transfers):
+			context.handleEventsTimeout(0.1)
+
+	handle.releaseInterface(VENDOR_INTERFACE)
+
+print('%d packets, %.3f s, %.1f kB/s, %d transfers of %d bytes queued' % (
+	check.packets, duration, check.bytes / duration / 1e3 if duration > 0 else 0, args.queue, args.size))
+if firstCompletion is not None:
+	print('First transfer completed after %.2f ms' % ((firstCompletion - start) * 1e3))
+print('Lost %d, reordered / duplicated %d, corrupted %d' % (check.lost, check.reordered, check.corrupted))
+
+failed = check.lost or check.reordered or check.corrupted or (not args.time and check.packets < args.packets)
+sys.exit(1 if failed else 0)
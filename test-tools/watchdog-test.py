@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+
+# Watchdog recovery test: starts the packet stream (command P of logic.c), lets the
+# firmware hang (command H, firmware built with WATCHDOG_TEST=1), and measures the time until the stream continues after
+# the watchdog reset. The stream has to continue with the next sequence number.
+#
+# watchdog-test.py                  /dev/ttyACM0
+# watchdog-test.py /tmp/ttyCH55X    Host simulation, see sim/pty.c
+#
+# The device state (watchdog resets, recovery time measured by the device) is read
+# with a vendor request, if pyusb is available.
+#
+# Exit code 1 if the stream did not continue, more than one packet was lost,
+# or the outage took longer than --max-ms
+
+import serial
+import argparse
+import binascii
+import struct
+import json
+import time
+import sys
+import os
+from timeit import default_timer as timer
+
+GET_WATCHDOG = 0x6B
+
+# Layout of the stream packet, see logic.c
+PACKET_LEN = 64
+CRC_OFFSET = PACKET_LEN - 2
+
+# WarmState in lib/watchdog.h, without the application state
+WATCHDOG_FORMAT = '<HHI'
+WARM_MAGIC = 0x574D
+
+parser = argparse.ArgumentParser(description='Measure the watchdog recovery')
+parser.add_argument('port', nargs='?', default='/dev/ttyACM0', help='Serial port, default /dev/ttyACM0')
+parser.add_argument('-n', '--packets', type=int, default=200, help='Packets before and after the hang, default 200')
+parser.add_argument('--max-ms', type=float, default=3000, help='Max. outage, default 3000 ms')
+parser.add_argument('--tick-hz', type=float, default=2e6, help='Timer ticks per second, FREQ_SYS / 12')
+args = parser.parse_args()
+
+
+def packetSequence(packet):
+	"""
+	Sequence number of a stream packet, None if the CRC is wrong
+	"""
+	crc = struct.unpack('<H', packet[CRC_OFFSET:])[0]
+	if binascii.crc_hqx(bytes(packet[:CRC_OFFSET]), 0xffff) != crc:
+		return None
+	return struct.unpack_from('<I', packet)[0]
+
+
+def openPort(deadline):
+	"""
+	Open the port, the device disappears during the reset
+	"""
+	while True:
+		try:
+			return serial.Serial(args.port, 115200, timeout=0.05)
+		except serial.SerialException:
+			if timer() > deadline:
+				return None
+			time.sleep(0.01)
+
+
+def readDeviceState():
+	"""
+	Watchdog state of the device, None without pyusb / device
+	"""
+	try:
+		import usbdevice
+	except ImportError:
+		return None
+
+	path = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + '/../usb-descriptor')
+	with open(path + '/usb-descriptor.json', 'r') as f:
+		descriptor = json.load(f)
+
+	dev = usbdevice.find(int('0x' + descriptor['vendor'], 16), int('0x' + descriptor['product'], 16))
+	if dev is None:
+		return None
+
+	try:
+		data = bytes(dev.ctrl_transfer(0xC0, GET_WATCHDOG, 0, 0, struct.calcsize(WATCHDOG_FORMAT)))
+	except usbdevice.USBError:
+		print('Request failed, firmware built with WATCHDOG=0?')
+		return None
+
+	magic, resets, recoveryTicks = struct.unpack(WATCHDOG_FORMAT, data)
+	if magic != WARM_MAGIC:
+		return None
+
+	return resets, recoveryTicks
+
+
+before = readDeviceState()
+
+ser = openPort(timer() + 1)
+if ser is None:
+	print('Cannot open ' + args.port)
+	sys.exit(1)
+
+ser.reset_input_buffer()
+# Sent until the test is done, the last packets are stopped with another P command
+ser.write(('P %d\n' % (args.packets * 10)).encode('ascii'))
+
+buffer = bytearray()
+expected = 0
+received = 0
+lastData = timer()
+hangSent = None
+outage = None
+lost = 0
+corrupted = False
+
+while True:
+	try:
+		data = ser.read(PACKET_LEN * 16)
+	except serial.SerialException:
+		# USB disconnect on reset, wait for the new enumeration
+		ser.close()
+		buffer = bytearray()
+		ser = openPort(lastData + args.max_ms / 1000 + 5)
+		if ser is None:
+			break
+		continue
+
+	now = timer()
+	if not data:
+		if now - lastData > args.max_ms / 1000 + 5:
+			break
+		continue
+
+	buffer += data
+
+	while len(buffer) >= PACKET_LEN:
+		sequence = packetSequence(buffer[:PACKET_LEN])
+		del buffer[:PACKET_LEN]
+
+		if sequence is None:
+			corrupted = True
+			continue
+
+		if hangSent is not None and outage is None and now - lastData > 0.05:
+			# First packet after the recovery, the packet in the endpoint buffer may be lost
+			outage = now - lastData
+			lost = sequence - expected
+
+		expected = sequence + 1
+		received += 1
+		lastData = now
+
+	if hangSent is None and received >= args.packets:
+		ser.write(b'H\n')
+		hangSent = now
+	elif outage is not None and received >= args.packets * 2:
+		break
+
+if ser is not None:
+	ser.write(b'P 1\n')
+	ser.close()
+
+if outage is None:
+	print('The stream did not continue after the hang, %d packets received' % received)
+	sys.exit(1)
+
+print('Stream continued after %.1f ms, %d packets lost, %d packets received' % (outage * 1e3, lost, received))
+
+after = readDeviceState()
+if after is not None:
+	resets, recoveryTicks = after
+	if before is not None and resets != before[0] + 1:
+		print('Unexpected watchdog reset count %d, before %d' % (resets, before[0]))
+	print('Device: %d watchdog resets, %.3f ms from boot until the stream continued'
+		% (resets, recoveryTicks * 1e3 / args.tick_hz))
+
+if corrupted:
+	print('Corrupted packets received')
+
+if corrupted or lost < 0 or lost > 1 or outage * 1e3 > args.max_ms:
+	sys.exit(1)
@@ -1,13 +1,75 @@
 #!/usr/bin/env python3
 
+# Generates from usb-descriptor.json:
+#   usb-descriptor.h  The descriptors, and the descriptor table, so GET_DESCRIPTOR
+#                     is answered with one table lookup. Included by lib/usb-cdc.c only.
+#   usb-layout.h      Interface count, endpoint configuration and
+#                     XRAM buffer addresses, defines only
+#   usb-layout.mk     XRAM range of the compiler, included by build/Makefile
+#
+# Interfaces with "option" are only enabled if the option is set in the Makefile
+# (e.g. VENDOR_BULK=1, defined as VENDOR_BULK_ENABLE), the layout and the descriptors
+# are generated for each combination of the options.
+#
+# Only the interfaces the firmware serves are accepted: the CDC interface of lib/usb-cdc.c,
+# and the vendor bulk interface of lib/vendor.c, USBDeviceEndPointCfg() and the USB interrupt
+# set up these endpoints only.
+#
+# generate.py                        Generate from usb-descriptor.json
+# generate.py --check other.json     Only check other.json, nothing is written
+#
+# Exit code 1 if the descriptor is not supported by the firmware
+
+import argparse
+import itertools
 import json
 import os
+import sys
 
 path = os.path.dirname(os.path.realpath(__file__))
 
-with open(path + '/usb-descriptor.json', 'r') as f:
+parser = argparse.ArgumentParser(description='Generate the USB descriptors and the XRAM layout')
+parser.add_argument('descriptor', nargs='?', default=path + '/usb-descriptor.json', help='Descriptor, default usb-descriptor.json')
+parser.add_argument('--check', action='store_true', help='Only check the descriptor, write nothing')
+args = parser.parse_args()
+
+with open(args.descriptor, 'r') as f:
 	descriptor = json.load(f)
 
+# USB_DESCR_TYP_*
+TYPE_DEVICE = 1
+TYPE_CONFIGURATION = 2
+TYPE_STRING = 3
+
+# Each endpoint direction uses a 64 byte XRAM buffer, EP0 starts at 0
+BUFFER_SIZE = 64
+
+# Not initialized by the startup code, after the USB buffers: flight recorder (lib/recorder.h)
+# and watchdog warm state (lib/watchdog.h)
+NOINIT_SIZE = 0x100
+
+XRAM_END = 0x400
+
+ENDPOINT_TYPES = { 'bulk': 2, 'interrupt': 3 }
+
+
+def fail(message):
+	print(os.path.basename(args.descriptor) + ': ' + message)
+	sys.exit(1)
+
+
+def defineName(name):
+	return name.upper().replace('-', '_')
+
+
+def varName(name):
+	return name.title().replace('-', '')
+
+
+def hexBytes(values):
+	return ', '.join('0x%02x' % v for v in values)
+
+
 def printTextDescriptor(out, text, var):
 	textByte = text.encode('utf-16')
 	length = 0
@@ -37,9 +99,253 @@ def printTextDescriptor(out, text, var):
 	out.write('};\n')
 	out.write('\n')
 
-with open(path + '/usb-descriptor.h', 'w') as out:
+# ----------------------------------------------------------------------------
+# Strings: language, manufacturer, product, serial, additional strings, and the names
+# of the enabled interfaces, numbered per variant
+# ----------------------------------------------------------------------------
+
+strings = [
+	('manufacturer', descriptor['manufacturer-text']),
+	('product', descriptor['product-text']),
+	('serial', descriptor['serial-text'])
+]
+for name in descriptor.get('strings', {}):
+	strings.append((name, descriptor['strings'][name]))
+
+allInterfaces = descriptor['interfaces']
+stringInterfaces = [i for i in allInterfaces if 'string' in i]
+
+# ----------------------------------------------------------------------------
+# Endpoints and interfaces
+# ----------------------------------------------------------------------------
+
+# lib/usb-cdc.c answers the control requests with one packet of up to 64 bytes, e.g. the
+# device config and the statistics, they are not split into smaller packets
+ep0Size = descriptor['endpoint0-size']
+if ep0Size != BUFFER_SIZE:
+	fail('endpoint0-size needs to be 64, the firmware sends the control replies in one packet')
+
+maxPower = descriptor.get('max-power-ma', 100) // 2
+
+# Endpoints (number, direction, type) of the interfaces, as set up by the firmware
+FIRMWARE_ENDPOINTS = {
+	'cdc': [(1, 'in', 'interrupt'), (2, 'in', 'bulk'), (2, 'out', 'bulk')],
+	'vendor': [(3, 'in', 'bulk'), (3, 'out', 'bulk')]
+}
+
+for interface in allInterfaces:
+	name = interface['name']
+	if interface['type'] not in FIRMWARE_ENDPOINTS:
+		fail('Interface ' + name + ': type ' + interface['type'] + ' is not supported by the firmware, only cdc and vendor')
+
+	if len([i for i in allInterfaces if i['type'] == interface['type']]) > 1:
+		fail('Interface ' + name + ': only one ' + interface['type'] + ' interface is supported')
+
+	for ep in interface['endpoints']:
+		if ep['size'] > 64 or ep['type'] not in ENDPOINT_TYPES:
+			fail('Endpoint %d %s: max. 64 bytes, bulk or interrupt' % (ep['endpoint'], ep['direction']))
+
+		# lib/usb-cdc.c and lib/vendor.c send and receive up to 64 bytes per packet. The interrupt
+		# endpoint only NAKs, its size is only in the descriptor
+		if ep['type'] == 'bulk' and ep['size'] != BUFFER_SIZE:
+			fail('Endpoint %d %s: bulk endpoints need 64 bytes, the firmware uses full packets' % (ep['endpoint'], ep['direction']))
+
+	endpoints = sorted((ep['endpoint'], ep['direction'], ep['type']) for ep in interface['endpoints'])
+	if interface['type'] == 'cdc':
+		# lib/usb-cdc.c uses fixed endpoints
+		if 'option' in interface or endpoints != FIRMWARE_ENDPOINTS['cdc']:
+			fail('The CDC interface is always enabled, and needs the notification on EP1 IN, and the data on EP2 IN / OUT')
+	elif interface.get('option') != 'VENDOR_BULK' or endpoints != FIRMWARE_ENDPOINTS['vendor']:
+		# EP3 is only set up with VENDOR_BULK_ENABLE, lib/vendor.c
+		fail('The vendor interface needs the option VENDOR_BULK, and the data on EP3 IN / OUT (bulk)')
+
+if not [i for i in allInterfaces if i['type'] == 'cdc']:
+	fail('The CDC interface is needed, see lib/usb-cdc.c')
+
+options = []
+for interface in allInterfaces:
+	if 'option' in interface and interface['option'] not in options:
+		options.append(interface['option'])
+
+modBits = {
+	(1, 'in'): ('UEP4_1_MOD', 'bUEP1_TX_EN'),
+	(2, 'out'): ('UEP2_3_MOD', 'bUEP2_RX_EN'),
+	(2, 'in'): ('UEP2_3_MOD', 'bUEP2_TX_EN'),
+	(3, 'out'): ('UEP2_3_MOD', 'bUEP3_RX_EN'),
+	(3, 'in'): ('UEP2_3_MOD', 'bUEP3_TX_EN')
+}
+
+
+def endpointDescriptor(ep):
+	address = ep['endpoint'] | (0x80 if ep['direction'] == 'in' else 0)
+	return ('Endpoint 0x%02x, %s, %d bytes' % (address, ep['type'], ep['size']),
+		[0x07, 0x05, address, ENDPOINT_TYPES[ep['type']], ep['size'] & 0xff, ep['size'] >> 8, ep.get('interval', 0)])
+
+
+def interfaceDescriptor(number, endpointCount, cls, subclass, protocol, string):
+	return [0x09, 0x04, number, 0x00, endpointCount, cls, subclass, protocol, string]
+
+
+class Variant:
+	"""
+	Interfaces, endpoints, buffers and configuration descriptor for one combination of the options
+	"""
+
+	def __init__(self, enabled):
+		self.enabled = enabled
+		self.interfaces = [i for i in allInterfaces if 'option' not in i or i['option'] in enabled]
+
+		# (endpoint number, 'in' / 'out') -> endpoint
+		self.endpoints = {}
+		self.numbers = {}
+
+		self.interfaceCount = 0
+		for interface in self.interfaces:
+			self.numbers[interface['name']] = self.interfaceCount
+			self.interfaceCount += 2 if interface['type'] == 'cdc' else 1
+
+			for ep in interface['endpoints']:
+				self.endpoints[(ep['endpoint'], ep['direction'])] = ep
+
+		# Names of the enabled interfaces after the fixed strings, so the indices are contiguous
+		self.strings = strings + [(i['name'], i['string']) for i in self.interfaces if 'string' in i]
+		self.stringIndex = {}
+		for i, (name, text) in enumerate(self.strings):
+			self.stringIndex[name] = i + 1
+
+		# Interface association descriptor for the CDC, if there are other interfaces
+		self.composite = len(self.interfaces) > 1
+
+		# XRAM buffers, per endpoint: OUT at the DMA address, IN after it
+		self.buffers = {}
+		addr = 0
+		for number in range(4):
+			directions = [d for d in ('out', 'in') if (number, d) in self.endpoints]
+			if number == 0:
+				directions = ['ep0']
+			elif not directions:
+				continue
+
+			self.buffers[number] = (addr, len(directions) * BUFFER_SIZE)
+			addr += len(directions) * BUFFER_SIZE
+
+		self.usbXramEnd = addr
+		self.xramLoc = addr + NOINIT_SIZE
+
+		self.mod = { 'UEP4_1_MOD': [], 'UEP2_3_MOD': [] }
+		for key in sorted(self.endpoints):
+			register, bit = modBits[key]
+			self.mod[register].append(bit)
+
+		self.buildConfiguration()
+
+	def buildConfiguration(self):
+		"""
+		Configuration descriptor, list of (comment, bytes)
+		"""
+		self.configuration = []
+
+		for interface in self.interfaces:
+			number = self.numbers[interface['name']]
+			name = interface['name']
+			string = self.stringIndex.get(name, 0)
+			eps = sorted(interface['endpoints'], key=lambda ep: (ep['endpoint'], ep['direction'] == 'in'))
+
+			if interface['type'] == 'cdc':
+				notify = [ep for ep in eps if ep['type'] == 'interrupt']
+				data = [ep for ep in eps if ep['type'] == 'bulk']
+
+				if self.composite:
+					self.configuration.append(('Interface association: CDC, interfaces %d and %d' % (number, number + 1),
+						[0x08, 0x0b, number, 0x02, 0x02, 0x02, 0x01, 0x00]))
+
+				self.configuration.append(('Interface %d: CDC communication (one endpoint)' % number,
+					interfaceDescriptor(number, 1, 0x02, 0x02, 0x01, string)))
+				self.configuration.append(('Function descriptor (header)', [0x05, 0x24, 0x00, 0x10, 0x01]))
+				self.configuration.append(('Management descriptor (no data class interface) 03 01', [0x05, 0x24, 0x01, 0x00, 0x00]))
+				self.configuration.append(('Support Set_Line_Coding, Set_Control_Line_State, Get_Line_Coding, Serial_State',
+					[0x04, 0x24, 0x02, 0x02]))
+				self.configuration.append(('CDC interface numbered %d; data class interface number %d' % (number, number + 1),
+					[0x05, 0x24, 0x06, number, number + 1]))
+				self.configuration += [endpointDescriptor(ep) for ep in notify]
+
+				self.configuration.append(('Interface %d: CDC data' % (number + 1),
+					interfaceDescriptor(number + 1, len(data), 0x0a, 0x00, 0x00, 0)))
+				self.configuration += [endpointDescriptor(ep) for ep in data]
+
+			else:
+				self.configuration.append(('Interface %d: vendor specific, %s' % (number, name),
+					interfaceDescriptor(number, len(eps), 0xff, 0x00, 0x00, string)))
+				self.configuration += [endpointDescriptor(ep) for ep in eps]
+
+		self.totalLength = 9 + sum(len(b) for c, b in self.configuration)
+
+	def condition(self):
+		"""
+		Preprocessor condition of this variant
+		"""
+		return ' && '.join(('' if o in self.enabled else '!') + o + '_ENABLE' for o in options)
+
+	def makeKey(self):
+		"""
+		Concatenated make variables of the options
+		"""
+		return ''.join('1' if o in self.enabled else '0' for o in options)
+
+
+variants = []
+for flags in itertools.product([False, True], repeat=len(options)):
+	variants.append(Variant([o for o, flag in zip(options, flags) if flag]))
+
+if args.check:
+	sys.exit(0)
+
+
+def writeVariants(out, write):
+	"""
+	Write the variant specific part, with #if for each combination of the options
+	"""
+	if not options:
+		write(out, variants[0])
+		return
+
+	for i, variant in enumerate(variants):
+		out.write(('#if ' if i == 0 else '#elif ') + variant.condition() + '\n')
+		out.write('\n')
+		write(out, variant)
+	out.write('#endif\n')
+	out.write('\n')
+
+# ----------------------------------------------------------------------------
+# usb-layout.h
+# ----------------------------------------------------------------------------
+
+def writeLayout(out, v):
+	out.write('// Interface name strings, number of string descriptors including the language\n')
+	for name, text in v.strings[len(strings):]:
+		out.write('#define USB_STRING_' + defineName(name) + ' ' + str(v.stringIndex[name]) + '\n')
+	out.write('#define USB_STRINGS ' + str(len(v.strings) + 1) + '\n')
+	out.write('\n')
+	out.write('// Interfaces\n')
+	out.write('#define USB_INTERFACES ' + str(v.interfaceCount) + '\n')
+	out.write('\n')
+	out.write('// XRAM buffers, OUT at the address, IN after it\n')
+	for number in sorted(v.buffers):
+		out.write('#define USB_EP%d_BUFFER 0x%04x\n' % (number, v.buffers[number][0]))
+		out.write('#define USB_EP%d_BUFFER_SIZE %d\n' % (number, v.buffers[number][1]))
+	out.write('\n')
+	out.write('// First XRAM address after the USB buffers\n')
+	out.write('#define USB_XRAM_END 0x%04x\n' % v.usbXramEnd)
+	out.write('\n')
+	out.write('// Endpoint mode, for USBDeviceEndPointCfg()\n')
+	for register in ('UEP4_1_MOD', 'UEP2_3_MOD'):
+		out.write('#define USB_' + register + ' ' + ('(' + ' | '.join(v.mod[register]) + ')' if v.mod[register] else '0') + '\n')
+	out.write('\n')
+
+
+with open(path + '/usb-layout.h', 'w') as out:
 	out.write('/**\n')
-	out.write(' * USB Descriptors\n')
+	out.write(' * USB interfaces, endpoints and XRAM buffer layout\n')
 	out.write(' *\n')
 	out.write(' * ** Automatically generated! **\n')
 	out.write(' * ** Do not change, change usb-descriptor.json! **\n')
@@ -47,13 +353,52 @@ with open(path + '/usb-descriptor.h', 'w') as out:
 	out.write('\n')
 	out.write('#pragma once\n')
 	out.write('\n')
-	out.write('#include "../lib/inc.h"\n')
+	if options:
+		out.write('// Options, set in the Makefile\n')
+		for o in options:
+			out.write('#ifndef ' + o + '_ENABLE\n')
+			out.write('#define ' + o + '_ENABLE 0\n')
+			out.write('#endif\n')
+	out.write('// String indices\n')
+	for i, (name, text) in enumerate(strings):
+		out.write('#define USB_STRING_' + defineName(name) + ' ' + str(i + 1) + '\n')
 	out.write('\n')
+	out.write('#define USB_EP0_SIZE ' + str(ep0Size) + '\n')
+	out.write('\n')
+	writeVariants(out, writeLayout)
+
+# ----------------------------------------------------------------------------
+# usb-layout.mk
+# ----------------------------------------------------------------------------
+
+with open(path + '/usb-layout.mk', 'w') as out:
+	out.write('# XRAM layout, automatically generated by usb-descriptor/generate.py, change usb-descriptor.json!\n')
+	for i, v in enumerate(variants):
+		if options:
+			out.write(('' if i == 0 else 'else ') + 'ifeq (' + ''.join('$(' + o + ')' for o in options) + ',' + v.makeKey() + ')\n')
+		out.write('# 0x0000 ... 0x%04x USB buffers, 0x%04x ... 0x%04x not initialized, the rest is used by the compiler\n'
+			% (v.usbXramEnd - 1, v.usbXramEnd, v.xramLoc - 1))
+		out.write('XRAM_LOC = 0x%04x\n' % v.xramLoc)
+		out.write('XRAM_SIZE = 0x%04x\n' % (XRAM_END - v.xramLoc))
+	if options:
+		out.write('else\n')
+		out.write('$(error ' + ', '.join(options) + (' needs' if len(options) == 1 else ' need') + ' to be 0 or 1)\n')
+		out.write('endif\n')
+
+# ----------------------------------------------------------------------------
+# usb-descriptor.h
+# ----------------------------------------------------------------------------
+
+def writeDescriptors(out, v):
 	out.write('// Device descriptor\n')
 	out.write('\n')
 	out.write('__code uint8_t g_DescriptorDevice[] = {\n')
 	out.write('\t0x12, 0x01, 0x10, 0x01,\n')
-	out.write('\t0x02, 0x00, 0x00, DEFAULT_ENDP0_SIZE,\n')
+	if v.composite:
+		out.write('\t// Composite device with interface association\n')
+		out.write('\t0xef, 0x02, 0x01, USB_EP0_SIZE,\n')
+	else:
+		out.write('\t0x02, 0x00, 0x00, USB_EP0_SIZE,\n')
 	out.write('\n')
 	out.write('\t// ' + descriptor['vendor-info'] + '\n')
 	out.write('\t// Vendor\n')
@@ -61,7 +406,7 @@ with open(path + '/usb-descriptor.h', 'w') as out:
 
 	vendorId = descriptor['vendor']
 	out.write('0x' + vendorId[2:4] + ', 0x' + vendorId[0:2] + ',')
-	
+
 	out.write('\n')
 	out.write('\n')
 
@@ -74,34 +419,129 @@ with open(path + '/usb-descriptor.h', 'w') as out:
 
 	out.write('\n')
 	out.write('\n')
-	out.write('\t0x00, 0x01, 0x01, 0x02,\n')
-	out.write('\t0x03, 0x01\n')
+	out.write('\t0x00, 0x01, USB_STRING_MANUFACTURER, USB_STRING_PRODUCT,\n')
+	out.write('\tUSB_STRING_SERIAL, 0x01\n')
 	out.write('};\n')
 	out.write('\n')
 
-	file1 = open(path + '/part1.template.h', 'r')
-	while True:
-		line = file1.readline()
-		# end of file is reached
-		if not line:
-			break
+	out.write('__code uint8_t g_DescriptorConfiguration[] = {\n')
+	out.write('\t// ------------------------------------------------------------------------\n')
+	out.write('\t// Configuration descriptor (%d interfaces, %d bytes)\n' % (v.interfaceCount, v.totalLength))
+	out.write('\t// ------------------------------------------------------------------------\n')
+	out.write('\t' + hexBytes([0x09, 0x02, v.totalLength & 0xff, v.totalLength >> 8, v.interfaceCount, 0x01, 0x00, 0xa0, maxPower]) + ',\n')
+	for comment, values in v.configuration:
+		out.write('\n')
+		out.write('\t// ' + comment + '\n')
+		out.write('\t' + hexBytes(values) + ',\n')
+	out.write('};\n')
+	out.write('\n')
 
-		out.write(line)
 
-	file1.close() 
+def writeOptional(out, interface, write):
+	"""
+	Write a part of an interface, with #if if the interface has an option
+	"""
+	if 'option' in interface:
+		out.write('#if ' + interface['option'] + '_ENABLE\n')
+	write()
+	if 'option' in interface:
+		out.write('#endif\n')
 
 
-	out.write('// Serial number string descriptor\n')
-	out.write('// Use this as identifier for Linux and Windows,\n')
-	out.write('// the Name is the only Attribute displayed on Windows\n')
-	
-	printTextDescriptor(out, descriptor['serial-text'], 'g_DescriptorSerial')
+def writeTable(out):
+	# Descriptor table entries (type, index, var), ordered by type and index, the strings are the
+	# last type, so the interface names of disabled interfaces can be left out at the end
+	table = [
+		(TYPE_DEVICE, '0', 'g_DescriptorDevice'),
+		(TYPE_CONFIGURATION, '0', 'g_DescriptorConfiguration'),
+		(TYPE_STRING, '0', 'g_DescriptorLanguage')
+	]
+	for i, (name, text) in enumerate(strings):
+		table.append((TYPE_STRING, str(i + 1), 'g_Descriptor' + varName(name)))
 
-	out.write('// Product string descriptor\n')
-	printTextDescriptor(out, descriptor['product-text'], 'g_DescriptorProduct')
+	out.write('// Ordered by type and index\n')
+	out.write('__code UsbDescriptor g_DescriptorTable[] = {\n')
 
-	out.write('// Manufacturer string descriptor\n')
-	printTextDescriptor(out, descriptor['manufacturer-text'], 'g_DescriptorManufacturer')
+	first = {}
+	count = {}
+	for i, (descriptorType, index, var) in enumerate(table):
+		if descriptorType not in first:
+			first[descriptorType] = i
+			count[descriptorType] = 0
+		out.write('\t{ 0x%02x, %s, %s, sizeof(%s) },\n' % (descriptorType, index, var, var))
+		count[descriptorType] += 1
 
+	for interface in stringInterfaces:
+		var = 'g_Descriptor' + varName(interface['name'])
+		writeOptional(out, interface, lambda: out.write('\t{ 0x%02x, USB_STRING_%s, %s, sizeof(%s) },\n'
+			% (TYPE_STRING, defineName(interface['name']), var, var)))
 
+	out.write('};\n')
+	out.write('\n')
+
+	types = TYPE_STRING + 1
+	count = [str(count.get(t, 0)) for t in range(types)]
+	count[TYPE_STRING] = 'USB_STRINGS'
+	out.write('// Descriptor types 0 ... USB_DESCRIPTOR_TYPES - 1: first table entry and count\n')
+	out.write('#define USB_DESCRIPTOR_TYPES ' + str(types) + '\n')
+	out.write('__code uint8_t g_DescriptorTypeFirst[] = { ' + ', '.join(str(first.get(t, 0)) for t in range(types)) + ' };\n')
+	out.write('__code uint8_t g_DescriptorTypeCount[] = { ' + ', '.join(count) + ' };\n')
+	out.write('\n')
+
+
+with open(path + '/usb-descriptor.h', 'w') as out:
+	out.write('/**\n')
+	out.write(' * USB Descriptors\n')
+	out.write(' *\n')
+	out.write(' * ** Automatically generated! **\n')
+	out.write(' * ** Do not change, change usb-descriptor.json! **\n')
+	out.write(' */\n')
+	out.write('\n')
+	out.write('#pragma once\n')
+	out.write('\n')
+	out.write('#include "../lib/inc.h"\n')
+	out.write('#include "usb-layout.h"\n')
+	out.write('\n')
+
+	writeVariants(out, writeDescriptors)
+
+	out.write('// ----------------------------------------------------------------------------\n')
+	out.write('// String descriptor\n')
+	out.write('// ----------------------------------------------------------------------------\n')
+	out.write('\n')
+	out.write('// Language descriptor: English\n')
+	out.write('unsigned char __code g_DescriptorLanguage[] = { 0x04, 0x03, 0x09, 0x04 };\n')
+	out.write('\n')
+
+	for name, text in strings:
+		if name == 'serial':
+			out.write('// Serial number string descriptor\n')
+			out.write('// Use this as identifier for Linux and Windows,\n')
+			out.write('// the Name is the only Attribute displayed on Windows\n')
+		else:
+			out.write('// String descriptor ' + name + '\n')
+		printTextDescriptor(out, text, 'g_Descriptor' + varName(name))
+
+	# Interface names, only if the interface is enabled
+	for interface in stringInterfaces:
+		out.write('// String descriptor ' + interface['name'] + '\n')
+		writeOptional(out, interface, lambda: printTextDescriptor(out, interface['string'], 'g_Descriptor' + varName(interface['name'])))
+		if 'option' in interface:
+			out.write('\n')
+
+	out.write('// ----------------------------------------------------------------------------\n')
+	out.write('// Descriptor table\n')
+	out.write('// ----------------------------------------------------------------------------\n')
+	out.write('\n')
+	out.write('/**\n')
+	out.write(' * Descriptor, entry of g_DescriptorTable\n')
+	out.write(' */\n')
+	out.write('typedef struct {\n')
+	out.write('\tuint8_t type;\n')
+	out.write('\tuint8_t index;\n')
+	out.write('\tconst __code uint8_t* data;\n')
+	out.write('\tuint16_t length;\n')
+	out.write('} UsbDescriptor;\n')
+	out.write('\n')
 
+	writeTable(out)